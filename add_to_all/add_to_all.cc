@@ -0,0 +1,137 @@
+//
+// Q16's addToAll (dambuster_questions/Q16.cpp); the four versions from the question against
+// the kernels in add_to_all.hh, on AoS vec3 arrays and on Vec3SoA.
+//
+// First every kernel is checked against addToAll_slow on sizes that exercise the tails (each
+// float goes through the same single add whatever the kernel, so the results must be exactly
+// the same), then each is timed at three sizes; one that fits in L1, Q16's 1M vec3s (12MB) and
+// 32M (384MB) which fits in no cache. Built at -O2 and -O3 (see the makefile).
+//
+
+#include "vec3_soa.hh"
+#include "add_to_all.hh"
+#include "experiment.hh"
+#include "q16.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+std::vector<vec3> makeArray(std::size_t count)
+{
+  std::vector<vec3> array(count);
+  for(std::size_t i {0}; i < count; ++i)
+    array[i] = vec3{static_cast<float>(i), static_cast<float>(i * 2), static_cast<float>(i * 3)};
+  return array;
+}
+
+struct AoSKernel
+{
+  std::string name;
+  std::function<void(vec3*, std::size_t)> run;
+};
+
+std::vector<AoSKernel> aosKernels()
+{
+  std::vector<AoSKernel> out {
+    {"Q16 addToAll_slow", [](vec3 *a, std::size_t n){
+      vec3 t = toAdd;
+      addToAll_slow(a, &t, static_cast<unsigned>(n));
+    }},
+    {"Q16 addToAll_fast1", [](vec3 *a, std::size_t n){ addToAll_fast1(a, toAdd, static_cast<unsigned>(n)); }},
+    {"Q16 addToAll_fast2", [](vec3 *a, std::size_t n){ addToAll_fast2(a, toAdd, static_cast<unsigned>(n)); }},
+    {"Q16 addToAll_fast3", [](vec3 *a, std::size_t n){ addToAll_fast3(a, toAdd, static_cast<unsigned>(n)); }},
+  };
+  for(Isa isa : {Isa::plain, Isa::sse, Isa::avx2, Isa::avx512})
+    if(isaSupported(isa))
+      out.push_back({std::string("AoS ") + isaName(isa),
+                     [isa](vec3 *a, std::size_t n){ addToAll(a, n, toAdd, isa); }});
+  return out;
+}
+
+std::vector<Isa> soaIsas()
+{
+  std::vector<Isa> out;
+  for(Isa isa : {Isa::plain, Isa::sse, Isa::avx2, Isa::avx512})
+    if(isaSupported(isa))
+      out.push_back(isa);
+  return out;
+}
+
+void testKernels()
+{
+  for(std::size_t n : {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 47, 48, 49, 100, 1001}){
+    std::vector<vec3> expected = makeArray(n);
+    //
+    // a guard vec3 past the end to catch a tail that writes too far.
+    //
+    expected.push_back(vec3{-1.0f, -2.0f, -3.0f});
+    addToAll_slow(expected.data(), const_cast<vec3*>(&toAdd), static_cast<unsigned>(n));
+
+    for(const AoSKernel& k : aosKernels()){
+      std::vector<vec3> array = makeArray(n);
+      array.push_back(vec3{-1.0f, -2.0f, -3.0f});
+      k.run(array.data(), n);
+      for(std::size_t i {0}; i <= n; ++i)
+        assert(same(array[i], expected[i]));
+    }
+    for(Isa isa : soaIsas()){
+      std::vector<vec3> aos = makeArray(n);
+      Vec3SoA soa {aos.data(), n};
+      addToAll(soa, toAdd, isa);
+      for(std::size_t i {0}; i < n; ++i)
+        assert(same(soa[i], expected[i]));
+    }
+  }
+  std::cout << "all kernels match addToAll_slow, including tails" << std::endl;
+}
+
+//
+// ns per vec3, best of several runs of enough passes to take a while.
+//
+template<typename F>
+double nsPerVec3(std::size_t count, F&& pass)
+{
+  std::size_t passes = std::max<std::size_t>(1, 50'000'000 / count);
+  double best {1e30};
+  for(int r {0}; r < 5; ++r){
+    auto t0 = std::chrono::steady_clock::now();
+    for(std::size_t p {0}; p < passes; ++p)
+      pass();
+    auto t1 = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / (passes * count));
+  }
+  return best;
+}
+
+void bench(std::size_t count)
+{
+  std::cout << count << " vec3s (" << count * sizeof(vec3) / 1024 << "KiB), ns per vec3:"
+            << std::endl;
+  std::vector<vec3> array = makeArray(count);
+  double slow {0.0};
+  for(const AoSKernel& k : aosKernels()){
+    double ns = nsPerVec3(count, [&]{ k.run(array.data(), count); });
+    if(slow == 0.0)
+      slow = ns;
+    std::cout << "  " << k.name << ": " << ns << " (" << slow / ns << "x)" << std::endl;
+  }
+  Vec3SoA soa {array.data(), count};
+  array.clear();
+  array.shrink_to_fit();
+  for(Isa isa : soaIsas()){
+    double ns = nsPerVec3(count, [&]{ addToAll(soa, toAdd, isa); });
+    std::cout << "  SoA " << isaName(isa) << ": " << ns << " (" << slow / ns << "x)" << std::endl;
+  }
+}
+
+int main()
+{
+  testKernels();
+  for(std::size_t count : {2'048, 1'000'000, 32'000'000})
+    bench(count);
+}
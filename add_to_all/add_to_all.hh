@@ -0,0 +1,233 @@
+#ifndef _ADD_TO_ALL_HH_
+#define _ADD_TO_ALL_HH_
+
+#include "vec3_soa.hh"
+
+#include <cstddef>
+
+#include <immintrin.h>
+
+//
+// Q16's addToAll, done properly.
+//
+// The real problem with addToAll_slow is not the dereferences (Q16.cpp tried that and got
+// nothing); it is that toAdd is a pointer which may point into array. For all the compiler
+// knows, writing array->x changes toAdd->y, so it has to reload toAdd every time round and
+// can't vectorise at all. Q16's fast2/fast3 fix that by taking toAdd by value, after which the
+// compiler can vectorise, but the vec3s are 12 bytes so a vector of floats is never a whole
+// number of them.
+//
+// Everything here takes toAdd by value, so there is nothing for it to alias, and works on;
+//
+//  - Vec3SoA, where it is three streams of floats each with one value added. The kernels are
+//    the same loop at 4 (SSE), 8 (AVX2) and 16 (AVX-512) floats a go, with a scalar (SSE,
+//    AVX2) or masked (AVX-512) tail for the last few.
+//  - plain vec3 arrays (AoS). The trick is that over 4 vec3s (12 floats) the addend repeats;
+//    x y z x | y z x y | z x y z. So build those three registers once, with shuffles, and add
+//    them in turn to 3 loads. The same for 8 vec3s in 3 AVX2 registers and 16 in 3 AVX-512.
+//
+// Each kernel is compiled for its own instruction set with a target attribute, so they can
+// all be in one binary whatever -march says; addToAll() picks the best one the CPU has.
+//
+
+enum class Isa {plain, sse, avx2, avx512};
+
+inline const char* isaName(Isa isa)
+{
+  switch(isa){
+  case Isa::plain: return "plain";
+  case Isa::sse: return "sse";
+  case Isa::avx2: return "avx2";
+  case Isa::avx512: return "avx512";
+  }
+  return "?";
+}
+
+inline bool isaSupported(Isa isa)
+{
+  switch(isa){
+  case Isa::plain: return true;
+  case Isa::sse: return __builtin_cpu_supports("sse2");
+  case Isa::avx2: return __builtin_cpu_supports("avx2");
+  case Isa::avx512: return __builtin_cpu_supports("avx512f");
+  }
+  return false;
+}
+
+inline Isa bestIsa()
+{
+  static const Isa best = isaSupported(Isa::avx512) ? Isa::avx512 :
+                          isaSupported(Isa::avx2) ? Isa::avx2 : Isa::sse;
+  return best;
+}
+
+////////////////////////////////////////// SoA //////////////////////////////////////////////
+
+//
+// whatever the compiler makes of it; restrict says the three streams don't overlap.
+//
+inline void addToAllSoA_plain(float *__restrict x, float *__restrict y, float *__restrict z,
+                              std::size_t n, vec3 toAdd)
+{
+  for(std::size_t i {0}; i < n; ++i){
+    x[i] += toAdd.x;
+    y[i] += toAdd.y;
+    z[i] += toAdd.z;
+  }
+}
+
+__attribute__((target("sse2")))
+inline void addToAllSoA_sse(float *__restrict x, float *__restrict y, float *__restrict z,
+                            std::size_t n, vec3 toAdd)
+{
+  const __m128 ax = _mm_set1_ps(toAdd.x), ay = _mm_set1_ps(toAdd.y), az = _mm_set1_ps(toAdd.z);
+  std::size_t i {0};
+  for(; i + 4 <= n; i += 4){
+    _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), ax));
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), ay));
+    _mm_storeu_ps(z + i, _mm_add_ps(_mm_loadu_ps(z + i), az));
+  }
+  addToAllSoA_plain(x + i, y + i, z + i, n - i, toAdd);
+}
+
+__attribute__((target("avx2")))
+inline void addToAllSoA_avx2(float *__restrict x, float *__restrict y, float *__restrict z,
+                             std::size_t n, vec3 toAdd)
+{
+  const __m256 ax = _mm256_set1_ps(toAdd.x), ay = _mm256_set1_ps(toAdd.y), az = _mm256_set1_ps(toAdd.z);
+  std::size_t i {0};
+  for(; i + 8 <= n; i += 8){
+    _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), ax));
+    _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), ay));
+    _mm256_storeu_ps(z + i, _mm256_add_ps(_mm256_loadu_ps(z + i), az));
+  }
+  addToAllSoA_sse(x + i, y + i, z + i, n - i, toAdd);
+}
+
+__attribute__((target("avx512f")))
+inline void addToAllSoA_avx512(float *__restrict x, float *__restrict y, float *__restrict z,
+                               std::size_t n, vec3 toAdd)
+{
+  const __m512 ax = _mm512_set1_ps(toAdd.x), ay = _mm512_set1_ps(toAdd.y), az = _mm512_set1_ps(toAdd.z);
+  std::size_t i {0};
+  for(; i + 16 <= n; i += 16){
+    _mm512_storeu_ps(x + i, _mm512_add_ps(_mm512_loadu_ps(x + i), ax));
+    _mm512_storeu_ps(y + i, _mm512_add_ps(_mm512_loadu_ps(y + i), ay));
+    _mm512_storeu_ps(z + i, _mm512_add_ps(_mm512_loadu_ps(z + i), az));
+  }
+  if(i < n){
+    //
+    // the last 1-15 with a mask; masked off lanes are neither read nor written.
+    //
+    __mmask16 m = static_cast<__mmask16>((1u << (n - i)) - 1);
+    _mm512_mask_storeu_ps(x + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, x + i), ax));
+    _mm512_mask_storeu_ps(y + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, y + i), ay));
+    _mm512_mask_storeu_ps(z + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, z + i), az));
+  }
+}
+
+inline void addToAll(Vec3SoA& array, vec3 toAdd, Isa isa = bestIsa())
+{
+  switch(isa){
+  case Isa::plain: addToAllSoA_plain(array.x(), array.y(), array.z(), array.size(), toAdd); break;
+  case Isa::sse: addToAllSoA_sse(array.x(), array.y(), array.z(), array.size(), toAdd); break;
+  case Isa::avx2: addToAllSoA_avx2(array.x(), array.y(), array.z(), array.size(), toAdd); break;
+  case Isa::avx512: addToAllSoA_avx512(array.x(), array.y(), array.z(), array.size(), toAdd); break;
+  }
+}
+
+////////////////////////////////////////// AoS //////////////////////////////////////////////
+
+inline void addToAllAoS_plain(vec3 *array, std::size_t num, vec3 toAdd)
+{
+  for(std::size_t i {0}; i < num; ++i){
+    array[i].x += toAdd.x;
+    array[i].y += toAdd.y;
+    array[i].z += toAdd.z;
+  }
+}
+
+__attribute__((target("sse2")))
+inline void addToAllAoS_sse(vec3 *array, std::size_t num, vec3 toAdd)
+{
+  //
+  // t = x y z _, then the three rotations of it which line up with 4 vec3s.
+  //
+  const __m128 t = _mm_setr_ps(toAdd.x, toAdd.y, toAdd.z, 0.0f);
+  const __m128 a0 = _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 2, 1, 0));   // x y z x
+  const __m128 a1 = _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 2, 1));   // y z x y
+  const __m128 a2 = _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 1, 0, 2));   // z x y z
+  float *p = &array->x;
+  std::size_t i {0};
+  for(; i + 4 <= num; i += 4, p += 12){
+    _mm_storeu_ps(p, _mm_add_ps(_mm_loadu_ps(p), a0));
+    _mm_storeu_ps(p + 4, _mm_add_ps(_mm_loadu_ps(p + 4), a1));
+    _mm_storeu_ps(p + 8, _mm_add_ps(_mm_loadu_ps(p + 8), a2));
+  }
+  addToAllAoS_plain(array + i, num - i, toAdd);
+}
+
+__attribute__((target("avx2")))
+inline void addToAllAoS_avx2(vec3 *array, std::size_t num, vec3 toAdd)
+{
+  //
+  // 8 vec3s are 24 floats, 3 registers; float k of them gets component k % 3.
+  //
+  const __m256 t = _mm256_setr_ps(toAdd.x, toAdd.y, toAdd.z, 0, 0, 0, 0, 0);
+  const __m256 a0 = _mm256_permutevar8x32_ps(t, _mm256_setr_epi32(0, 1, 2, 0, 1, 2, 0, 1));
+  const __m256 a1 = _mm256_permutevar8x32_ps(t, _mm256_setr_epi32(2, 0, 1, 2, 0, 1, 2, 0));
+  const __m256 a2 = _mm256_permutevar8x32_ps(t, _mm256_setr_epi32(1, 2, 0, 1, 2, 0, 1, 2));
+  float *p = &array->x;
+  std::size_t i {0};
+  for(; i + 8 <= num; i += 8, p += 24){
+    _mm256_storeu_ps(p, _mm256_add_ps(_mm256_loadu_ps(p), a0));
+    _mm256_storeu_ps(p + 8, _mm256_add_ps(_mm256_loadu_ps(p + 8), a1));
+    _mm256_storeu_ps(p + 16, _mm256_add_ps(_mm256_loadu_ps(p + 16), a2));
+  }
+  addToAllAoS_sse(array + i, num - i, toAdd);
+}
+
+__attribute__((target("avx512f")))
+inline void addToAllAoS_avx512(vec3 *array, std::size_t num, vec3 toAdd)
+{
+  //
+  // 16 vec3s are 48 floats; the three registers start on x, y and z. 16 % 3 == 1 so each
+  // starts one component on from the last.
+  //
+  const __m512 t = _mm512_setr_ps(toAdd.x, toAdd.y, toAdd.z, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m512i i0 = _mm512_setr_epi32(0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0);
+  const __m512i i1 = _mm512_setr_epi32(1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1);
+  const __m512i i2 = _mm512_setr_epi32(2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2);
+  const __m512 a[3] {_mm512_permutexvar_ps(i0, t), _mm512_permutexvar_ps(i1, t),
+                     _mm512_permutexvar_ps(i2, t)};
+  float *p = &array->x;
+  std::size_t i {0};
+  for(; i + 16 <= num; i += 16, p += 48){
+    _mm512_storeu_ps(p, _mm512_add_ps(_mm512_loadu_ps(p), a[0]));
+    _mm512_storeu_ps(p + 16, _mm512_add_ps(_mm512_loadu_ps(p + 16), a[1]));
+    _mm512_storeu_ps(p + 32, _mm512_add_ps(_mm512_loadu_ps(p + 32), a[2]));
+  }
+  //
+  // the last 1-15 vec3s, 3-45 floats, as up to 3 masked registers; a[j] still lines up
+  // because they start on a multiple of 16 vec3s.
+  //
+  std::size_t left = 3 * (num - i);
+  for(int j {0}; left; ++j, p += 16){
+    std::size_t k = left < 16 ? left : 16;
+    __mmask16 m = static_cast<__mmask16>((1u << k) - 1);
+    _mm512_mask_storeu_ps(p, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, p), a[j]));
+    left -= k;
+  }
+}
+
+inline void addToAll(vec3 *array, std::size_t num, vec3 toAdd, Isa isa = bestIsa())
+{
+  switch(isa){
+  case Isa::plain: addToAllAoS_plain(array, num, toAdd); break;
+  case Isa::sse: addToAllAoS_sse(array, num, toAdd); break;
+  case Isa::avx2: addToAllAoS_avx2(array, num, toAdd); break;
+  case Isa::avx512: addToAllAoS_avx512(array, num, toAdd); break;
+  }
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _ADD_TO_ALL_PARALLEL_HH_
+#define _ADD_TO_ALL_PARALLEL_HH_
+
+#include "add_to_all.hh"
+#include "../skinning/parallel_for.hh"
+
+//
+// addToAll on every worker of a job system; each one runs the single threaded kernel from
+// add_to_all.hh over its own part of the array.
+//
+// The split points are 16 vec3s apart whatever the options say (and whatever the ISA); 16
+// vec3s are 192 bytes, three whole cache lines, and 16 floats of each Vec3SoA stream are one,
+// so no two workers write the same line (of a Vec3SoA always, of a vec3 array if it starts
+// on a line), and the AVX-512 kernels' chunks are whole registers, only the last has a tail.
+//
+
+inline void addToAll(JobSystem& js, Vec3SoA& array, vec3 toAdd, ParallelOptions options = {},
+                     Isa isa = bestIsa())
+{
+  options.align = (options.align + 15) / 16 * 16;
+  float *x = array.x(), *y = array.y(), *z = array.z();
+  parallelFor(js, 0, array.size(), [=](std::size_t first, std::size_t last){
+    switch(isa){
+    case Isa::plain: addToAllSoA_plain(x + first, y + first, z + first, last - first, toAdd); break;
+    case Isa::sse: addToAllSoA_sse(x + first, y + first, z + first, last - first, toAdd); break;
+    case Isa::avx2: addToAllSoA_avx2(x + first, y + first, z + first, last - first, toAdd); break;
+    case Isa::avx512: addToAllSoA_avx512(x + first, y + first, z + first, last - first, toAdd); break;
+    }
+  }, options);
+}
+
+inline void addToAll(JobSystem& js, vec3 *array, std::size_t num, vec3 toAdd,
+                     ParallelOptions options = {}, Isa isa = bestIsa())
+{
+  options.align = (options.align + 15) / 16 * 16;
+  parallelFor(js, 0, num, [=](std::size_t first, std::size_t last){
+    addToAll(array + first, last - first, toAdd, isa);
+  }, options);
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef _ADD_TO_ALL_STREAM_HH_
+#define _ADD_TO_ALL_STREAM_HH_
+
+#include "add_to_all.hh"
+#include "../skinning/cache_info.hh"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <immintrin.h>
+
+//
+// addToAll with non-temporal (streaming) stores, for arrays too big for the last level cache.
+//
+// An ordinary store leaves the line in the cache, dirty, until something pushes it out; over
+// an array bigger than the cache that something is the array itself, and on the way it pushes
+// out everything else (whatever the other threads, or the caller, had in there). A streaming
+// store (movntps) writes the line around the cache, and a line which was in the cache is
+// invalidated; as addToAll stores to every line it loads, a streamed pass leaves almost nothing
+// of the array behind it.
+//
+// Over an array which does fit, that is the opposite of what we want (the next pass would
+// have found it in cache), so Stores::automatic streams only when the array is bigger than
+// the last level cache (cache_info.hh, from sysfs or measured). As the kernel reads every line
+// before it writes it there is no read for ownership to save here, unlike a copy; what it
+// is meant to save is the cache, although the loads still bring every line in on the way
+// (see results.md for how that works out). An sfence at the end makes the streamed stores
+// visible to other threads in order with whatever the caller stores next, as streaming
+// stores are weakly ordered.
+//
+// Streaming stores need aligned addresses; Vec3SoA's streams are 64 byte aligned and padded
+// to 16 floats, so the SoA kernel goes to the end of the padding with no tail. A vec3 array
+// is treated as a run of floats; scalar up to the first 64 byte boundary, then 48 floats (16
+// vec3s) a go with the three addend registers rotated to the phase the boundary fell at, then
+// a scalar tail.
+//
+// AVX-512, or SSE where there is no AVX-512; the pass is limited by memory, not width, so an
+// AVX2 version wouldn't buy anything.
+//
+
+enum class Stores {normal, streaming, automatic};
+
+inline const char* storesName(Stores s)
+{
+  switch(s){
+  case Stores::normal: return "normal";
+  case Stores::streaming: return "streaming";
+  case Stores::automatic: return "automatic";
+  }
+  return "?";
+}
+
+//
+// arrays bigger than this are streamed by Stores::automatic.
+//
+inline std::size_t streamingThresholdBytes()
+{
+  std::size_t llc = cacheTopology().lastLevelSize();
+  return llc ? llc : std::size_t{32} << 20;
+}
+
+////////////////////////////////////////// SoA //////////////////////////////////////////////
+
+__attribute__((target("sse2")))
+inline void addToAllSoA_streamSse(float *x, float *y, float *z, std::size_t padded, vec3 toAdd)
+{
+  const __m128 ax = _mm_set1_ps(toAdd.x), ay = _mm_set1_ps(toAdd.y), az = _mm_set1_ps(toAdd.z);
+  for(std::size_t i {0}; i < padded; i += 4){
+    _mm_stream_ps(x + i, _mm_add_ps(_mm_load_ps(x + i), ax));
+    _mm_stream_ps(y + i, _mm_add_ps(_mm_load_ps(y + i), ay));
+    _mm_stream_ps(z + i, _mm_add_ps(_mm_load_ps(z + i), az));
+  }
+  _mm_sfence();
+}
+
+__attribute__((target("avx512f")))
+inline void addToAllSoA_streamAvx512(float *x, float *y, float *z, std::size_t padded, vec3 toAdd)
+{
+  const __m512 ax = _mm512_set1_ps(toAdd.x), ay = _mm512_set1_ps(toAdd.y), az = _mm512_set1_ps(toAdd.z);
+  for(std::size_t i {0}; i < padded; i += 16){
+    _mm512_stream_ps(x + i, _mm512_add_ps(_mm512_load_ps(x + i), ax));
+    _mm512_stream_ps(y + i, _mm512_add_ps(_mm512_load_ps(y + i), ay));
+    _mm512_stream_ps(z + i, _mm512_add_ps(_mm512_load_ps(z + i), az));
+  }
+  _mm_sfence();
+}
+
+inline void addToAll(Vec3SoA& array, vec3 toAdd, Stores stores, Isa isa = bestIsa())
+{
+  if(stores == Stores::normal ||
+     (stores == Stores::automatic && 3 * array.size() * sizeof(float) <= streamingThresholdBytes())){
+    addToAll(array, toAdd, isa);
+    return;
+  }
+  std::size_t padded = (array.size() + Vec3SoA::lane - 1) / Vec3SoA::lane * Vec3SoA::lane;
+  if(isa == Isa::avx512)
+    addToAllSoA_streamAvx512(array.x(), array.y(), array.z(), padded, toAdd);
+  else
+    addToAllSoA_streamSse(array.x(), array.y(), array.z(), padded, toAdd);
+}
+
+////////////////////////////////////////// AoS //////////////////////////////////////////////
+
+namespace stream_detail
+{
+  //
+  // floats of a vec3 array are x y z x y z ...; the addend of float k is component k % 3.
+  //
+  inline float addend(vec3 toAdd, std::size_t k)
+  { return k % 3 == 0 ? toAdd.x : k % 3 == 1 ? toAdd.y : toAdd.z; }
+
+  //
+  // floats up to the first 64 byte boundary, at most 15; p is 4 byte aligned as it is a float.
+  //
+  inline std::size_t toBoundary(const float *p, std::size_t total)
+  {
+    std::size_t misaligned = reinterpret_cast<std::uintptr_t>(p) % 64 / sizeof(float);
+    return misaligned ? std::min(total, 16 - misaligned) : 0;
+  }
+}
+
+__attribute__((target("sse2")))
+inline void addToAllAoS_streamSse(vec3 *array, std::size_t num, vec3 toAdd)
+{
+  using namespace stream_detail;
+  float *p = &array->x;
+  std::size_t total = 3 * num, k = toBoundary(p, total);
+  for(std::size_t i {0}; i < k; ++i)
+    p[i] += addend(toAdd, i);
+  //
+  // 12 floats (three registers) cover the pattern whatever phase k left it in.
+  //
+  __m128 a[3];
+  for(int r {0}; r < 3; ++r)
+    a[r] = _mm_setr_ps(addend(toAdd, k + 4 * r), addend(toAdd, k + 4 * r + 1),
+                       addend(toAdd, k + 4 * r + 2), addend(toAdd, k + 4 * r + 3));
+  for(; k + 12 <= total; k += 12)
+    for(int r {0}; r < 3; ++r)
+      _mm_stream_ps(p + k + 4 * r, _mm_add_ps(_mm_load_ps(p + k + 4 * r), a[r]));
+  _mm_sfence();
+  for(; k < total; ++k)
+    p[k] += addend(toAdd, k);
+}
+
+__attribute__((target("avx512f")))
+inline void addToAllAoS_streamAvx512(vec3 *array, std::size_t num, vec3 toAdd)
+{
+  using namespace stream_detail;
+  float *p = &array->x;
+  std::size_t total = 3 * num, k = toBoundary(p, total);
+  for(std::size_t i {0}; i < k; ++i)
+    p[i] += addend(toAdd, i);
+  //
+  // 48 floats (three registers) cover the pattern whatever phase k left it in.
+  //
+  alignas(64) float pattern[48];
+  for(std::size_t i {0}; i < 48; ++i)
+    pattern[i] = addend(toAdd, k + i);
+  const __m512 a0 = _mm512_load_ps(pattern), a1 = _mm512_load_ps(pattern + 16),
+               a2 = _mm512_load_ps(pattern + 32);
+  for(; k + 48 <= total; k += 48){
+    _mm512_stream_ps(p + k, _mm512_add_ps(_mm512_load_ps(p + k), a0));
+    _mm512_stream_ps(p + k + 16, _mm512_add_ps(_mm512_load_ps(p + k + 16), a1));
+    _mm512_stream_ps(p + k + 32, _mm512_add_ps(_mm512_load_ps(p + k + 32), a2));
+  }
+  _mm_sfence();
+  for(; k < total; ++k)
+    p[k] += addend(toAdd, k);
+}
+
+inline void addToAll(vec3 *array, std::size_t num, vec3 toAdd, Stores stores, Isa isa = bestIsa())
+{
+  if(stores == Stores::normal ||
+     (stores == Stores::automatic && num * sizeof(vec3) <= streamingThresholdBytes())){
+    addToAll(array, num, toAdd, isa);
+    return;
+  }
+  if(isa == Isa::avx512)
+    addToAllAoS_streamAvx512(array, num, toAdd);
+  else
+    addToAllAoS_streamSse(array, num, toAdd);
+}
+
+#endif
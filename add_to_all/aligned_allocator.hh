@@ -0,0 +1,166 @@
+#ifndef _ALIGNED_ALLOCATOR_HH_
+#define _ALIGNED_ALLOCATOR_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include <sys/mman.h>
+
+//
+// Memory for arrays the SIMD kernels go through; Q16 does new vec3[count], which is 16 byte
+// aligned, so a 64 byte register load is split across two cache lines three times in four.
+//
+// allocateAligned() gives memory starting on a cache line (or any power of 2), and with
+// Pages::huge backs it with 2MiB pages if it can. One 2MiB page covers what 512 4KiB pages
+// would, so a walk through a few hundred MB that would miss the TLB on nearly every line
+// doesn't; the sweeps don't care much (the hardware prefetchers and the page walker keep up),
+// random access does.
+//
+// Huge pages, in order of preference;
+//
+//  - MAP_HUGETLB, from the pool the admin reserved (vm.nr_hugepages), guaranteed 2MiB pages.
+//    Usually there is no pool, as here.
+//  - transparent huge pages; an ordinary mapping 2MiB aligned with madvise(MADV_HUGEPAGE),
+//    which the kernel backs with huge pages when it faults it in if it can find them (and if
+//    /sys/kernel/mm/transparent_hugepage/enabled isn't 'never').
+//
+// Either way it is mmap'd and must go back with freeAligned() given the same size and pages.
+// hugePageBytes() says how much of a range actually got huge pages, from /proc/self/smaps.
+//
+// AlignedAllocator wraps it all for std::vector and friends.
+//
+
+enum class Pages {normal, huge};
+
+constexpr std::size_t hugePageSize {std::size_t{2} << 20};
+
+inline void* allocateAligned(std::size_t bytes, std::size_t alignment = 64, Pages pages = Pages::normal)
+{
+  if(bytes == 0)
+    bytes = 1;
+  if(pages == Pages::huge){
+    std::size_t rounded = (bytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+    void *p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(p != MAP_FAILED)
+      return p;
+    //
+    // map a huge page more than needed so a 2MiB aligned range can be cut out of it, and give
+    // the ends back.
+    //
+    char *raw = static_cast<char*>(mmap(nullptr, rounded + hugePageSize, PROT_READ | PROT_WRITE,
+                                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if(raw == MAP_FAILED)
+      throw std::bad_alloc();
+    std::size_t misaligned = reinterpret_cast<std::uintptr_t>(raw) % hugePageSize;
+    char *aligned = raw + (misaligned ? hugePageSize - misaligned : 0);
+    if(aligned != raw)
+      munmap(raw, aligned - raw);
+    if(std::size_t after = raw + rounded + hugePageSize - (aligned + rounded))
+      munmap(aligned + rounded, after);
+    madvise(aligned, rounded, MADV_HUGEPAGE);
+    return aligned;
+  }
+  //
+  // aligned_alloc wants the size to be a multiple of the alignment.
+  //
+  void *p = std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+  if(!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+inline void freeAligned(void *p, std::size_t bytes, Pages pages = Pages::normal)
+{
+  if(!p)
+    return;
+  if(pages == Pages::huge){
+    if(bytes == 0)
+      bytes = 1;
+    munmap(p, (bytes + hugePageSize - 1) / hugePageSize * hugePageSize);
+  }
+  else
+    std::free(p);
+}
+
+//
+// bytes of the mapping containing p which are backed by huge pages, from /proc/self/smaps;
+// all of it for hugetlbfs, and for THP only the pages which have been touched.
+//
+inline std::size_t hugePageBytes(const void *p)
+{
+  std::ifstream smaps {"/proc/self/smaps"};
+  std::string line;
+  bool inside {false};
+  std::size_t size {0};
+  std::uintptr_t at = reinterpret_cast<std::uintptr_t>(p);
+  while(std::getline(smaps, line)){
+    std::uintptr_t low, high;
+    char dash;
+    std::istringstream header {line};
+    if(line.find('-') < line.find(' ') && header >> std::hex >> low >> dash >> high){
+      inside = low <= at && at < high;
+      continue;
+    }
+    if(!inside)
+      continue;
+    std::istringstream field {line};
+    std::string name;
+    std::size_t kb {0};
+    field >> name >> kb;
+    if(name == "Size:")
+      size = kb << 10;
+    else if(name == "KernelPageSize:" && kb << 10 == hugePageSize)
+      return size;
+    else if(name == "AnonHugePages:")
+      return kb << 10;
+  }
+  return 0;
+}
+
+template<typename T, std::size_t Alignment = 64>
+class AlignedAllocator
+{
+public:
+  using value_type = T;
+
+  template<typename U>
+  struct rebind
+  { using other = AlignedAllocator<U, Alignment>; };
+
+  AlignedAllocator(Pages pages = Pages::normal) noexcept
+    : _pages(pages)
+  {}
+
+  template<typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>& other) noexcept
+    : _pages(other.pages())
+  {}
+
+  T* allocate(std::size_t n)
+  { return static_cast<T*>(allocateAligned(n * sizeof(T), Alignment, _pages)); }
+
+  void deallocate(T *p, std::size_t n) noexcept
+  { freeAligned(p, n * sizeof(T), _pages); }
+
+  Pages pages() const noexcept
+  { return _pages; }
+
+  template<typename U>
+  bool operator==(const AlignedAllocator<U, Alignment>& other) const noexcept
+  { return _pages == other.pages(); }
+
+  template<typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment>& other) const noexcept
+  { return _pages != other.pages(); }
+
+private:
+  Pages _pages;
+};
+
+#endif
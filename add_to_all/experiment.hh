@@ -0,0 +1,32 @@
+#ifndef _EXPERIMENT_HH_
+#define _EXPERIMENT_HH_
+
+#include "vec3_soa.hh"
+
+#include <algorithm>
+#include <chrono>
+
+//
+// What the add_to_all programs share; Q16's addend, an exact compare (every kernel here must
+// give the bits the plain loop does, so no tolerance), and a best of N timer for the quick
+// comparisons which don't need ../bench/bench.hh's statistics.
+//
+
+constexpr vec3 toAdd {0.5f, 0.6f, 0.7f};
+
+inline bool same(const vec3& a, const vec3& b)
+{ return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+template<typename F>
+double bestSeconds(int runs, F&& f)
+{
+  double best {1e30};
+  for(int r {0}; r < runs; ++r){
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+  }
+  return best;
+}
+
+#endif
@@ -0,0 +1,215 @@
+//
+// vec3s stored as halves (vec3_half.hh).
+//
+// First that the software conversions agree with F16C bit for bit; every one of the 65536
+// halves to float and back, and millions of floats to half, including the edges (rounding
+// ties, subnormals, overflow, NaNs). Then that every ISA's batch conversions and addToAll give
+// the same bits as the plain ones.
+//
+// Then accuracy; the error of storing random vec3s, and how far an array of halves drifts
+// from the same array of floats after 100 addToAlls, of a step bigger than the spacing of
+// halves at the values and of one smaller.
+//
+// Then throughput; ns per vec3 for addToAll on floats (add_to_all.hh's best AoS kernel) and on
+// halves, in cache and out of it, and for converting a whole array each way.
+//
+
+#include "add_to_all.hh"
+#include "experiment.hh"
+#include "vec3_half.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+const Isa isas[] {Isa::plain, Isa::sse, Isa::avx2, Isa::avx512};
+
+std::uint32_t bits(float f)
+{
+  std::uint32_t b;
+  std::memcpy(&b, &f, sizeof b);
+  return b;
+}
+
+float fromBits(std::uint32_t b)
+{
+  float f;
+  std::memcpy(&f, &b, sizeof f);
+  return f;
+}
+
+void testConversions()
+{
+  std::vector<std::uint16_t> halves(65536);
+  for(std::uint32_t h {0}; h < 65536; ++h)
+    halves[h] = static_cast<std::uint16_t>(h);
+  std::vector<float> floats(halves.size());
+  std::vector<std::uint16_t> back(halves.size());
+  for(Isa isa : isas){
+    if(!halfSupported(isa))
+      continue;
+    floatsFromHalves(halves.data(), halves.size(), floats.data(), isa);
+    halvesFromFloats(floats.data(), floats.size(), back.data(), isa);
+    for(std::uint32_t h {0}; h < 65536; ++h){
+      assert(bits(floats[h]) == bits(floatFromHalf(static_cast<std::uint16_t>(h))));
+      //
+      // every half goes there and back unchanged, except a signalling NaN which comes back quiet.
+      //
+      bool nan = (h & 0x7c00) == 0x7c00 && (h & 0x3ff);
+      assert(back[h] == (nan ? h | 0x200 : h));
+    }
+  }
+
+  //
+  // random bit patterns cover everything a float can be; the others are the edges, half way
+  // between two halves either side of every power of 2 and the subnormal and overflow limits.
+  //
+  std::vector<float> in;
+  std::mt19937 rng {44};
+  for(int i {0}; i < 4'000'000; ++i)
+    in.push_back(fromBits(rng()));
+  for(int e {-26}; e <= 16; ++e)
+    for(float m : {1.0f, 1.0f + 1.0f / 2048, 1.0f + 3.0f / 2048, 2.0f - 1.0f / 2048, 1.5f}){
+      in.push_back(std::ldexp(m, e));
+      in.push_back(-std::ldexp(m, e));
+      in.push_back(std::nextafter(std::ldexp(m, e), 0.0f));
+      in.push_back(std::nextafter(std::ldexp(m, e), 1e30f));
+    }
+  for(float f : {65504.0f, 65519.0f, 65519.996f, 65520.0f, 1e30f, INFINITY, -INFINITY, NAN, 0.0f, -0.0f})
+    in.push_back(f);
+  std::vector<std::uint16_t> out(in.size());
+  for(Isa isa : isas){
+    if(!halfSupported(isa))
+      continue;
+    halvesFromFloats(in.data(), in.size(), out.data(), isa);
+    for(std::size_t i {0}; i < in.size(); ++i)
+      assert(out[i] == halfFromFloat(in[i]));
+  }
+  std::cout << "software conversions match F16C for every half and " << in.size() << " floats"
+            << std::endl;
+}
+
+void testAddToAll()
+{
+  std::mt19937 rng {16};
+  std::uniform_real_distribution<float> value(-2000.0f, 2000.0f);
+  for(std::size_t n : {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 100, 1001}){
+    std::vector<vec3> aos(n);
+    for(auto& v : aos)
+      v = vec3{value(rng), value(rng), value(rng)};
+    Vec3Half expected {aos.data(), n, Isa::plain};
+    addToAll(expected, toAdd, Isa::plain);
+    for(std::size_t i {0}; i < n; ++i){
+      vec3 before {floatFromHalf(halfFromFloat(aos[i].x)), floatFromHalf(halfFromFloat(aos[i].y)),
+                   floatFromHalf(halfFromFloat(aos[i].z))};
+      assert(expected.data()[3 * i] == halfFromFloat(before.x + toAdd.x));
+      assert(expected.data()[3 * i + 1] == halfFromFloat(before.y + toAdd.y));
+      assert(expected.data()[3 * i + 2] == halfFromFloat(before.z + toAdd.z));
+    }
+    for(Isa isa : isas){
+      if(!halfSupported(isa))
+        continue;
+      //
+      // a guard either side of the array to catch a kernel that writes too far.
+      //
+      std::vector<std::uint16_t> guarded(3 * n + 2, 0xabcd);
+      halvesFromFloats(&aos.data()->x, 3 * n, guarded.data() + 1, isa);
+      Vec3Half array {aos.data(), n, isa};
+      addToAll(array, toAdd, isa);
+      assert(std::equal(array.data(), array.data() + 3 * n, expected.data()));
+      switch(isa){
+      case Isa::plain: addToAllHalf_plain(guarded.data() + 1, n, toAdd); break;
+      case Isa::sse: addToAllHalf_sse(guarded.data() + 1, n, toAdd); break;
+      case Isa::avx2: addToAllHalf_avx2(guarded.data() + 1, n, toAdd); break;
+      case Isa::avx512: addToAllHalf_avx512(guarded.data() + 1, n, toAdd); break;
+      }
+      assert(guarded.front() == 0xabcd && guarded.back() == 0xabcd);
+      assert(std::equal(guarded.begin() + 1, guarded.end() - 1, expected.data()));
+    }
+  }
+  std::cout << "addToAll on halves gives the same bits at every ISA, and is the float sum rounded"
+            << std::endl;
+}
+
+//
+// largest error in any component of halves, compared with floats; relative to the float, or
+// absolute (relative is no use once values which started either side of 0 have been moved
+// across it).
+//
+double maxError(const Vec3Half& halves, const std::vector<vec3>& floats, bool relative)
+{
+  double worst {0.0};
+  for(std::size_t i {0}; i < floats.size(); ++i){
+    vec3 h = halves[i], f = floats[i];
+    for(auto [a, b] : {std::pair{h.x, f.x}, std::pair{h.y, f.y}, std::pair{h.z, f.z}})
+      if(b != 0.0f || !relative)
+        worst = std::max(worst, std::abs(static_cast<double>(a) - b) / (relative ? std::abs(b) : 1.0f));
+  }
+  return worst;
+}
+
+void accuracy()
+{
+  std::cout << "accuracy against floats, largest relative error storing, then largest absolute "
+            << "error after addToAlls;" << std::endl;
+  std::mt19937 rng {16};
+  for(float range : {1.0f, 100.0f, 1000.0f}){
+    std::uniform_real_distribution<float> value(-range, range);
+    std::vector<vec3> floats(100'000);
+    for(auto& v : floats)
+      v = vec3{value(rng), value(rng), value(rng)};
+    Vec3Half halves {floats.data(), floats.size()};
+    std::cout << "  values in +-" << range << ": stored " << maxError(halves, floats, true);
+    for(vec3 step : {toAdd, vec3{0.01f, 0.02f, 0.03f}}){
+      std::vector<vec3> f = floats;
+      Vec3Half h {floats.data(), floats.size()};
+      for(int pass {0}; pass < 100; ++pass){
+        addToAll(f.data(), f.size(), step);
+        addToAll(h, step);
+      }
+      std::cout << ", 100 adds of " << step.x << " " << step.y << " " << step.z << ": "
+                << maxError(h, f, false);
+    }
+    std::cout << std::endl;
+  }
+}
+
+void throughput(std::size_t count)
+{
+  std::cout << count << " vec3s (" << count * sizeof(vec3) / 1024 << "KiB as floats, "
+            << count * 6 / 1024 << "KiB as halves), ns per vec3;" << std::endl;
+  int runs = count > 10'000'000 ? 5 : count > 100'000 ? 20 : 2000;
+  std::vector<vec3, AlignedAllocator<vec3>> floats(count, vec3{1.0f, 2.0f, 3.0f});
+  Vec3Half halves {floats.data(), count};
+  auto ns = [&](double seconds){ return seconds * 1e9 / count; };
+  std::cout << "  floats, addToAll " << isaName(bestIsa()) << ": "
+            << ns(bestSeconds(runs, [&]{ addToAll(floats.data(), count, toAdd); })) << std::endl;
+  for(Isa isa : isas){
+    if(!halfSupported(isa))
+      continue;
+    std::cout << "  halves, addToAll " << isaName(isa) << ": "
+              << ns(bestSeconds(isa == Isa::plain ? std::max(1, runs / 10) : runs,
+                                [&]{ addToAll(halves, toAdd, isa); }));
+    if(isa != Isa::plain)
+      std::cout << "; float -> half "
+                << ns(bestSeconds(runs, [&]{ halvesFromFloats(&floats.data()->x, 3 * count, halves.data(), isa); }))
+                << ", half -> float "
+                << ns(bestSeconds(runs, [&]{ floatsFromHalves(halves.data(), 3 * count, &floats.data()->x, isa); }));
+    std::cout << std::endl;
+  }
+}
+
+int main()
+{
+  testConversions();
+  testAddToAll();
+  accuracy();
+  std::cout << "best ISA " << isaName(bestIsa()) << ", for halves " << isaName(bestHalfIsa()) << std::endl;
+  for(std::size_t count : {std::size_t{2'000}, std::size_t{1'000'000}, std::size_t{64'000'000}})
+    throughput(count);
+}
@@ -0,0 +1,173 @@
+//
+// Packed vec3, padded vec3a (vec3a.hh) and Vec3SoA, allocated as Q16 does and with
+// aligned_allocator.hh.
+//
+// First that the allocator gives what it says, that the conversions between packed and padded
+// go both ways at every length, and that the vec3a kernels match the plain loop.
+//
+// Then two load/store patterns over each layout, ns per element;
+//
+//  - sweep; addToAll over the whole array, the best kernel there is for the layout. Limited
+//    by how many bytes there are (12 a packed or SoA element, 16 a padded one) once the array
+//    is out of L1, by how well the elements fit the registers while it is in.
+//  - random; addToAll on one element at a time at random indices, each independent of the last
+//    so the loads overlap. Limited by how many lines (and pages) an element touches.
+//
+// each with normal and huge pages.
+//
+
+#include "aligned_allocator.hh"
+#include "add_to_all.hh"
+#include "experiment.hh"
+#include "vec3a.hh"
+#include "vec3_soa.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+bool same(const vec3a& a, const vec3& b)
+{ return a.x == b.x && a.y == b.y && a.z == b.z && a.w == 0.0f; }
+
+void test()
+{
+  for(std::size_t bytes : {1, 12, 64, 1000, 1 << 20}){
+    void *p = allocateAligned(bytes);
+    assert(reinterpret_cast<std::uintptr_t>(p) % 64 == 0);
+    freeAligned(p, bytes);
+    void *h = allocateAligned(bytes, 64, Pages::huge);
+    assert(reinterpret_cast<std::uintptr_t>(h) % hugePageSize == 0);
+    static_cast<char*>(h)[bytes - 1] = 1;
+    freeAligned(h, bytes, Pages::huge);
+  }
+  std::vector<vec3a, AlignedAllocator<vec3a>> v(100);
+  assert(reinterpret_cast<std::uintptr_t>(v.data()) % 64 == 0);
+  Vec3SoA hugeSoA {1000, Pages::huge};
+  assert(reinterpret_cast<std::uintptr_t>(hugeSoA.x()) % hugePageSize == 0);
+
+  for(std::size_t n : {0, 1, 2, 3, 4, 5, 15, 16, 17, 100, 1001}){
+    //
+    // a guard either side to catch a conversion or kernel that writes too far.
+    //
+    std::vector<vec3> packed(n + 2, vec3{-1.0f, -1.0f, -1.0f});
+    for(std::size_t i {0}; i < n; ++i)
+      packed[i + 1] = vec3{static_cast<float>(i), static_cast<float>(2 * i), -static_cast<float>(i)};
+    std::vector<vec3a, AlignedAllocator<vec3a>> padded(n + 2, vec3a{-1.0f, -1.0f, -1.0f, -1.0f});
+    toPadded(packed.data() + 1, n, padded.data() + 1);
+    for(std::size_t i {0}; i < n; ++i)
+      assert(same(padded[i + 1], packed[i + 1]));
+    assert(padded[0].w == -1.0f && padded[n + 1].w == -1.0f);
+
+    std::vector<vec3> back(n + 2, vec3{-1.0f, -1.0f, -1.0f});
+    toPacked(padded.data() + 1, n, back.data() + 1);
+    for(std::size_t i {0}; i < n + 2; ++i)
+      assert(same(back[i], packed[i]));
+
+    addToAllAoS_plain(packed.data() + 1, n, toAdd);
+    for(Isa isa : {Isa::plain, Isa::sse, Isa::avx2, Isa::avx512}){
+      if(!isaSupported(isa))
+        continue;
+      std::vector<vec3a, AlignedAllocator<vec3a>> a(n + 2, vec3a{-1.0f, -1.0f, -1.0f, -1.0f});
+      toPadded(back.data() + 1, n, a.data() + 1);
+      addToAll(a.data() + 1, n, toAdd, isa);
+      for(std::size_t i {0}; i < n; ++i)
+        assert(same(a[i + 1], packed[i + 1]));
+      assert(a[0].x == -1.0f && a[n + 1].x == -1.0f);
+    }
+  }
+  std::cout << "aligned allocations, packed <-> padded conversions and vec3a kernels check out"
+            << std::endl;
+}
+
+//
+// the random pattern's indices; 1M of them (or 4 an element if that is fewer, so a small array
+// isn't hit over and over), the same for every layout.
+//
+std::vector<std::uint32_t> randomIndices(std::size_t count)
+{
+  std::vector<std::uint32_t> indices(std::min<std::size_t>(count * 4, 1 << 20));
+  std::mt19937 rng {16};
+  std::uniform_int_distribution<std::uint32_t> pick(0, count - 1);
+  for(auto& i : indices)
+    i = pick(rng);
+  return indices;
+}
+
+template<typename T>
+void randomAdd(T *array, const std::vector<std::uint32_t>& indices)
+{
+  for(std::uint32_t i : indices){
+    array[i].x += toAdd.x;
+    array[i].y += toAdd.y;
+    array[i].z += toAdd.z;
+  }
+}
+
+void randomAdd(Vec3SoA& array, const std::vector<std::uint32_t>& indices)
+{
+  float *x = array.x(), *y = array.y(), *z = array.z();
+  for(std::uint32_t i : indices){
+    x[i] += toAdd.x;
+    y[i] += toAdd.y;
+    z[i] += toAdd.z;
+  }
+}
+
+void layouts(std::size_t count)
+{
+  std::cout << count << " vec3s (" << count * sizeof(vec3) / 1024 << "KiB packed), ns per element"
+            << ", sweep / random;" << std::endl;
+  int runs = count > 10'000'000 ? 5 : count > 100'000 ? 20 : 2000;
+  auto indices = randomIndices(count);
+  auto report = [&](const char *what, double sweep, double random, const void *p = nullptr){
+    std::cout << "  " << what << ": " << sweep * 1e9 / count << " / "
+              << random * 1e9 / indices.size();
+    if(p)
+      std::cout << " (" << (hugePageBytes(p) >> 20) << "MiB in huge pages)";
+    std::cout << std::endl;
+  };
+  {
+    std::unique_ptr<vec3[]> q16 {new vec3[count]()};
+    std::cout << "  (new vec3[] is " << reinterpret_cast<std::uintptr_t>(q16.get()) % 64
+              << " bytes past a line)" << std::endl;
+    report("packed, new vec3[]",
+           bestSeconds(runs, [&]{ addToAll(q16.get(), count, toAdd); }),
+           bestSeconds(runs, [&]{ randomAdd(q16.get(), indices); }));
+  }
+  for(Pages pages : {Pages::normal, Pages::huge}){
+    bool huge = pages == Pages::huge;
+    {
+      std::vector<vec3, AlignedAllocator<vec3>> packed(count, vec3{}, pages);
+      report(huge ? "packed, 64B, huge pages" : "packed, 64B",
+             bestSeconds(runs, [&]{ addToAll(packed.data(), count, toAdd); }),
+             bestSeconds(runs, [&]{ randomAdd(packed.data(), indices); }),
+             huge ? packed.data() : nullptr);
+    }
+    {
+      std::vector<vec3a, AlignedAllocator<vec3a>> padded(count, vec3a{}, pages);
+      report(huge ? "padded, 64B, huge pages" : "padded, 64B",
+             bestSeconds(runs, [&]{ addToAll(padded.data(), count, toAdd); }),
+             bestSeconds(runs, [&]{ randomAdd(padded.data(), indices); }),
+             huge ? padded.data() : nullptr);
+    }
+    {
+      Vec3SoA soa {count, pages};
+      report(huge ? "SoA, huge pages" : "SoA",
+             bestSeconds(runs, [&]{ addToAll(soa, toAdd); }),
+             bestSeconds(runs, [&]{ randomAdd(soa, indices); }),
+             huge ? soa.x() : nullptr);
+    }
+  }
+}
+
+int main()
+{
+  test();
+  std::cout << "best ISA " << isaName(bestIsa()) << std::endl;
+  for(std::size_t count : {std::size_t{2'000}, std::size_t{1'000'000}, std::size_t{64'000'000}})
+    layouts(count);
+}
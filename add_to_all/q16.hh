@@ -0,0 +1,56 @@
+#ifndef _Q16_HH_
+#define _Q16_HH_
+
+#include "vec3_soa.hh"
+
+//
+// The four addToAll's from Q16 (dambuster_questions/Q16.cpp), as they were, so the kernels in
+// add_to_all.hh (and the benchmark suites) have something to compare with.
+//
+// noinline, so each is compiled as it would be on its own; inlined into a caller whose toAdd
+// is a local the compiler can see it doesn't alias the array, and the question goes away.
+//
+
+__attribute__((noinline)) inline void addToAll_slow(vec3 *array, vec3 *toAdd, unsigned int num)
+{
+  for(int i = 0; i < num; ++i){
+    array->x += toAdd->x;
+    array->y += toAdd->y;
+    array->z += toAdd->z;
+    ++array;
+  }
+}
+
+__attribute__((noinline)) inline void addToAll_fast1(vec3 *array, vec3 toAdd, unsigned int num)
+{
+  for(int i = 0; i < num; ++i){
+    vec3& e = *array;
+    e.x += toAdd.x;
+    e.y += toAdd.y;
+    e.z += toAdd.z;
+    ++array;
+  }
+}
+
+__attribute__((noinline)) inline void addToAll_fast2(vec3 *array, vec3 toAdd, unsigned int num)
+{
+  for(int i = 0; i < num; ++i){
+    array->x += toAdd.x;
+    array->y += toAdd.y;
+    array->z += toAdd.z;
+    ++array;
+  }
+}
+
+__attribute__((noinline)) inline void addToAll_fast3(vec3 *array, vec3 toAdd, unsigned int num)
+{
+  float x {toAdd.x}, y {toAdd.y}, z {toAdd.z};
+  for(int i = 0; i < num; ++i){
+    array->x += x;
+    array->y += y;
+    array->z += z;
+    ++array;
+  }
+}
+
+#endif
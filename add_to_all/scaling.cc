@@ -0,0 +1,148 @@
+//
+// addToAll on the job system (add_to_all_parallel.hh, ../skinning/parallel_for.hh).
+//
+// First parallelFor itself; every index is run exactly once, every split point is a multiple
+// of the alignment, and the parallel addToAll gives exactly what the single threaded one does,
+// with both chunkings and more workers than cores, and that idle workers sleep rather than
+// spin. Then what a job costs, which is where the default grain comes from, and then the
+// scaling; ns per vec3 against the number of workers, at Q16's 1M vec3s and at 100M.
+//
+
+#include "add_to_all_parallel.hh"
+#include "experiment.hh"
+#include "vec3_soa.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <time.h>
+
+void testRanges(JobSystem& js, Chunking chunking)
+{
+  for(std::size_t n : {0, 1, 15, 64, 100, 1000, 4097, 100'003}){
+    for(std::size_t grain : {0, 1, 16, 100}){
+      std::mutex m;
+      std::vector<std::pair<std::size_t, std::size_t>> ranges;
+      std::size_t first {7};
+      parallelFor(js, first, first + n, [&](std::size_t a, std::size_t b){
+        std::lock_guard<std::mutex> lock {m};
+        ranges.push_back({a, b});
+      }, ParallelOptions{chunking, grain, 16});
+      std::sort(ranges.begin(), ranges.end());
+      std::size_t next {first};
+      for(auto& r : ranges){
+        assert(r.first == next && r.second > r.first);
+        assert(r.first == first || r.first % 16 == 0);
+        next = r.second;
+      }
+      assert(n == 0 ? ranges.empty() : next == first + n);
+    }
+  }
+}
+
+void testAddToAll(JobSystem& js, Chunking chunking)
+{
+  for(std::size_t n : {0, 1, 17, 1000, 40'000, 100'001}){
+    std::vector<vec3> expected(n), aos(n);
+    for(std::size_t i {0}; i < n; ++i)
+      expected[i] = aos[i] = vec3{static_cast<float>(i), static_cast<float>(i * 2), 1.0f};
+    Vec3SoA soa {aos.data(), n};
+    addToAll(expected.data(), n, toAdd);
+    ParallelOptions options {chunking, 1000};
+    addToAll(js, aos.data(), n, toAdd, options);
+    addToAll(js, soa, toAdd, options);
+    for(std::size_t i {0}; i < n; ++i)
+      assert(same(aos[i], expected[i]) && same(soa[i], expected[i]));
+  }
+}
+
+double cpuSeconds()
+{
+  timespec t;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+//
+// four workers, given something to do and then nothing; while the calling thread sleeps the
+// process should use next to no CPU (it was half of the one core when idle workers yielded).
+//
+void testIdle()
+{
+  JobSystem js {4};
+  std::vector<vec3> aos(100'000);
+  addToAll(js, aos.data(), aos.size(), toAdd, ParallelOptions{Chunking::guided, 1000});
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  double t0 = cpuSeconds();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  assert(cpuSeconds() - t0 < 0.01);
+}
+
+const char* chunkingName(Chunking c)
+{ return c == Chunking::equal ? "equal" : "guided"; }
+
+//
+// ns per job of a root with 'jobs' empty children, all on the one thread.
+//
+void jobCost()
+{
+  JobSystem js {1};
+  constexpr int jobs {1000};
+  double s = bestSeconds(20, [&]{
+    Job *root = js.createJob(&parallel_detail::noop);
+    for(int j {0}; j < jobs; ++j)
+      js.run(js.createJob(&parallel_detail::noop, root));
+    js.run(root);
+    js.wait(root);
+  });
+  std::cout << "a job (create, run, pop, execute, finish) on one thread: " << s * 1e9 / jobs
+            << "ns" << std::endl;
+}
+
+void scaling(std::size_t count, const std::vector<unsigned>& workerCounts)
+{
+  std::cout << count << " vec3s (" << count * sizeof(vec3) / (1 << 20) << "MiB), SoA "
+            << isaName(bestIsa()) << ", ns per vec3" << std::endl;
+  Vec3SoA soa {count};
+  double serial = bestSeconds(5, [&]{ addToAll(soa, toAdd); }) * 1e9 / count;
+  std::cout << "  single threaded: " << serial << std::endl;
+  for(unsigned workers : workerCounts){
+    JobSystem js {workers};
+    for(Chunking chunking : {Chunking::equal, Chunking::guided}){
+      double ns = bestSeconds(5, [&]{
+        addToAll(js, soa, toAdd, ParallelOptions{chunking});
+      }) * 1e9 / count;
+      std::cout << "  " << workers << " worker(s), " << chunkingName(chunking) << ": " << ns
+                << " (" << serial / ns << "x)" << std::endl;
+    }
+  }
+}
+
+int main()
+{
+  for(unsigned workers : {1u, 2u, 4u}){
+    JobSystem js {workers};
+    for(Chunking chunking : {Chunking::equal, Chunking::guided}){
+      testRanges(js, chunking);
+      testAddToAll(js, chunking);
+    }
+  }
+  testIdle();
+  std::cout << "parallelFor covers every index once on aligned splits, parallel addToAll "
+            << "matches, idle workers sleep" << std::endl;
+
+  jobCost();
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  std::cout << cores << " hardware thread(s)" << std::endl;
+  std::vector<unsigned> workerCounts;
+  for(unsigned w {1}; w <= std::max(cores, 4u); w *= 2)
+    workerCounts.push_back(w);
+  for(std::size_t count : {1'000'000, 100'000'000})
+    scaling(count, workerCounts);
+}
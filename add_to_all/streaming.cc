@@ -0,0 +1,154 @@
+//
+// addToAll with streaming stores (add_to_all_stream.hh).
+//
+// First the streaming kernels against the plain one, on vec3 arrays starting at every float
+// offset from a 64 byte boundary so the scalar head, the rotated addends and the tail all get
+// used. Then GB/s (24 bytes a vec3, read and written) with normal and streaming stores, at Q16's
+// 1M vec3s which fit in the last level cache and at a size which doesn't.
+//
+// Then the effect on somebody else's data. This VM has one core, so there is no running a
+// cache sensitive job alongside; instead the job (a random walk through 1 or 4MB, one load
+// per line, each depending on the last) is warmed up, the big addToAll runs, and the job runs
+// again. What it finds left of its data in the cache is what it would have found running
+// alongside.
+//
+
+#include "add_to_all_stream.hh"
+#include "experiment.hh"
+#include "vec3_soa.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <vector>
+
+void test()
+{
+  for(Isa isa : {Isa::sse, Isa::avx512}){
+    if(!isaSupported(isa))
+      continue;
+    for(std::size_t n : {0, 1, 4, 5, 15, 16, 17, 33, 100, 1001}){
+      for(std::size_t offset {0}; offset < 16; ++offset){
+        //
+        // a guard vec3 either side to catch a head or tail that writes too far.
+        //
+        std::vector<float> buffer(3 * (n + 2) + 32, -1.0f);
+        float *base = reinterpret_cast<float*>((reinterpret_cast<std::uintptr_t>(buffer.data()) + 63) / 64 * 64);
+        vec3 *array = reinterpret_cast<vec3*>(base + offset) + 1;
+        for(std::size_t i {0}; i < n; ++i)
+          array[i] = vec3{static_cast<float>(i), static_cast<float>(2 * i), static_cast<float>(3 * i)};
+        std::vector<vec3> expected(array - 1, array + n + 1);
+        addToAllAoS_plain(expected.data() + 1, n, toAdd);
+        addToAll(array, n, toAdd, Stores::streaming, isa);
+        const vec3 *guarded = array - 1;
+        for(std::size_t i {0}; i < n + 2; ++i)
+          assert(same(guarded[i], expected[i]));
+      }
+      std::vector<vec3> aos(n);
+      for(std::size_t i {0}; i < n; ++i)
+        aos[i] = vec3{static_cast<float>(i), 1.0f, -static_cast<float>(i)};
+      Vec3SoA soa {aos.data(), n};
+      addToAll(soa, toAdd, Stores::streaming, isa);
+      addToAllAoS_plain(aos.data(), n, toAdd);
+      for(std::size_t i {0}; i < n; ++i)
+        assert(same(soa[i], aos[i]));
+    }
+  }
+  std::cout << "streaming kernels match addToAll at every alignment" << std::endl;
+}
+
+void bandwidth(std::size_t count)
+{
+  std::cout << count << " vec3s (" << count * sizeof(vec3) / (1 << 20) << "MiB), GB/s;"
+            << std::endl;
+  std::vector<vec3> aos(count, vec3{1.0f, 2.0f, 3.0f});
+  Vec3SoA soa {aos.data(), count};
+  int runs = count > 10'000'000 ? 5 : 50;
+  for(Stores stores : {Stores::normal, Stores::streaming, Stores::automatic}){
+    double a = bestSeconds(runs, [&]{ addToAll(aos.data(), count, toAdd, stores); });
+    double s = bestSeconds(runs, [&]{ addToAll(soa, toAdd, stores); });
+    std::cout << "  " << storesName(stores) << ": AoS " << 24.0 * count / a / 1e9 << ", SoA "
+              << 24.0 * count / s / 1e9 << std::endl;
+  }
+}
+
+//
+// a random cycle through bytes of memory, one pointer per line.
+//
+class Walk
+{
+public:
+  explicit Walk(std::size_t bytes)
+    : _lines(bytes / 64), _mem(_lines * 8)
+  {
+    std::vector<std::size_t> order(_lines);
+    std::iota(order.begin(), order.end(), 0);
+    std::mt19937 rng {99};
+    std::shuffle(order.begin() + 1, order.end(), rng);
+    for(std::size_t i {0}; i < _lines; ++i)
+      _mem[order[i] * 8] = &_mem[order[(i + 1) % _lines] * 8];
+  }
+
+  //
+  // ns per load for one lap.
+  //
+  double lap()
+  {
+    void **p = &_mem[0];
+    auto t0 = std::chrono::steady_clock::now();
+    for(std::size_t i {0}; i < _lines; ++i)
+      p = static_cast<void**>(*p);
+    auto t1 = std::chrono::steady_clock::now();
+    static void* volatile sink;
+    sink = p;
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / _lines;
+  }
+
+private:
+  std::size_t _lines;
+  std::vector<void*> _mem;
+};
+
+void pollution(std::size_t count, std::size_t jobBytes)
+{
+  std::cout << "a random walk through " << (jobBytes >> 20) << "MiB, ns per load, after "
+            << count * sizeof(vec3) / (1 << 20) << "MiB of addToAll;" << std::endl;
+  Walk job {jobBytes};
+  Vec3SoA soa {count};
+  std::vector<vec3> aos(count);
+  //
+  // the median of 9 goes; a lap of the walk is a few ms and this VM's neighbours are noisy.
+  //
+  auto after = [&](const char *what, auto&& sweep){
+    std::vector<double> warm, cold;
+    for(int r {0}; r < 9; ++r){
+      job.lap();
+      warm.push_back(job.lap());
+      sweep();
+      cold.push_back(job.lap());
+    }
+    std::sort(warm.begin(), warm.end());
+    std::sort(cold.begin(), cold.end());
+    std::cout << "  " << what << ": " << cold[4] << " (" << warm[4] << " warm)" << std::endl;
+  };
+  after("nothing", []{});
+  after("AoS, normal stores", [&]{ addToAll(aos.data(), count, toAdd, Stores::normal); });
+  after("AoS, streaming stores", [&]{ addToAll(aos.data(), count, toAdd, Stores::streaming); });
+  after("SoA, normal stores", [&]{ addToAll(soa, toAdd, Stores::normal); });
+  after("SoA, streaming stores", [&]{ addToAll(soa, toAdd, Stores::streaming); });
+}
+
+int main()
+{
+  test();
+  std::size_t threshold = streamingThresholdBytes();
+  std::cout << "last level cache " << (threshold >> 20) << "MiB, streams above that" << std::endl;
+  std::size_t big = std::max<std::size_t>(32'000'000, 2 * threshold / sizeof(vec3));
+  for(std::size_t count : {std::size_t{1'000'000}, big})
+    bandwidth(count);
+  for(std::size_t job : {1 << 20, 4 << 20})
+    pollution(big, job);
+}
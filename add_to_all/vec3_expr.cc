@@ -0,0 +1,82 @@
+//
+// The expression templates in vec3_expr.hh against the same sums done a vec3 at a time, on
+// sizes which aren't a multiple of the 16 float blocks and with the destination also an
+// operand.
+//
+
+#include "vec3_expr.hh"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+bool close(float a, float b)
+{ return std::abs(a - b) <= 1e-5f * std::max(1.0f, std::abs(b)); }
+
+bool close(const vec3& a, const vec3& b)
+{ return close(a.x, b.x) && close(a.y, b.y) && close(a.z, b.z); }
+
+Vec3SoA make(std::size_t n, float seed)
+{
+  Vec3SoA a {n};
+  for(std::size_t i {0}; i < n; ++i)
+    a.set(i, vec3{seed + i, seed * 2 - i, seed * 0.5f + i * 0.25f});
+  return a;
+}
+
+int main()
+{
+  const float dt {1.0f / 60.0f};
+  const vec3 gravity {0.0f, -9.8f, 0.0f};
+  for(std::size_t n : {0, 1, 15, 16, 17, 100, 1001}){
+    Vec3SoA pos = make(n, 1.0f), vel = make(n, 2.0f), acc = make(n, 3.0f);
+    std::vector<vec3> p(n), v(n), a(n);
+    pos.toAoS(p.data());
+    vel.toAoS(v.data());
+    acc.toAoS(a.data());
+
+    //
+    // the motivating one, then the velocity update with a constant and a division.
+    //
+    pos += vel * dt + acc * (0.5f * dt * dt);
+    vel = vel + (acc + gravity) * dt - vel * acc / 100.0f;
+    for(std::size_t i {0}; i < n; ++i){
+      float h = 0.5f * dt * dt;
+      p[i] = vec3{p[i].x + (v[i].x * dt + a[i].x * h), p[i].y + (v[i].y * dt + a[i].y * h),
+                  p[i].z + (v[i].z * dt + a[i].z * h)};
+      v[i] = vec3{v[i].x + (a[i].x + gravity.x) * dt - v[i].x * a[i].x / 100.0f,
+                  v[i].y + (a[i].y + gravity.y) * dt - v[i].y * a[i].y / 100.0f,
+                  v[i].z + (a[i].z + gravity.z) * dt - v[i].z * a[i].z / 100.0f};
+      assert(close(pos[i], p[i]));
+      assert(close(vel[i], v[i]));
+    }
+
+    //
+    // a new array from an expression, negation, the compound assignments.
+    //
+    Vec3SoA d = -(pos - vel) * 2.0f;
+    assert(d.size() == n);
+    d -= pos;
+    d *= 0.5f;
+    d += vel;
+    for(std::size_t i {0}; i < n; ++i){
+      vec3 e {(-(p[i].x - v[i].x) * 2.0f - p[i].x) * 0.5f + v[i].x,
+              (-(p[i].y - v[i].y) * 2.0f - p[i].y) * 0.5f + v[i].y,
+              (-(p[i].z - v[i].z) * 2.0f - p[i].z) * 0.5f + v[i].z};
+      assert(close(d[i], e));
+    }
+  }
+
+  //
+  // expressions hold their operands by value, so one can be built up in steps and kept.
+  //
+  Vec3SoA x = make(33, 1.0f), y = make(33, 2.0f);
+  auto scaled = x * 3.0f;
+  auto sum = scaled + y;
+  Vec3SoA z {sum};
+  for(std::size_t i {0}; i < 33; ++i)
+    assert(close(z[i], vec3{x[i].x * 3 + y[i].x, x[i].y * 3 + y[i].y, x[i].z * 3 + y[i].z}));
+
+  std::cout << "vec3 expressions match the same sums done one vec3 at a time" << std::endl;
+}
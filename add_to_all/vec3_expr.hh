@@ -0,0 +1,301 @@
+#ifndef _VEC3_EXPR_HH_
+#define _VEC3_EXPR_HH_
+
+#include "vec3_soa.hh"
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+//
+// Expression templates over Vec3SoA, so a whole physics update,
+//
+//   pos += vel * dt + acc * (0.5f * dt * dt);
+//
+// is one pass through memory. Written as addToAll style passes it is two (pos += vel * dt,
+// then pos += acc * ...) each reading and writing all of pos, and with ordinary operators
+// returning arrays it is four loops and three temporary arrays as big as pos.
+//
+// Here the operators return a small object which only remembers what to do (the arrays are
+// held as pointers); nothing happens until it is assigned to a Vec3SoA, and then it is one
+// loop per component stream, each float of each array read once, with the whole right hand
+// side inlined into its body as if it was written out by hand.
+//
+// Operands are Vec3SoAs, vec3 constants (added to every element) and floats (only to multiply
+// or divide by). Element wise; a * b multiplies component by component.
+//
+// The loops run to the end of the padding (Vec3SoA pads each stream to 16 floats) in blocks of
+// 16, so there is no tail and -O2's vectoriser takes them. ivdep tells it a store to the
+// destination can't change a later element of an operand; true as each element only depends
+// on the elements at the same index, including when the destination is also an operand.
+//
+
+template<typename E>
+struct Vec3Expr
+{
+  const E& self() const
+  { return static_cast<const E&>(*this); }
+};
+
+namespace vec3_expr_detail
+{
+  struct Array : Vec3Expr<Array>
+  {
+    const float *c[3];
+    std::size_t n;
+
+    explicit Array(const Vec3SoA& a)
+      : c{a.x(), a.y(), a.z()}, n(a.size())
+    {}
+
+    template<int C>
+    float at(std::size_t i) const
+    { return c[C][i]; }
+
+    std::size_t size() const
+    { return n; }
+  };
+
+  struct Constant : Vec3Expr<Constant>
+  {
+    vec3 v;
+
+    explicit Constant(vec3 v)
+      : v(v)
+    {}
+
+    template<int C>
+    float at(std::size_t) const
+    { return C == 0 ? v.x : C == 1 ? v.y : v.z; }
+
+    std::size_t size() const
+    { return 0; }
+  };
+
+  struct Scalar : Vec3Expr<Scalar>
+  {
+    float s;
+
+    explicit Scalar(float s)
+      : s(s)
+    {}
+
+    template<int C>
+    float at(std::size_t) const
+    { return s; }
+
+    std::size_t size() const
+    { return 0; }
+  };
+
+  struct Add { static float apply(float a, float b) { return a + b; } };
+  struct Sub { static float apply(float a, float b) { return a - b; } };
+  struct Mul { static float apply(float a, float b) { return a * b; } };
+  struct Div { static float apply(float a, float b) { return a / b; } };
+
+  template<typename L, typename R, typename Op>
+  struct Binary : Vec3Expr<Binary<L, R, Op>>
+  {
+    L l;
+    R r;
+
+    Binary(const L& l, const R& r)
+      : l(l), r(r)
+    { assert(!l.size() || !r.size() || l.size() == r.size()); }
+
+    template<int C>
+    float at(std::size_t i) const
+    { return Op::apply(l.template at<C>(i), r.template at<C>(i)); }
+
+    std::size_t size() const
+    { return l.size() ? l.size() : r.size(); }
+  };
+
+  template<typename E>
+  struct Negate : Vec3Expr<Negate<E>>
+  {
+    E e;
+
+    explicit Negate(const E& e)
+      : e(e)
+    {}
+
+    template<int C>
+    float at(std::size_t i) const
+    { return -e.template at<C>(i); }
+
+    std::size_t size() const
+    { return e.size(); }
+  };
+
+  //
+  // what each kind of operand becomes in the tree; expressions are held by value (they are a
+  // few pointers and floats) so an expression can outlive the temporaries it was built from.
+  //
+  template<typename T, typename = void>
+  struct Node
+  {};
+
+  template<>
+  struct Node<Vec3SoA>
+  {
+    using type = Array;
+    static Array make(const Vec3SoA& a) { return Array {a}; }
+  };
+
+  template<>
+  struct Node<vec3>
+  {
+    using type = Constant;
+    static Constant make(vec3 v) { return Constant {v}; }
+  };
+
+  template<>
+  struct Node<float>
+  {
+    using type = Scalar;
+    static Scalar make(float s) { return Scalar {s}; }
+  };
+
+  template<typename E>
+  struct Node<E, std::enable_if_t<std::is_base_of_v<Vec3Expr<E>, E>>>
+  {
+    using type = E;
+    static const E& make(const E& e) { return e; }
+  };
+
+  template<typename T>
+  using NodeOf = typename Node<std::decay_t<T>>::type;
+
+  template<typename T>
+  constexpr bool isArray = std::is_same_v<std::decay_t<T>, Vec3SoA> ||
+                           std::is_base_of_v<Vec3Expr<std::decay_t<T>>, std::decay_t<T>>;
+
+  template<typename T>
+  constexpr bool isVector = isArray<T> || std::is_same_v<std::decay_t<T>, vec3>;
+
+  template<typename T>
+  constexpr bool isScalar = std::is_arithmetic_v<std::decay_t<T>>;
+
+  template<typename Op, typename L, typename R>
+  auto make(const L& l, const R& r)
+  {
+    return Binary<NodeOf<L>, NodeOf<R>, Op> {Node<std::decay_t<L>>::make(l),
+                                             Node<std::decay_t<R>>::make(r)};
+  }
+
+  struct Assign { static float apply(float, float b) { return b; } };
+
+  //
+  // e by value; a copy nothing else can see, so the compiler knows a store to dst can't change
+  // the scalars in it and keeps them in registers rather than loading them every time round.
+  //
+  template<int C, typename Op, typename E>
+  inline void evaluate(float *dst, const E e, std::size_t padded)
+  {
+    for(std::size_t i {0}; i < padded; i += Vec3SoA::lane)
+#pragma GCC ivdep
+      for(std::size_t j {0}; j < Vec3SoA::lane; ++j)
+        dst[i + j] = Op::apply(dst[i + j], e.template at<C>(i + j));
+  }
+
+  template<typename Op, typename E>
+  inline void evaluate(Vec3SoA& dst, const Vec3Expr<E>& expr)
+  {
+    const E& e = expr.self();
+    assert(!e.size() || e.size() == dst.size());
+    std::size_t padded = (dst.size() + Vec3SoA::lane - 1) / Vec3SoA::lane * Vec3SoA::lane;
+    evaluate<0, Op>(dst.x(), e, padded);
+    evaluate<1, Op>(dst.y(), e, padded);
+    evaluate<2, Op>(dst.z(), e, padded);
+  }
+}
+
+//
+// vector + vector and vector - vector, where at least one side is an array.
+//
+template<typename L, typename R,
+         typename = std::enable_if_t<vec3_expr_detail::isVector<L> && vec3_expr_detail::isVector<R> &&
+                                     (vec3_expr_detail::isArray<L> || vec3_expr_detail::isArray<R>)>>
+auto operator+(const L& l, const R& r)
+{ return vec3_expr_detail::make<vec3_expr_detail::Add>(l, r); }
+
+template<typename L, typename R,
+         typename = std::enable_if_t<vec3_expr_detail::isVector<L> && vec3_expr_detail::isVector<R> &&
+                                     (vec3_expr_detail::isArray<L> || vec3_expr_detail::isArray<R>)>>
+auto operator-(const L& l, const R& r)
+{ return vec3_expr_detail::make<vec3_expr_detail::Sub>(l, r); }
+
+//
+// element wise vector * vector, or scaled by a float either side.
+//
+template<typename L, typename R,
+         typename = std::enable_if_t<(vec3_expr_detail::isArray<L> || vec3_expr_detail::isArray<R>) &&
+                                     (vec3_expr_detail::isVector<L> || vec3_expr_detail::isScalar<L>) &&
+                                     (vec3_expr_detail::isVector<R> || vec3_expr_detail::isScalar<R>)>>
+auto operator*(const L& l, const R& r)
+{
+  using namespace vec3_expr_detail;
+  if constexpr(isScalar<L>)
+    return make<Mul>(static_cast<float>(l), r);
+  else if constexpr(isScalar<R>)
+    return make<Mul>(l, static_cast<float>(r));
+  else
+    return make<Mul>(l, r);
+}
+
+template<typename L, typename S,
+         typename = std::enable_if_t<vec3_expr_detail::isArray<L> && vec3_expr_detail::isScalar<S>>>
+auto operator/(const L& l, S s)
+{ return vec3_expr_detail::make<vec3_expr_detail::Div>(l, static_cast<float>(s)); }
+
+template<typename E, typename = std::enable_if_t<vec3_expr_detail::isArray<E>>>
+auto operator-(const E& e)
+{
+  using namespace vec3_expr_detail;
+  return Negate<NodeOf<E>> {Node<std::decay_t<E>>::make(e)};
+}
+
+template<typename E>
+Vec3SoA& Vec3SoA::operator=(const Vec3Expr<E>& e)
+{
+  vec3_expr_detail::evaluate<vec3_expr_detail::Assign>(*this, e);
+  return *this;
+}
+
+template<typename E>
+Vec3SoA::Vec3SoA(const Vec3Expr<E>& e)
+  : Vec3SoA(e.self().size())
+{ *this = e; }
+
+template<typename E>
+Vec3SoA& operator+=(Vec3SoA& dst, const Vec3Expr<E>& e)
+{
+  vec3_expr_detail::evaluate<vec3_expr_detail::Add>(dst, e);
+  return dst;
+}
+
+template<typename E>
+Vec3SoA& operator-=(Vec3SoA& dst, const Vec3Expr<E>& e)
+{
+  vec3_expr_detail::evaluate<vec3_expr_detail::Sub>(dst, e);
+  return dst;
+}
+
+template<typename E>
+Vec3SoA& operator*=(Vec3SoA& dst, const Vec3Expr<E>& e)
+{
+  vec3_expr_detail::evaluate<vec3_expr_detail::Mul>(dst, e);
+  return dst;
+}
+
+inline Vec3SoA& operator+=(Vec3SoA& dst, const Vec3SoA& a)
+{ return dst += vec3_expr_detail::Array {a}; }
+
+inline Vec3SoA& operator-=(Vec3SoA& dst, const Vec3SoA& a)
+{ return dst -= vec3_expr_detail::Array {a}; }
+
+inline Vec3SoA& operator*=(Vec3SoA& dst, float s)
+{ return dst *= vec3_expr_detail::Scalar {s}; }
+
+#endif
@@ -0,0 +1,352 @@
+#ifndef _VEC3_HALF_HH_
+#define _VEC3_HALF_HH_
+
+#include "add_to_all.hh"
+#include "aligned_allocator.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include <immintrin.h>
+
+//
+// vec3s stored as IEEE half precision (fp16) floats; Q16's layout, x y z x y z ..., at 6 bytes
+// a vec3 rather than 12.
+//
+// For arrays which are too big for the cache addToAll is limited by bandwidth (about 1ns a
+// vec3 from DRAM here, see results.md), so half the bytes should be nearly half the time,
+// if converting costs less than the memory it saves. F16C (vcvtph2ps / vcvtps2ph) converts 4
+// or 8 at a go, AVX-512 16, so the kernels load halves, widen them to floats, do the sum in
+// fp32 and narrow the result to store it; the arithmetic is the same as on floats, rounded
+// once more on the way out.
+//
+// What that costs is precision; a half has 11 significant bits, so values are stored to
+// about 1 part in 2048 (0.5 at 1000), up to 65504. The catch for addToAll in particular is
+// that anything added which is less than half the spacing at the value it is added to is
+// lost completely, every time; 1000 + 0.2 is stored as 1000. Good for data which is only
+// ever stored and read (normals, colours, offsets from a nearby origin), not for accumulating
+// small steps (see the accuracy part of half.cc).
+//
+// Conversions round to nearest even, as F16C does with _MM_FROUND_TO_NEAREST_INT; the plain
+// versions (halfFromFloat / floatFromHalf) do the same in software, bit for bit, for the
+// tails and for CPUs without F16C. Every CPU with AVX-512 has F16C (and AVX2), so the AVX-512
+// kernels hand their tails to the AVX2 ones.
+//
+
+//////////////////////////////////// single values //////////////////////////////////////////
+
+inline std::uint16_t halfFromFloat(float value)
+{
+  std::uint32_t f;
+  std::memcpy(&f, &value, sizeof f);
+  std::uint32_t sign = (f >> 16) & 0x8000;
+  std::uint32_t abs = f & 0x7fffffff;
+  if(abs >= 0x7f800000)
+    //
+    // infinity, or NaN which is kept a NaN (quiet) with the top of its payload.
+    //
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 | ((abs >> 13) & 0x3ff) : 0);
+  if(abs >= 0x477ff000)       // 65520 and up round to infinity
+    return sign | 0x7c00;
+  std::uint32_t e = abs >> 23, m = (abs & 0x7fffff) | 0x800000, shift, h;
+  if(e < 113){
+    //
+    // below 2^-14, a subnormal half; m * 2^(e - 150) in units of 2^-24.
+    //
+    shift = 126 - e;
+    if(shift > 24)
+      return sign;
+    h = m >> shift;
+  }
+  else{
+    shift = 13;
+    h = ((e - 112) << 10) | ((m >> 13) & 0x3ff);
+  }
+  std::uint32_t rest = m & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+  //
+  // rounding up may carry into the exponent, which is the right answer.
+  //
+  if(rest > halfway || (rest == halfway && (h & 1)))
+    ++h;
+  return sign | h;
+}
+
+inline float floatFromHalf(std::uint16_t h)
+{
+  std::uint32_t sign = std::uint32_t{h & 0x8000u} << 16;
+  std::uint32_t e = (h >> 10) & 0x1f, m = h & 0x3ff, f;
+  if(e == 0){
+    float v = static_cast<float>(m) * (1.0f / 16777216.0f);      // m * 2^-24, exact
+    std::memcpy(&f, &v, sizeof f);
+    f |= sign;
+  }
+  else if(e == 31)
+    f = sign | 0x7f800000 | (m << 13) | (m ? 0x400000 : 0);      // a NaN comes out quiet
+  else
+    f = sign | ((e + 112) << 23) | (m << 13);
+  float value;
+  std::memcpy(&value, &f, sizeof value);
+  return value;
+}
+
+//////////////////////////////////////// batches ////////////////////////////////////////////
+
+inline bool halfSupported(Isa isa)
+{
+  return isa == Isa::plain || isa == Isa::avx512 ? isaSupported(isa) :
+         isaSupported(isa) && __builtin_cpu_supports("f16c");
+}
+
+inline Isa bestHalfIsa()
+{
+  static const Isa best = halfSupported(Isa::avx512) ? Isa::avx512 :
+                          halfSupported(Isa::avx2) ? Isa::avx2 :
+                          halfSupported(Isa::sse) ? Isa::sse : Isa::plain;
+  return best;
+}
+
+inline void halvesFromFloats_plain(const float *in, std::size_t n, std::uint16_t *out)
+{
+  for(std::size_t i {0}; i < n; ++i)
+    out[i] = halfFromFloat(in[i]);
+}
+
+inline void floatsFromHalves_plain(const std::uint16_t *in, std::size_t n, float *out)
+{
+  for(std::size_t i {0}; i < n; ++i)
+    out[i] = floatFromHalf(in[i]);
+}
+
+__attribute__((target("f16c")))
+inline void halvesFromFloats_sse(const float *in, std::size_t n, std::uint16_t *out)
+{
+  std::size_t i {0};
+  for(; i + 4 <= n; i += 4)
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+                     _mm_cvtps_ph(_mm_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+  halvesFromFloats_plain(in + i, n - i, out + i);
+}
+
+__attribute__((target("f16c")))
+inline void floatsFromHalves_sse(const std::uint16_t *in, std::size_t n, float *out)
+{
+  std::size_t i {0};
+  for(; i + 4 <= n; i += 4)
+    _mm_storeu_ps(out + i, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i))));
+  floatsFromHalves_plain(in + i, n - i, out + i);
+}
+
+__attribute__((target("avx2,f16c")))
+inline void halvesFromFloats_avx2(const float *in, std::size_t n, std::uint16_t *out)
+{
+  std::size_t i {0};
+  for(; i + 8 <= n; i += 8)
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                     _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+  halvesFromFloats_sse(in + i, n - i, out + i);
+}
+
+__attribute__((target("avx2,f16c")))
+inline void floatsFromHalves_avx2(const std::uint16_t *in, std::size_t n, float *out)
+{
+  std::size_t i {0};
+  for(; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))));
+  floatsFromHalves_sse(in + i, n - i, out + i);
+}
+
+__attribute__((target("avx512f")))
+inline void halvesFromFloats_avx512(const float *in, std::size_t n, std::uint16_t *out)
+{
+  std::size_t i {0};
+  for(; i + 16 <= n; i += 16)
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                        _mm512_cvtps_ph(_mm512_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+  halvesFromFloats_avx2(in + i, n - i, out + i);
+}
+
+__attribute__((target("avx512f")))
+inline void floatsFromHalves_avx512(const std::uint16_t *in, std::size_t n, float *out)
+{
+  std::size_t i {0};
+  for(; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(out + i, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i))));
+  floatsFromHalves_avx2(in + i, n - i, out + i);
+}
+
+inline void halvesFromFloats(const float *in, std::size_t n, std::uint16_t *out, Isa isa = bestHalfIsa())
+{
+  switch(isa){
+  case Isa::plain: halvesFromFloats_plain(in, n, out); break;
+  case Isa::sse: halvesFromFloats_sse(in, n, out); break;
+  case Isa::avx2: halvesFromFloats_avx2(in, n, out); break;
+  case Isa::avx512: halvesFromFloats_avx512(in, n, out); break;
+  }
+}
+
+inline void floatsFromHalves(const std::uint16_t *in, std::size_t n, float *out, Isa isa = bestHalfIsa())
+{
+  switch(isa){
+  case Isa::plain: floatsFromHalves_plain(in, n, out); break;
+  case Isa::sse: floatsFromHalves_sse(in, n, out); break;
+  case Isa::avx2: floatsFromHalves_avx2(in, n, out); break;
+  case Isa::avx512: floatsFromHalves_avx512(in, n, out); break;
+  }
+}
+
+/////////////////////////////////////// the array ///////////////////////////////////////////
+
+//
+// n vec3s as 3n halves, 64 byte aligned (with Pages::huge on 2MiB pages if it can be, see
+// aligned_allocator.hh), and zeroed.
+//
+class Vec3Half
+{
+public:
+  static constexpr std::size_t alignment {64};
+
+  Vec3Half() = default;
+
+  explicit Vec3Half(std::size_t n, Pages pages = Pages::normal)
+    : _size(n), _pages(pages)
+  {
+    _data = static_cast<std::uint16_t*>(allocateAligned(bytes(), alignment, pages));
+    std::memset(_data, 0, bytes());
+  }
+
+  Vec3Half(const vec3 *aos, std::size_t n, Isa isa = bestHalfIsa())
+    : Vec3Half(n)
+  { halvesFromFloats(&aos->x, 3 * n, _data, isa); }
+
+  Vec3Half(const Vec3Half&) = delete;
+  Vec3Half& operator=(const Vec3Half&) = delete;
+
+  Vec3Half(Vec3Half&& other) noexcept
+  { swap(other); }
+
+  Vec3Half& operator=(Vec3Half&& other) noexcept
+  {
+    Vec3Half tmp {std::move(other)};
+    swap(tmp);
+    return *this;
+  }
+
+  ~Vec3Half()
+  { freeAligned(_data, bytes(), _pages); }
+
+  std::size_t size() const
+  { return _size; }
+
+  std::uint16_t* data() { return _data; }
+  const std::uint16_t* data() const { return _data; }
+
+  vec3 operator[](std::size_t i) const
+  { return vec3{floatFromHalf(_data[3 * i]), floatFromHalf(_data[3 * i + 1]), floatFromHalf(_data[3 * i + 2])}; }
+
+  void set(std::size_t i, vec3 v)
+  {
+    _data[3 * i] = halfFromFloat(v.x);
+    _data[3 * i + 1] = halfFromFloat(v.y);
+    _data[3 * i + 2] = halfFromFloat(v.z);
+  }
+
+  void toAoS(vec3 *out, Isa isa = bestHalfIsa()) const
+  { floatsFromHalves(_data, 3 * _size, &out->x, isa); }
+
+private:
+  std::size_t bytes() const
+  { return 3 * _size * sizeof(std::uint16_t); }
+
+  void swap(Vec3Half& other) noexcept
+  {
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+    std::swap(_pages, other._pages);
+  }
+
+  std::uint16_t *_data {nullptr};
+  std::size_t _size {0};
+  Pages _pages {Pages::normal};
+};
+
+/////////////////////////////////////// addToAll ////////////////////////////////////////////
+
+//
+// Load, widen, add, narrow, store; the addends lined up with the vec3s as in add_to_all.hh's
+// AoS kernels (x y z x | y z x y | z x y z at 4 a register), the tail handed down to the next
+// narrower kernel.
+//
+inline void addToAllHalf_plain(std::uint16_t *p, std::size_t num, vec3 toAdd)
+{
+  for(std::size_t i {0}; i < num; ++i, p += 3){
+    p[0] = halfFromFloat(floatFromHalf(p[0]) + toAdd.x);
+    p[1] = halfFromFloat(floatFromHalf(p[1]) + toAdd.y);
+    p[2] = halfFromFloat(floatFromHalf(p[2]) + toAdd.z);
+  }
+}
+
+__attribute__((target("f16c")))
+inline void addToAllHalf_sse(std::uint16_t *p, std::size_t num, vec3 toAdd)
+{
+  const __m128 t = _mm_setr_ps(toAdd.x, toAdd.y, toAdd.z, 0.0f);
+  const __m128 a[3] {_mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 2, 1, 0)),
+                     _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 2, 1)),
+                     _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 1, 0, 2))};
+  std::size_t i {0};
+  for(; i + 4 <= num; i += 4, p += 12)
+    for(int r {0}; r < 3; ++r){
+      __m128i *q = reinterpret_cast<__m128i*>(p + 4 * r);
+      _mm_storel_epi64(q, _mm_cvtps_ph(_mm_add_ps(_mm_cvtph_ps(_mm_loadl_epi64(q)), a[r]),
+                                       _MM_FROUND_TO_NEAREST_INT));
+    }
+  addToAllHalf_plain(p, num - i, toAdd);
+}
+
+__attribute__((target("avx2,f16c")))
+inline void addToAllHalf_avx2(std::uint16_t *p, std::size_t num, vec3 toAdd)
+{
+  const __m256 t = _mm256_setr_ps(toAdd.x, toAdd.y, toAdd.z, 0, 0, 0, 0, 0);
+  const __m256 a[3] {_mm256_permutevar8x32_ps(t, _mm256_setr_epi32(0, 1, 2, 0, 1, 2, 0, 1)),
+                     _mm256_permutevar8x32_ps(t, _mm256_setr_epi32(2, 0, 1, 2, 0, 1, 2, 0)),
+                     _mm256_permutevar8x32_ps(t, _mm256_setr_epi32(1, 2, 0, 1, 2, 0, 1, 2))};
+  std::size_t i {0};
+  for(; i + 8 <= num; i += 8, p += 24)
+    for(int r {0}; r < 3; ++r){
+      __m128i *q = reinterpret_cast<__m128i*>(p + 8 * r);
+      _mm_storeu_si128(q, _mm256_cvtps_ph(_mm256_add_ps(_mm256_cvtph_ps(_mm_loadu_si128(q)), a[r]),
+                                          _MM_FROUND_TO_NEAREST_INT));
+    }
+  addToAllHalf_sse(p, num - i, toAdd);
+}
+
+__attribute__((target("avx512f")))
+inline void addToAllHalf_avx512(std::uint16_t *p, std::size_t num, vec3 toAdd)
+{
+  const __m512 t = _mm512_setr_ps(toAdd.x, toAdd.y, toAdd.z, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m512 a[3] {
+    _mm512_permutexvar_ps(_mm512_setr_epi32(0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0), t),
+    _mm512_permutexvar_ps(_mm512_setr_epi32(1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1), t),
+    _mm512_permutexvar_ps(_mm512_setr_epi32(2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2), t)};
+  std::size_t i {0};
+  for(; i + 16 <= num; i += 16, p += 48)
+    for(int r {0}; r < 3; ++r){
+      __m256i *q = reinterpret_cast<__m256i*>(p + 16 * r);
+      _mm256_storeu_si256(q, _mm512_cvtps_ph(_mm512_add_ps(_mm512_cvtph_ps(_mm256_loadu_si256(q)), a[r]),
+                                             _MM_FROUND_TO_NEAREST_INT));
+    }
+  addToAllHalf_avx2(p, num - i, toAdd);
+}
+
+inline void addToAll(Vec3Half& array, vec3 toAdd, Isa isa = bestHalfIsa())
+{
+  switch(isa){
+  case Isa::plain: addToAllHalf_plain(array.data(), array.size(), toAdd); break;
+  case Isa::sse: addToAllHalf_sse(array.data(), array.size(), toAdd); break;
+  case Isa::avx2: addToAllHalf_avx2(array.data(), array.size(), toAdd); break;
+  case Isa::avx512: addToAllHalf_avx512(array.data(), array.size(), toAdd); break;
+  }
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef _VEC3_SOA_HH_
+#define _VEC3_SOA_HH_
+
+#include "aligned_allocator.hh"
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+
+//
+// The vec3 from Q16 (dambuster_questions/Q16.cpp); x, y, z one after the other, 12 bytes.
+//
+struct vec3
+{
+  float x, y, z;
+};
+
+template<typename E>
+struct Vec3Expr;
+
+//
+// The same thing as a structure of arrays; all the x's, then all the y's, then all the z's.
+//
+// With vec3 in an array (AoS) four floats of a SIMD register are x y z x, then y z x y, ...
+// so anything that treats the components differently needs shuffles, and every load is
+// misaligned with respect to the vec3s. In SoA a register is 4 (8, 16) x's, lined up, so the
+// code for one vec3 is the code for 16 of them.
+//
+// The three arrays share one allocation, each starting on a 64 byte boundary, and each is
+// padded to a whole number of 64 bytes (16 floats) so a kernel may read and write the padding
+// if it wants to, although the ones in add_to_all.hh don't rely on it. With Pages::huge the
+// allocation is backed by 2MiB pages where it can be (aligned_allocator.hh).
+//
+class Vec3SoA
+{
+public:
+  static constexpr std::size_t alignment {64};
+  static constexpr std::size_t lane {alignment / sizeof(float)};
+
+  Vec3SoA() = default;
+
+  explicit Vec3SoA(std::size_t n, Pages pages = Pages::normal)
+    : _size(n), _stride((n + lane - 1) / lane * lane), _pages(pages)
+  {
+    std::size_t bytes = 3 * _stride * sizeof(float);
+    _data = static_cast<float*>(allocateAligned(bytes, alignment, pages));
+    std::memset(_data, 0, bytes);
+  }
+
+  Vec3SoA(const vec3 *aos, std::size_t n)
+    : Vec3SoA(n)
+  {
+    for(std::size_t i {0}; i < n; ++i){
+      x()[i] = aos[i].x;
+      y()[i] = aos[i].y;
+      z()[i] = aos[i].z;
+    }
+  }
+
+  //
+  // from, and assigned, an expression of Vec3SoAs (vec3_expr.hh), in one pass.
+  //
+  template<typename E>
+  Vec3SoA(const Vec3Expr<E>& e);
+
+  template<typename E>
+  Vec3SoA& operator=(const Vec3Expr<E>& e);
+
+  Vec3SoA(const Vec3SoA&) = delete;
+  Vec3SoA& operator=(const Vec3SoA&) = delete;
+
+  Vec3SoA(Vec3SoA&& other) noexcept
+  { swap(other); }
+
+  Vec3SoA& operator=(Vec3SoA&& other) noexcept
+  {
+    Vec3SoA tmp {std::move(other)};
+    swap(tmp);
+    return *this;
+  }
+
+  ~Vec3SoA()
+  { freeAligned(_data, 3 * _stride * sizeof(float), _pages); }
+
+  std::size_t size() const
+  { return _size; }
+
+  float* x() { return _data; }
+  float* y() { return _data + _stride; }
+  float* z() { return _data + 2 * _stride; }
+  const float* x() const { return _data; }
+  const float* y() const { return _data + _stride; }
+  const float* z() const { return _data + 2 * _stride; }
+
+  vec3 operator[](std::size_t i) const
+  { return vec3{x()[i], y()[i], z()[i]}; }
+
+  void set(std::size_t i, vec3 v)
+  {
+    x()[i] = v.x;
+    y()[i] = v.y;
+    z()[i] = v.z;
+  }
+
+  void toAoS(vec3 *out) const
+  {
+    for(std::size_t i {0}; i < _size; ++i)
+      out[i] = (*this)[i];
+  }
+
+private:
+  void swap(Vec3SoA& other) noexcept
+  {
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+    std::swap(_stride, other._stride);
+    std::swap(_pages, other._pages);
+  }
+
+  float *_data {nullptr};
+  std::size_t _size {0};
+  std::size_t _stride {0};
+  Pages _pages {Pages::normal};
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef _VEC3A_HH_
+#define _VEC3A_HH_
+
+#include "add_to_all.hh"
+
+#include <cstddef>
+
+#include <immintrin.h>
+
+//
+// vec3 padded to 16 bytes; x y z and a float of nothing.
+//
+// A third more memory than Q16's packed vec3 (and a third more to move, for a pass that is
+// limited by bandwidth), but every element is one SSE register, four are one AVX-512 register
+// and, in an array starting on a 64 byte boundary (aligned_allocator.hh), four are exactly
+// one cache line. So the kernels need no rotated addends, every load is aligned, and fetching
+// one element at random touches one line; a packed vec3 crosses a line 2 times in 16, and a
+// Vec3SoA element is in three lines.
+//
+// w is kept 0 by everything here, so a kernel can add or multiply whole registers without
+// caring about it; the conversions below write it.
+//
+
+struct alignas(16) vec3a
+{
+  float x, y, z, w;
+};
+
+//
+// packed to padded and back. Each element is moved as a 4 float register; from packed, the 4th
+// float is the next element's x (so the last one is done on its own, there may be no next) and
+// is cleared; to packed, the store's 4th float lands on the next element's x, which the next
+// store then overwrites, so it has to go in order and, again, the last is done on its own.
+//
+__attribute__((target("sse2")))
+inline void toPadded(const vec3 *in, std::size_t n, vec3a *out)
+{
+  if(n == 0)
+    return;
+  const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+  const float *p = &in->x;
+  for(std::size_t i {0}; i + 1 < n; ++i)
+    _mm_store_ps(&out[i].x, _mm_and_ps(_mm_loadu_ps(p + 3 * i), xyz));
+  out[n - 1] = vec3a{in[n - 1].x, in[n - 1].y, in[n - 1].z, 0.0f};
+}
+
+__attribute__((target("sse2")))
+inline void toPacked(const vec3a *in, std::size_t n, vec3 *out)
+{
+  if(n == 0)
+    return;
+  float *p = &out->x;
+  for(std::size_t i {0}; i + 1 < n; ++i)
+    _mm_storeu_ps(p + 3 * i, _mm_load_ps(&in[i].x));
+  out[n - 1] = vec3{in[n - 1].x, in[n - 1].y, in[n - 1].z};
+}
+
+//
+// the same four kernels as add_to_all.hh; an element a register at SSE, 2 at AVX2, 4 at
+// AVX-512, with no shuffling of the addend beyond broadcasting x y z 0 to every 4 lanes.
+// A vec3a is always 16 byte aligned (new vec3a[n] too), so SSE's loads are aligned ones; the
+// wider ones are unaligned, which costs nothing when the address is aligned, and they are
+// quickest on a 64 byte aligned array, where no register is split across two lines.
+//
+inline void addToAllPadded_plain(vec3a *array, std::size_t num, vec3 toAdd)
+{
+  for(std::size_t i {0}; i < num; ++i){
+    array[i].x += toAdd.x;
+    array[i].y += toAdd.y;
+    array[i].z += toAdd.z;
+  }
+}
+
+__attribute__((target("sse2")))
+inline void addToAllPadded_sse(vec3a *array, std::size_t num, vec3 toAdd)
+{
+  const __m128 a = _mm_setr_ps(toAdd.x, toAdd.y, toAdd.z, 0.0f);
+  float *p = &array->x;
+  for(std::size_t i {0}; i < num; ++i, p += 4)
+    _mm_store_ps(p, _mm_add_ps(_mm_load_ps(p), a));
+}
+
+__attribute__((target("avx2")))
+inline void addToAllPadded_avx2(vec3a *array, std::size_t num, vec3 toAdd)
+{
+  const __m256 a = _mm256_setr_ps(toAdd.x, toAdd.y, toAdd.z, 0, toAdd.x, toAdd.y, toAdd.z, 0);
+  float *p = &array->x;
+  std::size_t i {0};
+  for(; i + 2 <= num; i += 2, p += 8)
+    _mm256_storeu_ps(p, _mm256_add_ps(_mm256_loadu_ps(p), a));
+  addToAllPadded_sse(array + i, num - i, toAdd);
+}
+
+__attribute__((target("avx512f")))
+inline void addToAllPadded_avx512(vec3a *array, std::size_t num, vec3 toAdd)
+{
+  const __m512 a = _mm512_broadcast_f32x4(_mm_setr_ps(toAdd.x, toAdd.y, toAdd.z, 0.0f));
+  float *p = &array->x;
+  std::size_t i {0};
+  for(; i + 4 <= num; i += 4, p += 16)
+    _mm512_storeu_ps(p, _mm512_add_ps(_mm512_loadu_ps(p), a));
+  if(i < num){
+    //
+    // the last 1-3 elements, 4 floats each.
+    //
+    __mmask16 m = static_cast<__mmask16>((1u << (4 * (num - i))) - 1);
+    _mm512_mask_storeu_ps(p, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, p), a));
+  }
+}
+
+inline void addToAll(vec3a *array, std::size_t num, vec3 toAdd, Isa isa = bestIsa())
+{
+  switch(isa){
+  case Isa::plain: addToAllPadded_plain(array, num, toAdd); break;
+  case Isa::sse: addToAllPadded_sse(array, num, toAdd); break;
+  case Isa::avx2: addToAllPadded_avx2(array, num, toAdd); break;
+  case Isa::avx512: addToAllPadded_avx512(array, num, toAdd); break;
+  }
+}
+
+#endif
@@ -0,0 +1,450 @@
+#ifndef _BENCH_HH_
+#define _BENCH_HH_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+
+#include "perf_counters.hh"
+#include "roofline.hh"
+
+//
+// A small micro benchmark harness, for the experiments which so far have timed one run with
+// high_resolution_clock and drawn conclusions from it (the Q16.cpp results swing by over 30%
+// from run to run, more than the differences it was looking for).
+//
+// For each benchmark it;
+//
+//  1. calibrates; grows the number of iterations per sample until a sample takes at least
+//     minSampleSeconds, so the clock's resolution and overhead don't matter.
+//  2. warms up; runs samples without recording them for warmupSeconds, so caches, branch
+//     predictors, page faults and the CPU's clock speed have settled.
+//  3. takes 'samples' samples and reports the median time per item, the median absolute
+//     deviation (scaled to be comparable to a standard deviation) and a 95% confidence
+//     interval for the median (from order statistics, so no assumption the times are normal,
+//     which they never are; they have a long tail to the right).
+//
+// Benchmarks are compared with the first one in their suite. The difference is only called
+// when the two confidence intervals don't overlap, otherwise it prints '~'. That is
+// conservative, which is the point.
+//
+// The process is pinned to one CPU (the one it started on unless --cpu says otherwise) so a
+// migration half way through a sample can't happen, and the results can be written as JSON.
+//
+// A benchmark is a function taking an iteration count which does the thing that many times;
+// use doNotOptimize() on results and clobberMemory() after writes so the compiler can't
+// decide the work is unused and throw it away.
+//
+// With --counters it also reads the thread's perf counters (perf_counters.hh) over the
+// samples and prints them per item under each line; whichever of them the host allows.
+//
+// A benchmark which says how many bytes and flops an item takes, and how big its working set
+// is (Register::roofline()), can be put against the machine's limits (roofline.hh); with
+// --roofline the limits are measured first, and each line says what share of the attainable
+// time per item it gets, and whether that limit is the bandwidth or the flops.
+//
+// Options (run with --help); --filter=substring --samples=N --min-time=seconds
+//                            --warmup=seconds --cpu=N --json=file --counters --roofline
+//
+
+namespace bench
+{
+
+//
+// makes the compiler believe value is read, so whatever computed it has to happen.
+//
+template<typename T>
+inline void doNotOptimize(const T& value)
+{ asm volatile("" : : "r,m"(value) : "memory"); }
+
+template<typename T>
+inline void doNotOptimize(T& value)
+{ asm volatile("" : "+r,m"(value) : : "memory"); }
+
+//
+// makes the compiler believe all memory is read and written, so stores before it happen.
+//
+inline void clobberMemory()
+{ asm volatile("" : : : "memory"); }
+
+struct Options
+{
+  std::string filter;
+  int samples {30};
+  double minSampleSeconds {0.01};
+  double warmupSeconds {0.2};
+  int cpu {-1};
+  std::string json;
+  bool counters {false};
+  bool roofline {false};
+};
+
+struct Benchmark
+{
+  std::string suite;
+  std::string name;
+  double itemsPerIteration {1.0};     // the time is reported per item
+  std::string unit {"item"};
+  std::function<void(std::size_t)> run;
+  double bytesPerItem {0.0};          // memory traffic per item, as STREAM counts it
+  double flopsPerItem {0.0};
+  std::size_t workingSetBytes {0};
+};
+
+struct Stats
+{
+  double median {0.0};
+  double mad {0.0};         // median absolute deviation * 1.4826
+  double ciLow {0.0};
+  double ciHigh {0.0};
+  double mean {0.0};
+  double min {0.0};
+  double max {0.0};
+};
+
+struct Result
+{
+  const Benchmark *benchmark {nullptr};
+  std::size_t iterations {0};             // per sample
+  std::vector<double> nsPerItem;          // one per sample
+  Stats stats;
+  CounterValues counters;                 // per item, over all the samples, if asked for
+  double attainableNs {0.0};              // per item, from the roofline, if asked for
+  bool memoryBound {false};
+};
+
+inline double median(std::vector<double> v)
+{
+  if(v.empty())
+    return 0.0;
+  std::sort(v.begin(), v.end());
+  std::size_t n = v.size();
+  return n % 2 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+inline Stats computeStats(const std::vector<double>& samples)
+{
+  Stats s;
+  if(samples.empty())
+    return s;
+  std::vector<double> v = samples;
+  std::sort(v.begin(), v.end());
+  std::size_t n = v.size();
+  s.median = median(v);
+  std::vector<double> deviation(n);
+  for(std::size_t i {0}; i < n; ++i)
+    deviation[i] = std::abs(v[i] - s.median);
+  s.mad = 1.4826 * median(deviation);
+  //
+  // the ranks either side of the median which bracket it 95% of the time; the number of
+  // samples below the true median is Binomial(n, 1/2), approximated by a normal.
+  //
+  double half = 1.96 * std::sqrt(static_cast<double>(n)) / 2.0;
+  long lo = static_cast<long>(std::floor(n / 2.0 - half));
+  long hi = static_cast<long>(std::ceil(n / 2.0 + half)) - 1;
+  s.ciLow = v[static_cast<std::size_t>(std::max(0l, lo))];
+  s.ciHigh = v[static_cast<std::size_t>(std::min(static_cast<long>(n) - 1, hi))];
+  double sum {0.0};
+  for(double x : v)
+    sum += x;
+  s.mean = sum / n;
+  s.min = v.front();
+  s.max = v.back();
+  return s;
+}
+
+inline std::vector<Benchmark>& registry()
+{
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+//
+// registers a benchmark at static initialisation; a suite is a .cc file full of these.
+//
+struct Register
+{
+  Register(std::string suite, std::string name, std::function<void(std::size_t)> run,
+           double itemsPerIteration = 1.0, std::string unit = "item")
+    : _index(registry().size())
+  {
+    registry().push_back(Benchmark{std::move(suite), std::move(name), itemsPerIteration,
+                                   std::move(unit), std::move(run)});
+  }
+
+  //
+  // what an item costs the machine, for --roofline.
+  //
+  Register& roofline(double bytesPerItem, double flopsPerItem, std::size_t workingSetBytes)
+  {
+    Benchmark& b = registry()[_index];
+    b.bytesPerItem = bytesPerItem;
+    b.flopsPerItem = flopsPerItem;
+    b.workingSetBytes = workingSetBytes;
+    return *this;
+  }
+
+private:
+  std::size_t _index;
+};
+
+//
+// pins the process to cpu, or to the one it is on now if cpu < 0. Returns the cpu, or -1 if
+// it couldn't.
+//
+inline int pinToCpu(int cpu)
+{
+  if(cpu < 0)
+    cpu = sched_getcpu();
+  if(cpu < 0)
+    return -1;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0 ? cpu : -1;
+}
+
+inline double secondsFor(const Benchmark& b, std::size_t iterations)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  b.run(iterations);
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+inline Result runBenchmark(const Benchmark& b, const Options& options)
+{
+  Result r;
+  r.benchmark = &b;
+  std::size_t iterations {1};
+  double t = secondsFor(b, iterations);
+  while(t < options.minSampleSeconds){
+    //
+    // aim straight for the target (with some margin) once the time means something.
+    //
+    std::size_t next = t > options.minSampleSeconds / 100
+                     ? static_cast<std::size_t>(iterations * 1.2 * options.minSampleSeconds / t)
+                     : iterations * 10;
+    iterations = std::max(next, iterations + 1);
+    t = secondsFor(b, iterations);
+  }
+  r.iterations = iterations;
+  for(double warm {t}; warm < options.warmupSeconds; )
+    warm += secondsFor(b, iterations);
+  CounterValues before;
+  if(options.counters)
+    before = PerfCounters::forThisThread().read();
+  for(int s {0}; s < options.samples; ++s)
+    r.nsPerItem.push_back(secondsFor(b, iterations) * 1e9 / (iterations * b.itemsPerIteration));
+  if(options.counters){
+    //
+    // includes the clock reads either side of each sample, which are nothing next to >= 10ms.
+    //
+    double items = static_cast<double>(options.samples) * iterations * b.itemsPerIteration;
+    r.counters = (PerfCounters::forThisThread().read() - before).scaled(1.0 / items);
+  }
+  r.stats = computeStats(r.nsPerItem);
+  if(options.roofline && (b.bytesPerItem > 0.0 || b.flopsPerItem > 0.0))
+    r.attainableNs = roofline().attainableNs(b.bytesPerItem, b.flopsPerItem, b.workingSetBytes,
+                                             &r.memoryBound);
+  return r;
+}
+
+inline std::string jsonString(const std::string& s)
+{
+  std::string out {"\""};
+  for(char c : s){
+    if(c == '"' || c == '\\'){
+      out += '\\';
+      out += c;
+    }
+    else if(static_cast<unsigned char>(c) < 0x20){
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    }
+    else
+      out += c;
+  }
+  return out + "\"";
+}
+
+inline void writeJson(std::ostream& os, const std::vector<Result>& results, const Options& options,
+                      int cpu)
+{
+  os << std::setprecision(9);
+  os << "{\n  \"cpu\": " << cpu << ",\n  \"samples\": " << options.samples
+     << ",\n  \"min_sample_seconds\": " << options.minSampleSeconds
+     << ",\n  \"warmup_seconds\": " << options.warmupSeconds;
+  if(options.roofline){
+    const Roofline& roof = roofline();
+    os << ",\n  \"roofline\": {\"peak_gflops\": " << roof.peakGflops << ", \"levels\": [";
+    for(std::size_t i {0}; i < roof.levels.size(); ++i){
+      const MemoryLevel& l = roof.levels[i];
+      os << (i ? ", " : "") << "{\"name\": " << jsonString(l.name) << ", \"probe_bytes\": "
+         << l.probeBytes << ", \"copy_gbps\": " << l.copy << ", \"scale_gbps\": " << l.scale
+         << ", \"add_gbps\": " << l.add << ", \"triad_gbps\": " << l.triad
+         << ", \"update_gbps\": " << l.update << "}";
+    }
+    os << "]}";
+  }
+  os << ",\n  \"benchmarks\": [";
+  for(std::size_t i {0}; i < results.size(); ++i){
+    const Result& r = results[i];
+    const Stats& s = r.stats;
+    os << (i ? ",\n" : "\n") << "    {\"suite\": " << jsonString(r.benchmark->suite)
+       << ", \"name\": " << jsonString(r.benchmark->name)
+       << ", \"unit\": " << jsonString(r.benchmark->unit)
+       << ", \"iterations_per_sample\": " << r.iterations
+       << ", \"median_ns\": " << s.median << ", \"mad_ns\": " << s.mad
+       << ", \"ci95_ns\": [" << s.ciLow << ", " << s.ciHigh << "]"
+       << ", \"mean_ns\": " << s.mean << ", \"min_ns\": " << s.min << ", \"max_ns\": " << s.max
+       << ", \"samples_ns\": [";
+    for(std::size_t j {0}; j < r.nsPerItem.size(); ++j)
+      os << (j ? ", " : "") << r.nsPerItem[j];
+    os << "]";
+    if(r.attainableNs > 0.0)
+      os << ", \"attainable_ns\": " << r.attainableNs << ", \"attainable_share\": "
+         << r.attainableNs / s.median << ", \"bound\": " << (r.memoryBound ? "\"memory\"" : "\"flops\"");
+    if(options.counters){
+      //
+      // per item; a counter the host doesn't have is null rather than missing or 0.
+      //
+      os << ", \"counters\": {";
+      for(int c {0}; c < counterCount; ++c){
+        os << (c ? ", " : "") << jsonString(counterName(static_cast<Counter>(c))) << ": ";
+        if(r.counters.valid[c])
+          os << r.counters.value[c];
+        else
+          os << "null";
+      }
+      os << "}";
+    }
+    os << "}";
+  }
+  os << "\n  ]\n}\n";
+}
+
+inline bool parseOptions(int argc, char *argv[], Options& options)
+{
+  for(int i {1}; i < argc; ++i){
+    std::string arg = argv[i];
+    auto value = [&](const char *prefix) -> const char* {
+      std::size_t n = std::strlen(prefix);
+      return arg.compare(0, n, prefix) == 0 ? argv[i] + n : nullptr;
+    };
+    if(const char *v = value("--filter="))
+      options.filter = v;
+    else if(const char *v = value("--samples="))
+      options.samples = std::max(1, std::atoi(v));
+    else if(const char *v = value("--min-time="))
+      options.minSampleSeconds = std::atof(v);
+    else if(const char *v = value("--warmup="))
+      options.warmupSeconds = std::atof(v);
+    else if(const char *v = value("--cpu="))
+      options.cpu = std::atoi(v);
+    else if(const char *v = value("--json="))
+      options.json = v;
+    else if(arg == "--counters")
+      options.counters = true;
+    else if(arg == "--roofline")
+      options.roofline = true;
+    else{
+      std::cerr << "usage: " << argv[0] << " [--filter=substring] [--samples=N] "
+                << "[--min-time=seconds] [--warmup=seconds] [--cpu=N] [--json=file] [--counters] [--roofline]"
+                << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+//
+// runs every registered benchmark whose "suite/name" contains the filter; a table on stdout
+// and JSON if asked. Returns main's exit code.
+//
+inline int runAll(int argc, char *argv[])
+{
+  Options options;
+  if(!parseOptions(argc, argv, options))
+    return 1;
+  int cpu = pinToCpu(options.cpu);
+  std::cout << "pinned to cpu " << cpu << ", " << options.samples << " samples of >= "
+            << options.minSampleSeconds * 1000 << "ms, " << options.warmupSeconds * 1000
+            << "ms warm up" << std::endl;
+  if(options.counters){
+    const PerfCounters& counters = PerfCounters::forThisThread();
+    std::cout << "perf counters" << (counters.anyHardware() ? "" : ", software only") << ";"
+              << std::endl;
+    printUnavailable(std::cout, counters);
+  }
+  if(options.roofline){
+    std::cout << "roofline;" << std::endl;
+    printRoofline(std::cout, roofline());
+  }
+
+  std::vector<Result> results;
+  std::size_t baseline {0};
+  std::string suite;
+  for(const Benchmark& b : registry()){
+    if((b.suite + "/" + b.name).find(options.filter) == std::string::npos)
+      continue;
+    if(b.suite != suite){
+      suite = b.suite;
+      baseline = results.size();
+      std::cout << "\n" << suite << std::endl;
+    }
+    results.push_back(runBenchmark(b, options));
+    const Result& r = results.back();
+    const Stats& s = r.stats;
+    std::cout << "  " << std::left << std::setw(32) << b.name << std::right << std::fixed
+              << std::setprecision(3) << std::setw(10) << s.median << " ns/" << b.unit
+              << "  mad " << std::setw(7) << s.mad << "  ci95 [" << s.ciLow << ", " << s.ciHigh
+              << "]";
+    //
+    // the baseline is kept by index as results may have reallocated.
+    //
+    if(results.size() - 1 != baseline){
+      const Stats& base = results[baseline].stats;
+      bool overlap = s.ciLow <= base.ciHigh && base.ciLow <= s.ciHigh;
+      std::cout << "  " << std::setprecision(2) << base.median / s.median << "x"
+                << (overlap ? " ~" : "");
+    }
+    if(r.attainableNs > 0.0){
+      const Roofline& roof = roofline();
+      std::cout << "  " << std::setprecision(0) << 100 * r.attainableNs / s.median << "% of "
+                << (r.memoryBound ? roof.levelFor(b.workingSetBytes).name + " bandwidth"
+                                  : std::string("peak flops"));
+    }
+    std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+    if(options.counters){
+      std::cout << "    ";
+      printCounters(std::cout, r.counters, 1.0, b.unit.c_str());
+      std::cout << std::endl;
+    }
+  }
+
+  if(!options.json.empty()){
+    std::ofstream out {options.json};
+    writeJson(out, results, options, cpu);
+    std::cout << "\nwrote " << options.json << std::endl;
+  }
+  return 0;
+}
+
+}
+
+#endif
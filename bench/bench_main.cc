@@ -0,0 +1,10 @@
+//
+// Runs every suite linked in (see the makefile); options as bench.hh says.
+//
+
+#include "bench.hh"
+
+int main(int argc, char *argv[])
+{
+  return bench::runAll(argc, argv);
+}
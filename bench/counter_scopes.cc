@@ -0,0 +1,77 @@
+//
+// ScopedCounters (perf_counters.hh) round addToAll on an array which fits in L1 and on one
+// which fits in no cache, and on the first touch of a fresh allocation, then the report.
+//
+// What it checks holds whatever the host allows; every counter is either there or says why
+// not, the software ones are always there, the first touch of 64MiB takes page faults and
+// adding to an array already in memory doesn't.
+//
+
+#include "perf_counters.hh"
+#include "../add_to_all/vec3_soa.hh"
+#include "../add_to_all/add_to_all.hh"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+const vec3 toAdd {0.5f, 0.6f, 0.7f};
+
+void addToAllScoped(const std::string& name, std::vector<vec3>& array, int passes)
+{
+  for(int p {0}; p < passes; ++p){
+    bench::ScopedCounters scope {name};
+    addToAll(array.data(), array.size(), toAdd);
+  }
+}
+
+int main()
+{
+  bench::PerfCounters& counters = bench::PerfCounters::forThisThread();
+  std::cout << "perf_event_paranoid=" << bench::perfEventParanoid() << "; counters which aren't there;"
+            << std::endl;
+  bench::printUnavailable(std::cout, counters);
+  for(int i {0}; i < bench::counterCount; ++i){
+    bench::Counter c = static_cast<bench::Counter>(i);
+    assert(counters.available(c) != !counters.reason(c).empty());
+  }
+  assert(counters.available(bench::Counter::taskClock));
+  assert(counters.available(bench::Counter::pageFaults));
+
+  std::vector<vec3> small(2'048), large(16'000'000);
+  addToAllScoped("addToAll 2048 vec3s (L1)", small, 1000);
+  addToAllScoped("addToAll 16M vec3s (DRAM)", large, 10);
+
+  constexpr std::size_t touched {64 << 20};
+  {
+    bench::ScopedCounters scope {"first touch of 64MiB"};
+    char *p = static_cast<char*>(std::malloc(touched));
+    std::memset(p, 1, touched);
+    asm volatile("" : : "r"(p) : "memory");
+    std::free(p);
+  }
+  //
+  // each thread counts itself; one scope name from two threads adds up in one report line.
+  //
+  std::thread other {[]{
+    std::vector<vec3> a(2'048);
+    addToAllScoped("addToAll 2048 vec3s (L1)", a, 1000);
+  }};
+  other.join();
+
+  std::cout << "\nper call;" << std::endl;
+  bench::printCounterReport(std::cout);
+
+  auto& report = bench::scopeReport();
+  const bench::ScopeTotals& first = report.at("first touch of 64MiB");
+  const bench::ScopeTotals& again = report.at("addToAll 16M vec3s (DRAM)");
+  assert(first.values[bench::Counter::pageFaults] >= touched / 4096 / 2);
+  assert(again.values[bench::Counter::pageFaults] < 100);
+  assert(again.values[bench::Counter::taskClock] > 0);
+  assert(report.at("addToAll 2048 vec3s (L1)").calls == 2000);
+  std::cout << "\nscoped counters ok" << std::endl;
+}
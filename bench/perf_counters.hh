@@ -0,0 +1,350 @@
+#ifndef _PERF_COUNTERS_HH_
+#define _PERF_COUNTERS_HH_
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//
+// Hardware counters for the calling thread through perf_event_open(2), so a benchmark can say
+// why it takes the time it does; an addToAll doing 0.3 instructions a cycle with an L1 miss
+// every 16 bytes is waiting on memory, one doing 3 a cycle with no misses is not.
+//
+// PerfCounters opens each counter on its own (not as a group) so one the machine doesn't have
+// doesn't take the others with it, counting user space only (which is what
+// perf_event_paranoid=2 still allows for your own threads). If the kernel multiplexes them
+// because there are more than the PMU has registers, the counts are scaled up by
+// enabled / running time, as perf stat does.
+//
+// Anything that can't be opened is reported as n/a with the reason, never as an error; no PMU
+// at all (a VM without a virtual PMU says ENOENT), a paranoid setting which forbids it
+// (EACCES / EPERM), or no perf_event_open at all (ENOSYS under seccomp). The software counters
+// (task clock, page faults, context switches) are there even when the hardware ones aren't.
+//
+// Per scope; ScopedCounters reads the thread's counters when it is made and again when it is
+// destroyed, and adds the difference to a report under its name; printCounterReport() prints
+// the lot.
+//
+
+namespace bench
+{
+
+enum class Counter
+{
+  cycles, instructions, l1dMisses, llcMisses, branchMisses, dtlbMisses,
+  taskClock, pageFaults, contextSwitches,
+  count
+};
+
+constexpr int counterCount {static_cast<int>(Counter::count)};
+
+inline const char* counterName(Counter c)
+{
+  static const char* names[counterCount] {
+    "cycles", "instructions", "l1d-misses", "llc-misses", "branch-misses", "dtlb-misses",
+    "task-clock-ns", "page-faults", "context-switches"};
+  return names[static_cast<int>(c)];
+}
+
+struct CounterValues
+{
+  double value[counterCount] {};
+  bool valid[counterCount] {};
+
+  double operator[](Counter c) const
+  { return value[static_cast<int>(c)]; }
+
+  bool has(Counter c) const
+  { return valid[static_cast<int>(c)]; }
+
+  CounterValues& operator+=(const CounterValues& other)
+  {
+    for(int i {0}; i < counterCount; ++i){
+      value[i] += other.value[i];
+      valid[i] = valid[i] || other.valid[i];
+    }
+    return *this;
+  }
+
+  CounterValues operator-(const CounterValues& other) const
+  {
+    CounterValues d = *this;
+    for(int i {0}; i < counterCount; ++i)
+      d.value[i] -= other.value[i];
+    return d;
+  }
+
+  CounterValues scaled(double by) const
+  {
+    CounterValues s = *this;
+    for(double& v : s.value)
+      v *= by;
+    return s;
+  }
+
+  //
+  // instructions per cycle, or 0 if either is missing.
+  //
+  double ipc() const
+  {
+    return has(Counter::cycles) && has(Counter::instructions) && (*this)[Counter::cycles] > 0
+         ? (*this)[Counter::instructions] / (*this)[Counter::cycles] : 0.0;
+  }
+};
+
+inline int perfEventParanoid()
+{
+  std::ifstream in {"/proc/sys/kernel/perf_event_paranoid"};
+  int level {-100};
+  in >> level;
+  return level;
+}
+
+class PerfCounters
+{
+public:
+  PerfCounters()
+  {
+    for(int i {0}; i < counterCount; ++i){
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      configure(static_cast<Counter>(i), attr);
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+      if(fd < 0)
+        _errno[i] = errno;
+      _fd[i] = static_cast<int>(fd);
+    }
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  ~PerfCounters()
+  {
+    for(int fd : _fd)
+      if(fd >= 0)
+        close(fd);
+  }
+
+  bool available(Counter c) const
+  { return _fd[static_cast<int>(c)] >= 0; }
+
+  bool anyHardware() const
+  {
+    for(int i {0}; i < static_cast<int>(Counter::taskClock); ++i)
+      if(_fd[i] >= 0)
+        return true;
+    return false;
+  }
+
+  //
+  // why a counter isn't available, "" if it is.
+  //
+  std::string reason(Counter c) const
+  {
+    int i = static_cast<int>(c);
+    if(_fd[i] >= 0)
+      return {};
+    switch(_errno[i]){
+    case ENOENT:
+    case EOPNOTSUPP:
+      return "not on this machine (no PMU, e.g. a VM without a virtual one)";
+    case EACCES:
+    case EPERM:
+      return "blocked by perf_event_paranoid=" + std::to_string(perfEventParanoid());
+    case ENOSYS:
+      return "no perf_event_open (kernel or seccomp)";
+    default:
+      return std::strerror(_errno[i]);
+    }
+  }
+
+  //
+  // running totals since the counters were opened; take the difference of two reads.
+  //
+  CounterValues read() const
+  {
+    CounterValues v;
+    for(int i {0}; i < counterCount; ++i){
+      if(_fd[i] < 0)
+        continue;
+      std::uint64_t data[3];
+      if(::read(_fd[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)))
+        continue;
+      //
+      // data = {value, time enabled, time running}; running < enabled when multiplexed.
+      //
+      v.value[i] = data[2] ? static_cast<double>(data[0]) * data[1] / data[2] : 0.0;
+      v.valid[i] = true;
+    }
+    return v;
+  }
+
+  //
+  // the calling thread's counters, opened the first time it asks.
+  //
+  static PerfCounters& forThisThread()
+  {
+    static thread_local PerfCounters counters;
+    return counters;
+  }
+
+private:
+  static void configure(Counter c, perf_event_attr& attr)
+  {
+    auto cache = [&](std::uint64_t which){
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = which | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    };
+    switch(c){
+    case Counter::cycles:
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case Counter::instructions:
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case Counter::l1dMisses:
+      cache(PERF_COUNT_HW_CACHE_L1D);
+      break;
+    case Counter::llcMisses:
+      cache(PERF_COUNT_HW_CACHE_LL);
+      break;
+    case Counter::branchMisses:
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+    case Counter::dtlbMisses:
+      cache(PERF_COUNT_HW_CACHE_DTLB);
+      break;
+    case Counter::taskClock:
+      attr.type = PERF_TYPE_SOFTWARE;
+      attr.config = PERF_COUNT_SW_TASK_CLOCK;
+      break;
+    case Counter::pageFaults:
+      attr.type = PERF_TYPE_SOFTWARE;
+      attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+      break;
+    case Counter::contextSwitches:
+      attr.type = PERF_TYPE_SOFTWARE;
+      attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+      break;
+    case Counter::count:
+      break;
+    }
+  }
+
+  int _fd[counterCount];
+  int _errno[counterCount] {};
+};
+
+//
+// prints the counters which are there, per 'per' of whatever was measured (an item, a call).
+//
+inline void printCounters(std::ostream& os, const CounterValues& v, double per = 1.0,
+                          const char *unit = "item")
+{
+  std::ios::fmtflags flags = os.flags();
+  os << std::fixed << std::setprecision(3);
+  bool first {true};
+  for(int i {0}; i < counterCount; ++i){
+    if(!v.valid[i])
+      continue;
+    os << (first ? "" : "  ") << counterName(static_cast<Counter>(i)) << " " << v.value[i] / per;
+    first = false;
+  }
+  if(v.ipc() > 0)
+    os << "  ipc " << v.ipc();
+  if(!first)
+    os << " (per " << unit << ")";
+  os.flags(flags);
+}
+
+//
+// the counters which aren't there and why, once.
+//
+inline void printUnavailable(std::ostream& os, const PerfCounters& counters)
+{
+  for(int i {0}; i < counterCount; ++i){
+    Counter c = static_cast<Counter>(i);
+    if(!counters.available(c))
+      os << "  " << counterName(c) << ": n/a, " << counters.reason(c) << std::endl;
+  }
+}
+
+struct ScopeTotals
+{
+  CounterValues values;
+  std::uint64_t calls {0};
+};
+
+inline std::map<std::string, ScopeTotals>& scopeReport(std::mutex **lock = nullptr)
+{
+  static std::mutex m;
+  static std::map<std::string, ScopeTotals> report;
+  if(lock)
+    *lock = &m;
+  return report;
+}
+
+class ScopedCounters
+{
+public:
+  explicit ScopedCounters(std::string name)
+    : _name(std::move(name)), _counters(PerfCounters::forThisThread()), _start(_counters.read())
+  {}
+
+  ScopedCounters(const ScopedCounters&) = delete;
+  ScopedCounters& operator=(const ScopedCounters&) = delete;
+
+  ~ScopedCounters()
+  {
+    CounterValues delta = _counters.read() - _start;
+    std::mutex *m;
+    auto& report = scopeReport(&m);
+    std::lock_guard<std::mutex> lock {*m};
+    ScopeTotals& t = report[_name];
+    t.values += delta;
+    ++t.calls;
+  }
+
+private:
+  std::string _name;
+  PerfCounters& _counters;
+  CounterValues _start;
+};
+
+//
+// every scope so far, per call.
+//
+inline void printCounterReport(std::ostream& os)
+{
+  std::mutex *m;
+  auto& report = scopeReport(&m);
+  std::lock_guard<std::mutex> lock {*m};
+  for(const auto& kv : report){
+    os << kv.first << " (" << kv.second.calls << " calls): ";
+    printCounters(os, kv.second.values, static_cast<double>(kv.second.calls), "call");
+    os << std::endl;
+  }
+}
+
+}
+
+#endif
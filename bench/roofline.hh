@@ -0,0 +1,334 @@
+#ifndef _ROOFLINE_HH_
+#define _ROOFLINE_HH_
+
+#include "../skinning/cache_info.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <immintrin.h>
+
+//
+// What the machine can do at best, so a kernel's time can be put next to it; Q16's addToAll
+// at 1M vec3s moves 24 bytes a vec3 (read and write 12) for 3 flops, so its limit is the
+// bandwidth of wherever 12MB lives, and once it gets near that there is nothing left to tune.
+//
+// Two probes;
+//
+//  - STREAM's four kernels (McCalpin's copy, scale, add and triad on arrays of doubles) at a
+//    working set for each cache level; half of L1, then four times the level below (well out
+//    of it) or half the level, whichever is smaller, and four times the last level for memory.
+//    Not half of a big shared L3, the part of it near one core is faster than the rest. Bytes
+//    are counted as STREAM counts them, what the kernel reads and writes, not the read for
+//    ownership of the line written; the same as the bytes a benchmark says it moves. Plus an
+//    in place update (a = q * a), which STREAM hasn't got; a kernel which writes where it
+//    read, like addToAll, doesn't pay for a read for ownership, so by that count it can go
+//    half as fast again as copy. A level's bandwidth is the best of the five.
+//  - peak single precision flops; independent chains of FMAs, as wide as the CPU has, enough
+//    of them to cover the FMA latency on every port.
+//
+// Roofline::attainableNs() is then the classic roofline; the time of an item can't be less
+// than its bytes at the bandwidth of the level its working set fits in, nor its flops at the
+// peak. Both are best cases measured on one thread, single core numbers for a single core
+// kernel.
+//
+
+namespace bench
+{
+
+struct MemoryLevel
+{
+  std::string name;               // "L1", "L2", "L3", "memory"
+  std::size_t capacity {0};       // bytes; a working set up to this is taken to be in this level
+  std::size_t probeBytes {0};     // the working set it was measured at
+  double copy {0.0}, scale {0.0}, add {0.0}, triad {0.0}, update {0.0};   // GB/s
+
+  double best() const
+  { return std::max({copy, scale, add, triad, update}); }
+};
+
+struct Roofline
+{
+  std::vector<MemoryLevel> levels;    // smallest first, memory last
+  double peakGflops {0.0};
+  std::string peakIsa;
+
+  const MemoryLevel& levelFor(std::size_t workingSetBytes) const
+  {
+    for(const MemoryLevel& l : levels)
+      if(workingSetBytes <= l.capacity)
+        return l;
+    return levels.back();
+  }
+
+  //
+  // the least time an item could take, and which of the two limits it (true for memory).
+  //
+  double attainableNs(double bytesPerItem, double flopsPerItem, std::size_t workingSetBytes,
+                      bool *memoryBound = nullptr) const
+  {
+    double memoryNs = bytesPerItem / levelFor(workingSetBytes).best();
+    double computeNs = flopsPerItem / peakGflops;
+    if(memoryBound)
+      *memoryBound = memoryNs >= computeNs;
+    return std::max(memoryNs, computeNs);
+  }
+};
+
+namespace roofline_detail
+{
+  //
+  // each STREAM kernel, kept out of line so what is timed is the loop and nothing else. n is
+  // a multiple of 8 (probe() makes it one) and they go 8 at a time, as -O2 only vectorises a
+  // loop which doesn't need a scalar tail, and STREAM is meant to be vectorised.
+  //
+  __attribute__((noinline)) inline void copy(double *__restrict c, const double *__restrict a,
+                                             std::size_t n)
+  {
+    for(std::size_t i {0}; i < n; i += 8)
+      for(std::size_t j {0}; j < 8; ++j)
+        c[i + j] = a[i + j];
+  }
+
+  __attribute__((noinline)) inline void scale(double *__restrict b, const double *__restrict c,
+                                              double q, std::size_t n)
+  {
+    for(std::size_t i {0}; i < n; i += 8)
+      for(std::size_t j {0}; j < 8; ++j)
+        b[i + j] = q * c[i + j];
+  }
+
+  __attribute__((noinline)) inline void add(double *__restrict c, const double *__restrict a,
+                                            const double *__restrict b, std::size_t n)
+  {
+    for(std::size_t i {0}; i < n; i += 8)
+      for(std::size_t j {0}; j < 8; ++j)
+        c[i + j] = a[i + j] + b[i + j];
+  }
+
+  __attribute__((noinline)) inline void triad(double *__restrict a, const double *__restrict b,
+                                              const double *__restrict c, double q, std::size_t n)
+  {
+    for(std::size_t i {0}; i < n; i += 8)
+      for(std::size_t j {0}; j < 8; ++j)
+        a[i + j] = b[i + j] + q * c[i + j];
+  }
+
+  __attribute__((noinline)) inline void update(double *__restrict a, double q, std::size_t n)
+  {
+    for(std::size_t i {0}; i < n; i += 8)
+      for(std::size_t j {0}; j < 8; ++j)
+        a[i + j] = q * a[i + j];
+  }
+
+  //
+  // best GB/s of running pass over 'bytes' enough times to take about 'seconds'.
+  //
+  template<typename F>
+  double bestGBps(double bytes, double seconds, F&& pass)
+  {
+    pass();
+    auto t0 = std::chrono::steady_clock::now();
+    pass();
+    double once = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    int repeats = std::max(1, std::min(1000, static_cast<int>(seconds / 8 / std::max(once, 1e-9))));
+    double best {1e30};
+    for(int r {0}; r < 8; ++r){
+      auto s0 = std::chrono::steady_clock::now();
+      for(int i {0}; i < repeats; ++i)
+        pass();
+      auto s1 = std::chrono::steady_clock::now();
+      best = std::min(best, std::chrono::duration<double>(s1 - s0).count() / repeats);
+    }
+    return bytes / best / 1e9;
+  }
+
+  inline MemoryLevel probe(std::string name, std::size_t capacity, std::size_t bytes,
+                           double seconds)
+  {
+    //
+    // three arrays make up the working set, as in STREAM.
+    //
+    std::size_t n = std::max<std::size_t>(bytes / 3 / sizeof(double) / 8 * 8, 64);
+    std::size_t each = (n * sizeof(double) + 63) / 64 * 64;
+    double *mem = static_cast<double*>(std::aligned_alloc(64, 3 * each));
+    if(!mem)
+      throw std::bad_alloc();
+    double *a = mem, *b = mem + each / sizeof(double), *c = mem + 2 * each / sizeof(double);
+    std::fill(a, a + n, 1.0);
+    std::fill(b, b + n, 2.0);
+    std::fill(c, c + n, 0.0);
+    const double q {3.0};
+    const double w = static_cast<double>(n * sizeof(double));
+
+    MemoryLevel l;
+    l.name = std::move(name);
+    l.capacity = capacity;
+    l.probeBytes = 3 * n * sizeof(double);
+    l.copy = bestGBps(2 * w, seconds, [&]{ copy(c, a, n); });
+    l.scale = bestGBps(2 * w, seconds, [&]{ scale(b, c, q, n); });
+    l.add = bestGBps(3 * w, seconds, [&]{ add(c, a, b, n); });
+    l.triad = bestGBps(3 * w, seconds, [&]{ triad(a, b, c, q, n); });
+    //
+    // a *= 1 so a stays as it is however many times it runs.
+    //
+    l.update = bestGBps(2 * w, seconds, [&]{ update(a, 1.0, n); });
+    std::free(mem);
+    return l;
+  }
+
+  //
+  // 'chains' FMAs in flight per step; the accumulators stay near 1 so nothing denormalises
+  // or overflows however long it runs.
+  //
+  constexpr int chains {12};
+  constexpr float mul {0.999999f}, addend {1e-6f};
+
+  __attribute__((target("avx512f"), noinline))
+  inline float fmaAvx512(std::size_t steps)
+  {
+    __m512 acc[chains];
+    for(__m512& v : acc)
+      v = _mm512_set1_ps(1.0f);
+    const __m512 m = _mm512_set1_ps(mul), a = _mm512_set1_ps(addend);
+    for(std::size_t s {0}; s < steps; ++s)
+#pragma GCC unroll 12
+      for(__m512& v : acc)
+        v = _mm512_fmadd_ps(v, m, a);
+    __m512 sum = acc[0];
+    for(int k {1}; k < chains; ++k)
+      sum = _mm512_add_ps(sum, acc[k]);
+    return _mm512_reduce_add_ps(sum);
+  }
+
+  __attribute__((target("avx2,fma"), noinline))
+  inline float fmaAvx2(std::size_t steps)
+  {
+    __m256 acc[chains];
+    for(__m256& v : acc)
+      v = _mm256_set1_ps(1.0f);
+    const __m256 m = _mm256_set1_ps(mul), a = _mm256_set1_ps(addend);
+    for(std::size_t s {0}; s < steps; ++s)
+#pragma GCC unroll 12
+      for(__m256& v : acc)
+        v = _mm256_fmadd_ps(v, m, a);
+    __m256 sum = acc[0];
+    for(int k {1}; k < chains; ++k)
+      sum = _mm256_add_ps(sum, acc[k]);
+    float out[8];
+    _mm256_storeu_ps(out, sum);
+    return out[0] + out[1] + out[2] + out[3] + out[4] + out[5] + out[6] + out[7];
+  }
+
+  __attribute__((target("sse2"), noinline))
+  inline float mulAddSse(std::size_t steps)
+  {
+    //
+    // no FMA; a multiply and an add, which is still 2 flops a lane.
+    //
+    __m128 acc[chains];
+    for(__m128& v : acc)
+      v = _mm_set1_ps(1.0f);
+    const __m128 m = _mm_set1_ps(mul), a = _mm_set1_ps(addend);
+    for(std::size_t s {0}; s < steps; ++s)
+#pragma GCC unroll 12
+      for(__m128& v : acc)
+        v = _mm_add_ps(_mm_mul_ps(v, m), a);
+    __m128 sum = acc[0];
+    for(int k {1}; k < chains; ++k)
+      sum = _mm_add_ps(sum, acc[k]);
+    float out[4];
+    _mm_storeu_ps(out, sum);
+    return out[0] + out[1] + out[2] + out[3];
+  }
+
+  //
+  // GFLOP/s of f, which does chains * lanes * 2 flops a step.
+  //
+  inline double gflops(float (*f)(std::size_t), int lanes, double seconds)
+  {
+    static volatile float sink;
+    std::size_t steps {1 << 16};
+    double best {1e30};
+    for(int r {0}; r < 8; ++r){
+      auto t0 = std::chrono::steady_clock::now();
+      sink = f(steps);
+      double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      if(t < seconds / 8){
+        steps *= 2;
+        --r;
+        continue;
+      }
+      best = std::min(best, t / steps);
+    }
+    return static_cast<double>(chains) * lanes * 2 / best / 1e9;
+  }
+}
+
+//
+// measures the machine; about 'seconds' per kernel per level, so 4 levels take 20 * seconds.
+//
+inline Roofline measureRoofline(double seconds = 0.05)
+{
+  using namespace roofline_detail;
+  Roofline r;
+  const CacheTopology& topo = cacheTopology();
+  std::size_t previous {0};
+  for(const CacheLevel& c : topo.levels){
+    std::size_t bytes = previous ? std::min(4 * previous, c.size / 2) : c.size / 2;
+    r.levels.push_back(probe("L" + std::to_string(c.level), c.size, bytes, seconds));
+    previous = c.size;
+  }
+  std::size_t memoryBytes = std::min(std::max(4 * topo.lastLevelSize(), std::size_t{64} << 20),
+                                     std::size_t{1} << 30);
+  r.levels.push_back(probe("memory", static_cast<std::size_t>(-1), memoryBytes, seconds));
+
+  if(__builtin_cpu_supports("avx512f")){
+    r.peakGflops = gflops(&fmaAvx512, 16, seconds);
+    r.peakIsa = "avx512 fma";
+  }
+  else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+    r.peakGflops = gflops(&fmaAvx2, 8, seconds);
+    r.peakIsa = "avx2 fma";
+  }
+  else{
+    r.peakGflops = gflops(&mulAddSse, 4, seconds);
+    r.peakIsa = "sse mul+add";
+  }
+  return r;
+}
+
+//
+// measured the first time it is asked for.
+//
+inline const Roofline& roofline()
+{
+  static const Roofline r = measureRoofline();
+  return r;
+}
+
+inline void printRoofline(std::ostream& os, const Roofline& r)
+{
+  std::ios::fmtflags flags = os.flags();
+  os << std::fixed << std::setprecision(1);
+  os << "  level     working set      copy     scale       add     triad    update  GB/s" << std::endl;
+  for(const MemoryLevel& l : r.levels){
+    os << "  " << std::left << std::setw(8) << l.name << std::right << std::setw(10)
+       << l.probeBytes / 1024 << "KiB" << std::setw(10) << l.copy << std::setw(10) << l.scale
+       << std::setw(10) << l.add << std::setw(10) << l.triad << std::setw(10) << l.update
+       << std::endl;
+  }
+  os << "  peak " << r.peakGflops << " GFLOP/s single precision (" << r.peakIsa << ")" << std::endl;
+  os.flags(flags);
+}
+
+}
+
+#endif
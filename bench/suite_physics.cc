@@ -0,0 +1,127 @@
+//
+// pos += vel * dt + acc * (0.5f * dt * dt) over Vec3SoAs, four ways;
+//
+//  - the expression templates from add_to_all/vec3_expr.hh, one pass.
+//  - the same by hand, one loop per stream, as the best the expression templates could do.
+//  - two addToAll style passes, pos += vel * dt then pos += acc * (0.5f * dt * dt); pos is
+//    read and written twice.
+//  - ordinary operators which each return a new array; four loops and four new arrays.
+//
+// At 1024 vec3s (all three arrays in L1), Q16's 1M and 16M (576MB in the three arrays, in
+// no cache). The roofline for the fused ones; read pos, vel and acc, write pos, 48 bytes
+// and 12 flops a vec3.
+//
+
+#include "bench.hh"
+#include "../add_to_all/vec3_expr.hh"
+
+#include <string>
+
+namespace
+{
+
+const float dt {1.0f / 60.0f};
+
+//
+// a vec3 of the fused ones, as above; the other two have no roofline.
+//
+constexpr double bytesPerVec3 {4 * sizeof(vec3)}, flopsPerVec3 {12};
+
+struct State
+{
+  Vec3SoA pos, vel, acc;
+};
+
+State& stateOf(std::size_t count)
+{
+  static State small, large, huge;
+  State& s = count <= 1024 ? small : count <= 1'000'000 ? large : huge;
+  if(s.pos.size() != count){
+    s = State {Vec3SoA {count}, Vec3SoA {count}, Vec3SoA {count}};
+    for(std::size_t i {0}; i < count; ++i){
+      s.pos.set(i, vec3{static_cast<float>(i), 0.0f, 0.0f});
+      s.vel.set(i, vec3{1.0f, 2.0f, 3.0f});
+      s.acc.set(i, vec3{0.0f, -9.8f, 0.0f});
+    }
+  }
+  return s;
+}
+
+void fused(State& s)
+{ s.pos += s.vel * dt + s.acc * (0.5f * dt * dt); }
+
+void byHand(float *__restrict p, const float *__restrict v, const float *__restrict a,
+            std::size_t padded)
+{
+  const float h {0.5f * dt * dt};
+  for(std::size_t i {0}; i < padded; i += Vec3SoA::lane)
+    for(std::size_t j {0}; j < Vec3SoA::lane; ++j)
+      p[i + j] += v[i + j] * dt + a[i + j] * h;
+}
+
+void byHand(State& s)
+{
+  std::size_t padded = (s.pos.size() + Vec3SoA::lane - 1) / Vec3SoA::lane * Vec3SoA::lane;
+  byHand(s.pos.x(), s.vel.x(), s.acc.x(), padded);
+  byHand(s.pos.y(), s.vel.y(), s.acc.y(), padded);
+  byHand(s.pos.z(), s.vel.z(), s.acc.z(), padded);
+}
+
+void twoPasses(State& s)
+{
+  s.pos += s.vel * dt;
+  s.pos += s.acc * (0.5f * dt * dt);
+}
+
+//
+// the obvious array class; every operator makes a new array and fills it.
+//
+Vec3SoA eager(const Vec3SoA& a, float k)
+{
+  Vec3SoA out {a.size()};
+  for(std::size_t i {0}; i < a.size(); ++i)
+    out.set(i, vec3{a[i].x * k, a[i].y * k, a[i].z * k});
+  return out;
+}
+
+Vec3SoA eager(const Vec3SoA& a, const Vec3SoA& b)
+{
+  Vec3SoA out {a.size()};
+  for(std::size_t i {0}; i < a.size(); ++i)
+    out.set(i, vec3{a[i].x + b[i].x, a[i].y + b[i].y, a[i].z + b[i].z});
+  return out;
+}
+
+void temporaries(State& s)
+{
+  Vec3SoA sum = eager(eager(s.vel, dt), eager(s.acc, 0.5f * dt * dt));
+  s.pos = eager(s.pos, sum);
+}
+
+bench::Register physics(const std::string& suite, const std::string& name, std::size_t count,
+                        void (*step)(State&))
+{
+  return bench::Register {suite, name, [count, step](std::size_t iterations){
+    State& s = stateOf(count);
+    for(std::size_t i {0}; i < iterations; ++i){
+      step(s);
+      bench::clobberMemory();
+    }
+  }, static_cast<double>(count), "vec3"};
+}
+
+bool registerSuite(const std::string& suite, std::size_t count)
+{
+  physics(suite, "two addToAll passes", count, &twoPasses);
+  physics(suite, "temporaries", count, &temporaries);
+  std::size_t workingSet {3 * count * sizeof(vec3)};
+  physics(suite, "expression template", count, &fused).roofline(bytesPerVec3, flopsPerVec3, workingSet);
+  physics(suite, "by hand", count, &byHand).roofline(bytesPerVec3, flopsPerVec3, workingSet);
+  return true;
+}
+
+const bool registered = registerSuite("pos += vel*dt + acc*dt^2/2, 1024 vec3s (L1)", 1024) &&
+                        registerSuite("pos += vel*dt + acc*dt^2/2, 1M vec3s", 1'000'000) &&
+                        registerSuite("pos += vel*dt + acc*dt^2/2, 16M vec3s", 16'000'000);
+
+}
@@ -0,0 +1,104 @@
+//
+// Q16's addToAll (dambuster_questions/Q16.cpp); the question's four and the kernels from
+// add_to_all/add_to_all.hh, at Q16's 1M vec3s and at a size which fits in L1.
+//
+// Each iteration adds toAdd to every vec3 once more, so the values drift upwards over a run;
+// that doesn't change the time of an add.
+//
+
+#include "bench.hh"
+#include "../add_to_all/vec3_soa.hh"
+#include "../add_to_all/add_to_all.hh"
+#include "../add_to_all/q16.hh"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const vec3 toAdd {0.5f, 0.6f, 0.7f};
+
+//
+// each vec3 is read and written once, three adds.
+//
+constexpr double bytesPerVec3 {2 * sizeof(vec3)}, flopsPerVec3 {3};
+
+std::vector<vec3>& arrayOf(std::size_t count)
+{
+  static std::vector<vec3> small, large;
+  std::vector<vec3>& a = count <= 2048 ? small : large;
+  if(a.size() != count){
+    a.resize(count);
+    for(std::size_t i {0}; i < count; ++i)
+      a[i] = vec3{static_cast<float>(i), static_cast<float>(i * 2), static_cast<float>(i * 3)};
+  }
+  return a;
+}
+
+Vec3SoA& soaOf(std::size_t count)
+{
+  static Vec3SoA small, large;
+  Vec3SoA& a = count <= 2048 ? small : large;
+  if(a.size() != count)
+    a = Vec3SoA {arrayOf(count).data(), count};
+  return a;
+}
+
+template<typename F>
+bench::Register q16(const std::string& suite, const std::string& name, std::size_t count, F f)
+{
+  return bench::Register {suite, name, [count, f](std::size_t iterations){
+    vec3 *a = arrayOf(count).data();
+    for(std::size_t i {0}; i < iterations; ++i){
+      f(a, count);
+      bench::clobberMemory();
+    }
+  }, static_cast<double>(count), "vec3"}.roofline(bytesPerVec3, flopsPerVec3, count * sizeof(vec3));
+}
+
+bench::Register soa(const std::string& suite, Isa isa, std::size_t count)
+{
+  return bench::Register {suite, std::string("SoA ") + isaName(isa), [count, isa](std::size_t iterations){
+    Vec3SoA& a = soaOf(count);
+    for(std::size_t i {0}; i < iterations; ++i){
+      addToAll(a, toAdd, isa);
+      bench::clobberMemory();
+    }
+  }, static_cast<double>(count), "vec3"}.roofline(bytesPerVec3, flopsPerVec3, count * sizeof(vec3));
+}
+
+void slow(vec3 *a, std::size_t n)
+{
+  vec3 t = toAdd;
+  bench::doNotOptimize(t);
+  addToAll_slow(a, &t, static_cast<unsigned>(n));
+}
+
+void fast1(vec3 *a, std::size_t n)
+{ addToAll_fast1(a, toAdd, static_cast<unsigned>(n)); }
+
+void fast2(vec3 *a, std::size_t n)
+{ addToAll_fast2(a, toAdd, static_cast<unsigned>(n)); }
+
+void fast3(vec3 *a, std::size_t n)
+{ addToAll_fast3(a, toAdd, static_cast<unsigned>(n)); }
+
+void aosBest(vec3 *a, std::size_t n)
+{ addToAll(a, n, toAdd); }
+
+bool registerSuite(const std::string& suite, std::size_t count)
+{
+  q16(suite, "addToAll_slow", count, &slow);
+  q16(suite, "addToAll_fast1", count, &fast1);
+  q16(suite, "addToAll_fast2", count, &fast2);
+  q16(suite, "addToAll_fast3", count, &fast3);
+  q16(suite, std::string("AoS ") + isaName(bestIsa()), count, &aosBest);
+  soa(suite, bestIsa(), count);
+  return true;
+}
+
+const bool registered = registerSuite("Q16 addToAll, 1M vec3s", 1'000'000) &&
+                        registerSuite("Q16 addToAll, 2048 vec3s (L1)", 2048);
+
+}
@@ -0,0 +1,85 @@
+//
+// Q7's foo (dambuster_questions/Q7.cpp), which counts the set bits of its argument by clearing
+// the lowest one until there are none left, against the popcount builtin and a byte table.
+// foo's time depends on how many bits are set, so it is run on random 64 bit values (32 set on
+// average) and on sparse ones (2 set on average).
+//
+
+#include "bench.hh"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+int foo(long long val)
+{
+  int n = 0;
+  while(val){
+    val &= val-1;
+    ++n;
+  }
+  return n;
+}
+
+int table8(long long val)
+{
+  static const auto table = []{
+    std::vector<unsigned char> t(256);
+    for(int i {0}; i < 256; ++i)
+      t[i] = static_cast<unsigned char>(foo(i));
+    return t;
+  }();
+  unsigned long long v = static_cast<unsigned long long>(val);
+  int n {0};
+  for(int b {0}; b < 8; ++b, v >>= 8)
+    n += table[v & 0xff];
+  return n;
+}
+
+int builtin(long long val)
+{ return __builtin_popcountll(static_cast<unsigned long long>(val)); }
+
+constexpr std::size_t values {4096};
+
+const std::vector<long long>& inputs(bool sparse)
+{
+  static const auto make = [](bool sparse){
+    std::mt19937_64 rng {7};
+    std::vector<long long> v(values);
+    for(long long& x : v)
+      x = static_cast<long long>(sparse ? rng() & rng() & rng() & rng() & rng() : rng());
+    return v;
+  };
+  static const std::vector<long long> dense = make(false), few = make(true);
+  return sparse ? few : dense;
+}
+
+template<int (*F)(long long)>
+bench::Register count(const char *suite, const char *name, bool sparse)
+{
+  return bench::Register {suite, name, [sparse](std::size_t iterations){
+    const std::vector<long long>& in = inputs(sparse);
+    for(std::size_t i {0}; i < iterations; ++i){
+      int total {0};
+      for(long long v : in)
+        total += F(v);
+      bench::doNotOptimize(total);
+    }
+  }, static_cast<double>(values), "value"};
+}
+
+bool registerSuite(const char *suite, bool sparse)
+{
+  count<foo>(suite, "foo (clear lowest bit)", sparse);
+  count<table8>(suite, "byte table", sparse);
+  count<builtin>(suite, "__builtin_popcountll", sparse);
+  return true;
+}
+
+const bool registered = registerSuite("Q7 bit count, random values", false) &&
+                        registerSuite("Q7 bit count, ~2 bits set", true);
+
+}
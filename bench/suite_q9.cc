@@ -0,0 +1,112 @@
+//
+// Q9's sorts (dambuster_questions/Q9.cpp); the question's bubbleSort template against the
+// answer's mybubble, which compares and swaps through function pointers so one instantiation
+// could serve every pointer type, and std::sort for scale. Each iteration copies the same
+// shuffled 1000 ints in and sorts them; the copy is included but is ~1000x cheaper than a
+// bubble sort.
+//
+
+#include "bench.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+template<typename T>
+void bubbleSort(T* ptr, unsigned int num)
+{
+  unsigned int change;
+  do{
+    change = 0;
+    for(int i = 0; i < num - 1; ++i){
+      if(ptr[i] > ptr[i + 1]){
+        T tmp = ptr[i];
+        ptr[i] = ptr[i + 1];
+        ptr[i + 1] = tmp;
+        change = 1;
+      }
+    }
+  }
+  while(change);
+}
+
+//
+// without the printing at the end.
+//
+template<typename T>
+void mybubble(T* ptr, unsigned int num, bool (*compare)(T* a, T *b), void (*swap)(T* a, T* b))
+{
+  bool change;
+  do{
+    change = false;
+    for(int i{0}; i < num - 1; ++i){
+      if(!compare(ptr + i, ptr + i + 1)){
+        swap(ptr + i, ptr + i + 1);
+        change = true;
+      }
+    }
+  }
+  while(change);
+}
+
+template<typename T>
+bool less_ptr(T* a, T* b)
+{ return *a < *b; }
+
+template<typename T>
+void swap_ptr(T* a, T* b)
+{
+  T tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+constexpr unsigned count {1000};
+
+const std::vector<unsigned>& input()
+{
+  static const auto in = []{
+    std::vector<unsigned> v(count);
+    for(unsigned i {0}; i < count; ++i)
+      v[i] = i;
+    std::shuffle(v.begin(), v.end(), std::mt19937 {9});
+    return v;
+  }();
+  return in;
+}
+
+template<typename Sort>
+bench::Register sort(const char *name, Sort s)
+{
+  return bench::Register {"Q9 sort 1000 shuffled unsigned ints", name, [s](std::size_t iterations){
+    std::vector<unsigned> v(count);
+    for(std::size_t i {0}; i < iterations; ++i){
+      std::memcpy(v.data(), input().data(), count * sizeof(unsigned));
+      bench::clobberMemory();
+      s(v.data());
+      assert(std::is_sorted(v.begin(), v.end()));
+      bench::doNotOptimize(v.data());
+    }
+  }, 1.0, "sort"};
+}
+
+//
+// mybubble's policies are only known at run time if they come in through a pointer the
+// compiler can't see through, which is the point of them; the volatile stops it
+// specialising the call with the pointers it can see here.
+//
+bool (*volatile compare)(unsigned*, unsigned*) = &less_ptr<unsigned>;
+void (*volatile swapper)(unsigned*, unsigned*) = &swap_ptr<unsigned>;
+
+const bool registered = (
+  sort("bubbleSort<unsigned>", [](unsigned *p){ bubbleSort<unsigned>(p, count); }),
+  sort("mybubble (policy pointers)", [](unsigned *p){ mybubble<unsigned>(p, count, compare, swapper); }),
+  sort("std::sort", [](unsigned *p){ std::sort(p, p + count); }),
+  true);
+
+}
@@ -0,0 +1,108 @@
+#ifndef _BATCH_TRAVERSAL_HH_
+#define _BATCH_TRAVERSAL_HH_
+
+#include "traversal.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+//
+// Batched walks.
+//
+// One walk is a chain of dependent loads; the child to load next is not known until the
+// current node has arrived and been decoded, so a single walk can never have more than one
+// miss in flight and the core sits idle for most of every miss. But we don't have one walk,
+// we have millions of independent ones, and the core can have 10+ misses in flight at once.
+//
+// So walk a group of queries in lockstep. Each slot in the group is one query, and a slot
+// goes through two stages per level,
+//
+//   stage 0  the node has (hopefully) arrived; read it and prefetch what the visitor needs
+//            from it (for the decode that is the message, which lives somewhere else).
+//   stage 1  the message has (hopefully) arrived; visit, pick the child, prefetch the child.
+//
+// Going round the slots doing one stage each means by the time we are back at a slot its
+// prefetch has had a whole round of other work to complete behind. When a query reaches its
+// leaf the slot is refilled with the next query straight away. This is the 'asynchronous
+// memory access chaining' (AMAC) flavour of group prefetching, Kocberber et al. 2015.
+//
+// I went with the state machine rather than C++20 coroutines; the whole state of a walk is
+// a node and a stage, so there is nothing for a coroutine frame to save us writing and the
+// switch is far cheaper than a resume.
+//
+// Visitors here need one extra hook on top of what walkPath wants,
+//
+//   void prefetch(NodeRef n) const;    // prefetch whatever operator() will read from n
+//
+// and each query gets its own visitor (it may carry per query state). Results must have room
+// for one NodeRef per query and get the node each walk ended on, same as walkPath returns.
+// batch is how many walks are in flight at once; 0 is taken as 1, one at a time.
+//
+template<typename Tree, typename Visitor>
+void walkPathsBatched(const Tree& tree, typename Tree::NodeRef root, Visitor *visitors,
+                      typename Tree::NodeRef *results, std::size_t queries,
+                      std::size_t batch, TraversalScratch& scratch)
+{
+  using NodeRef = typename Tree::NodeRef;
+  struct Slot
+  {
+    NodeRef node;
+    std::size_t query;
+    int stage;
+  };
+
+  if(!tree.valid(root) || queries == 0){
+    for(std::size_t q {0}; q < queries; ++q)
+      results[q] = root;
+    return;
+  }
+
+  batch = std::max<std::size_t>(batch, 1);
+  std::vector<Slot> slots;
+  slots.reserve(batch);
+  std::size_t next {0};
+  tree.prefetch(root);
+  while(slots.size() < batch && next < queries)
+    slots.push_back({root, next++, 0});
+
+  std::size_t active = slots.size();
+  while(active){
+    for(std::size_t s {0}; s < slots.size(); ++s){
+      Slot& slot = slots[s];
+      if(slot.stage < 0)
+        continue;
+      Visitor& v = visitors[slot.query];
+      if(slot.stage == 0){
+        v.prefetch(slot.node);
+        slot.stage = 1;
+        continue;
+      }
+
+      Branch b = v(slot.node, scratch.data());
+      NodeRef child {};
+      bool done = b == Branch::stop;
+      if(!done){
+        child = b == Branch::left ? tree.left(slot.node) : tree.right(slot.node);
+        done = !tree.valid(child);
+      }
+      if(!done){
+        tree.prefetch(child);
+        slot.node = child;
+        slot.stage = 0;
+        continue;
+      }
+
+      results[slot.query] = slot.node;
+      if(next < queries){
+        slot = Slot {root, next++, 0};
+      }
+      else{
+        slot.stage = -1;
+        --active;
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,71 @@
+//
+// Throughput of batched walks (batch_traversal.hh) against one walk at a time (walkPath) for
+// batch sizes 1 to 64, over a 4M node pointer tree and its van Emde Boas flattening.
+//
+// Every batched run checks it ends each query on the same node as walkPath did, as does a
+// batch of 0 (taken as 1) on the first thousand queries.
+//
+
+#include "secret_tree.hh"
+#include "traversal.hh"
+#include "flat_tree.hh"
+#include "batch_traversal.hh"
+#include "salted_decode.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+template<typename Tree>
+void run(const char *name, const Tree& tree, typename Tree::NodeRef root, std::size_t queries)
+{
+  using NodeRef = typename Tree::NodeRef;
+  std::mt19937_64 rng {5};
+  std::vector<u64> salts(queries);
+  for(u64& s : salts)
+    s = rng();
+
+  TraversalScratch scratch;
+  std::vector<NodeRef> expected(queries), results(queries);
+  auto t0 = std::chrono::steady_clock::now();
+  for(std::size_t q {0}; q < queries; ++q)
+    expected[q] = walkPath(tree, root, SaltedDecode<Tree>{&tree, salts[q]}, scratch);
+  auto t1 = std::chrono::steady_clock::now();
+  double single = queries / std::chrono::duration<double>(t1 - t0).count() / 1e6;
+  std::cout << name << " one at a time: " << single << " Mwalks/s" << std::endl;
+
+  std::vector<SaltedDecode<Tree>> visitors(queries);
+  //
+  // a batch of 0 is one at a time; every query still gets its result.
+  //
+  std::size_t few {std::min<std::size_t>(queries, 1000)};
+  for(std::size_t q {0}; q < few; ++q)
+    visitors[q] = SaltedDecode<Tree>{&tree, salts[q]};
+  walkPathsBatched(tree, root, visitors.data(), results.data(), few, 0, scratch);
+  assert(std::equal(results.begin(), results.begin() + few, expected.begin()));
+
+  for(std::size_t batch : {1, 2, 4, 8, 16, 32, 64}){
+    for(std::size_t q {0}; q < queries; ++q)
+      visitors[q] = SaltedDecode<Tree>{&tree, salts[q]};
+    t0 = std::chrono::steady_clock::now();
+    walkPathsBatched(tree, root, visitors.data(), results.data(), queries, batch, scratch);
+    t1 = std::chrono::steady_clock::now();
+    assert(results == expected);
+    double rate = queries / std::chrono::duration<double>(t1 - t0).count() / 1e6;
+    std::cout << name << " batch " << batch << ": " << rate << " Mwalks/s ("
+              << rate / single << "x)" << std::endl;
+  }
+}
+
+int main()
+{
+  constexpr int levels {22};
+  constexpr std::size_t queries {1'000'000};
+  SecretTree tree;
+  buildRandomTree(tree, (std::size_t{1} << levels) - 1, levels);
+  FlatTree veb = flatten(tree.root, FlatLayout::veb);
+
+  run("pointer", PointerTree{}, static_cast<const node*>(tree.root), queries);
+  run("veb", veb, veb.root(), queries);
+}
@@ -0,0 +1,158 @@
+//
+// Tests and a benchmark for the decode cache (decode_cache.hh) on Zipf distributed lookups,
+// i.e. a few (message, key) pairs come up all the time and most hardly ever.
+//
+// Two decoders; the made up xor decode from secret_tree.hh, which is so cheap it is hard for
+// any cache to beat, and a slow one standing in for a real cipher (the same output, but it
+// runs a key schedule of 256 rounds first) which is where a cache earns its keep.
+//
+// The threaded test hammers one small cache from 4 threads (so there are plenty of
+// evictions) and checks every decode against the right answer.
+//
+
+#include "secret_tree.hh"
+#include "decode_cache.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+void slowDecode(char *out, const char *message, u64 key)
+{
+  u64 k = key;
+  for(int r {0}; r < 256; ++r){
+    k += 0x9e3779b97f4a7c15ull;
+    k = (k ^ (k >> 30)) * 0xbf58476d1ce4e5b9ull;
+    k = (k ^ (k >> 27)) * 0x94d049bb133111ebull;
+  }
+  //
+  // the schedule is only for show; it goes to a volatile so the compiler has to run it but the
+  // decode itself doesn't change.
+  //
+  static thread_local volatile u64 schedule;
+  schedule = k;
+  decodeSecretMessage(out, message, key);
+}
+
+//
+// Zipf ranks 0..n-1 with exponent s, mapped to items through a shuffle so the popular items
+// are not all next to each other in memory.
+//
+std::vector<u32> zipfRequests(std::size_t items, std::size_t count, double s, u64 seed)
+{
+  std::vector<double> cdf(items);
+  double sum {0.0};
+  for(std::size_t i {0}; i < items; ++i){
+    sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+    cdf[i] = sum;
+  }
+  std::mt19937_64 rng {seed};
+  std::vector<u32> item(items);
+  for(std::size_t i {0}; i < items; ++i)
+    item[i] = static_cast<u32>(i);
+  std::shuffle(item.begin(), item.end(), rng);
+
+  std::uniform_real_distribution<double> uniform {0.0, sum};
+  std::vector<u32> requests(count);
+  for(u32& r : requests)
+    r = item[std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin()];
+  return requests;
+}
+
+//
+// shard counts which aren't a power of 2 are rounded up, as capacities are; every shard then
+// gets used and every decode is still right.
+//
+void testRounding(const SecretTree& tree, const std::vector<std::string>& expected)
+{
+  DecodeCache cache {1000, 3};
+  assert(cache.capacity() == 4 * 16 * DecodeCache::ways);
+  char out[MAX_MESSAGE_LENGTH];
+  for(int pass {0}; pass < 2; ++pass)
+    for(std::size_t i {0}; i < 256; ++i){
+      cache.decode(out, tree.nodes[i].message, tree.nodes[i].key);
+      assert(expected[i] == out);
+    }
+  DecodeCache::Stats s = cache.stats();
+  assert(s.hits + s.misses == 512 && s.hits > 0);
+  assert(DecodeCache(4096, 12).capacity() == 4096);
+}
+
+void testThreaded(const SecretTree& tree, const std::vector<std::string>& expected)
+{
+  DecodeCache cache {4096, 16};
+  std::vector<std::thread> threads;
+  for(int t {0}; t < 4; ++t)
+    threads.emplace_back([&, t]{
+      auto requests = zipfRequests(tree.nodes.size(), 500'000, 0.99, 100 + t);
+      char out[MAX_MESSAGE_LENGTH];
+      for(u32 r : requests){
+        cache.decode(out, tree.nodes[r].message, tree.nodes[r].key);
+        assert(expected[r] == out);
+      }
+    });
+  for(auto& t : threads)
+    t.join();
+  DecodeCache::Stats s = cache.stats();
+  assert(s.hits + s.misses == 4 * 500'000);
+  assert(s.evictions > 0);
+  std::cout << "4 threads, 2M decodes through a " << cache.capacity()
+            << " entry cache: all correct, hit rate " << s.hitRate() * 100 << "%, "
+            << s.evictions << " evictions" << std::endl;
+}
+
+template<typename Decode>
+void bench(const char *name, Decode decoder, const SecretTree& tree,
+           const std::vector<u32>& requests)
+{
+  char out[MAX_MESSAGE_LENGTH];
+  u64 check {0};
+  auto t0 = std::chrono::steady_clock::now();
+  for(u32 r : requests){
+    decoder(out, tree.nodes[r].message, tree.nodes[r].key);
+    check += static_cast<u8>(out[0]);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double uncached = std::chrono::duration<double, std::nano>(t1 - t0).count() / requests.size();
+  std::cout << name << " uncached: " << uncached << "ns/decode" << std::endl;
+
+  for(double fraction : {0.01, 0.1}){
+    DecodeCache cache {static_cast<std::size_t>(tree.nodes.size() * fraction)};
+    u64 cachedCheck {0};
+    t0 = std::chrono::steady_clock::now();
+    for(u32 r : requests){
+      cache.decode(out, tree.nodes[r].message, tree.nodes[r].key, decoder);
+      cachedCheck += static_cast<u8>(out[0]);
+    }
+    t1 = std::chrono::steady_clock::now();
+    assert(cachedCheck == check);
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / requests.size();
+    DecodeCache::Stats s = cache.stats();
+    std::cout << name << " cache " << cache.capacity() << " entries: " << ns << "ns/decode ("
+              << uncached / ns << "x), hit rate " << s.hitRate() * 100 << "%, hit "
+              << s.meanHitNs() << "ns, miss " << s.meanMissNs() << "ns" << std::endl;
+  }
+}
+
+int main()
+{
+  constexpr std::size_t items {1'000'000};
+  SecretTree tree;
+  buildRandomTree(tree, items, 21);
+  std::vector<std::string> expected(items);
+  for(std::size_t i {0}; i < items; ++i){
+    char temp[MAX_MESSAGE_LENGTH];
+    decodeSecretMessage(temp, tree.nodes[i].message, tree.nodes[i].key);
+    expected[i] = temp;
+  }
+  testRounding(tree, expected);
+  testThreaded(tree, expected);
+
+  auto requests = zipfRequests(items, 10'000'000, 0.99, 1);
+  bench("xor decode ", &decodeSecretMessage, tree, requests);
+  bench("slow decode", &slowDecode, tree, requests);
+}
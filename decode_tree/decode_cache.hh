@@ -0,0 +1,254 @@
+#ifndef _DECODE_CACHE_HH_
+#define _DECODE_CACHE_HH_
+
+#include "secret_tree.hh"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <immintrin.h>
+
+//
+// A bounded, thread safe memo of decodeSecretMessage.
+//
+// If the same (message, key) pairs come up over and over again across walks there is no point
+// decoding them every time. Messages never move once they are in an arena, so the message
+// address and key identify a decode.
+//
+// The cache is split into shards, each with its own mutex, so threads only contend when they
+// hash to the same shard. Each shard is set associative like a CPU cache; the hash picks a set
+// of 16 ways and the pair can only live in one of those. That keeps it bounded without any
+// index structure to maintain. Each way has a one byte fingerprint (a tag, the top byte of
+// the hash) and the 16 tags of a set are checked with one SSE compare; only ways whose tag
+// matches get their full (message, key) compared. So a miss almost never touches an entry.
+//
+// Eviction is CLOCK within the set; a hit sets the way's reference bit, and when a new entry
+// needs a way the hand goes round clearing reference bits until it finds one which was not
+// referenced since the last time round. A close approximation of LRU for a bit a way.
+//
+// Counters are per shard under the shard lock. Latency is sampled (1 in 64 lookups per
+// thread) because reading the clock costs about as much as a hit.
+//
+
+class DecodeCache
+{
+public:
+  static constexpr int ways {16};
+
+  struct Stats
+  {
+    u64 hits {0};
+    u64 misses {0};
+    u64 evictions {0};
+    u64 sampledHits {0};
+    u64 sampledHitNs {0};
+    u64 sampledMisses {0};
+    u64 sampledMissNs {0};
+
+    double hitRate() const
+    { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+
+    double meanHitNs() const
+    { return sampledHits ? static_cast<double>(sampledHitNs) / sampledHits : 0.0; }
+
+    double meanMissNs() const
+    { return sampledMisses ? static_cast<double>(sampledMissNs) / sampledMisses : 0.0; }
+  };
+
+  //
+  // capacity is in entries; it and shards are rounded up so there are a power of 2 shards
+  // each with a power of 2 sets (so picking either is a mask, not a divide).
+  //
+  explicit DecodeCache(std::size_t capacity, std::size_t shards = 64)
+    : _shards(powerOf2AtLeast(shards)), _shardMask(_shards.size() - 1)
+  {
+    std::size_t n = _shards.size();
+    _setsPerShard = powerOf2AtLeast((capacity + ways * n - 1) / (ways * n));
+    for(auto& shard : _shards)
+      shard.sets = std::make_unique<Set[]>(_setsPerShard);
+  }
+
+  std::size_t capacity() const
+  { return _shards.size() * _setsPerShard * ways; }
+
+  //
+  // decodeSecretMessage, through the cache. Decode is the function to call on a miss, so a
+  // slower decoder can be dropped in; it must have the same signature.
+  //
+  template<typename Decode = void (*)(char*, const char*, u64)>
+  void decode(char *out, const char *message, u64 key, Decode&& decoder = &decodeSecretMessage)
+  {
+    u64 h = hash(message, key);
+    Shard& shard = _shards[h & _shardMask];
+    static thread_local unsigned sampler {0};
+    bool sample = (sampler++ & 63) == 0;
+    auto t0 = sample ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+    {
+      std::lock_guard<std::mutex> lock {shard.mutex};
+      if(find(shard, h, message, key, out)){
+        ++shard.stats.hits;
+        if(sample)
+          record(shard.stats.sampledHits, shard.stats.sampledHitNs, t0);
+        return;
+      }
+      ++shard.stats.misses;
+    }
+
+    //
+    // decode outside the lock; if two threads miss on the same pair at once they both decode
+    // and both insert, which is harmless (the second finds the first's entry and updates it).
+    //
+    decoder(out, message, key);
+
+    std::lock_guard<std::mutex> lock {shard.mutex};
+    insert(shard, h, message, key, out);
+    if(sample)
+      record(shard.stats.sampledMisses, shard.stats.sampledMissNs, t0);
+  }
+
+  Stats stats()
+  {
+    Stats total;
+    for(auto& shard : _shards){
+      std::lock_guard<std::mutex> lock {shard.mutex};
+      total.hits += shard.stats.hits;
+      total.misses += shard.stats.misses;
+      total.evictions += shard.stats.evictions;
+      total.sampledHits += shard.stats.sampledHits;
+      total.sampledHitNs += shard.stats.sampledHitNs;
+      total.sampledMisses += shard.stats.sampledMisses;
+      total.sampledMissNs += shard.stats.sampledMissNs;
+    }
+    return total;
+  }
+
+private:
+  struct Entry
+  {
+    const char *message;
+    u64 key;
+    char plain[MAX_MESSAGE_LENGTH];
+  };
+
+  struct Set
+  {
+    alignas(16) u8 tags[ways] {};   // 0 = empty way
+    u16 referenced {0};             // CLOCK reference bit per way
+    u8 hand {0};
+    Entry entries[ways];
+  };
+
+  struct alignas(64) Shard
+  {
+    std::mutex mutex;
+    std::unique_ptr<Set[]> sets;
+    Stats stats;
+  };
+
+  //
+  // murmur3's 64 bit finaliser over the address and key.
+  //
+  static u64 hash(const char *message, u64 key)
+  {
+    u64 h = reinterpret_cast<std::uintptr_t>(message) ^ (key * 0x9e3779b97f4a7c15ull);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  static std::size_t powerOf2AtLeast(std::size_t n)
+  {
+    std::size_t p {1};
+    while(p < n)
+      p *= 2;
+    return p;
+  }
+
+  static u8 tagOf(u64 h)
+  {
+    u8 t = static_cast<u8>(h >> 56);
+    return t ? t : 1;
+  }
+
+  Set& setOf(Shard& shard, u64 h)
+  { return shard.sets[(h >> 8) & (_setsPerShard - 1)]; }
+
+  //
+  // bit i set if way i's tag matches.
+  //
+  static unsigned candidates(const Set& set, u8 tag)
+  {
+    __m128i tags = _mm_load_si128(reinterpret_cast<const __m128i*>(set.tags));
+    __m128i eq = _mm_cmpeq_epi8(tags, _mm_set1_epi8(static_cast<char>(tag)));
+    return static_cast<unsigned>(_mm_movemask_epi8(eq));
+  }
+
+  bool find(Shard& shard, u64 h, const char *message, u64 key, char *out)
+  {
+    Set& set = setOf(shard, h);
+    for(unsigned m = candidates(set, tagOf(h)); m; m &= m - 1){
+      int w = __builtin_ctz(m);
+      const Entry& e = set.entries[w];
+      if(e.message == message && e.key == key){
+        std::memcpy(out, e.plain, MAX_MESSAGE_LENGTH);
+        set.referenced |= static_cast<u16>(1u << w);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void insert(Shard& shard, u64 h, const char *message, u64 key, const char *plain)
+  {
+    Set& set = setOf(shard, h);
+    u8 tag = tagOf(h);
+    int way {-1};
+    for(unsigned m = candidates(set, tag); m; m &= m - 1){
+      int w = __builtin_ctz(m);
+      if(set.entries[w].message == message && set.entries[w].key == key){
+        way = w;
+        break;
+      }
+    }
+    if(way < 0){
+      unsigned empty = candidates(set, 0);
+      if(empty)
+        way = __builtin_ctz(empty);
+    }
+    if(way < 0){
+      while(set.referenced & (1u << set.hand)){
+        set.referenced &= static_cast<u16>(~(1u << set.hand));
+        set.hand = (set.hand + 1) % ways;
+      }
+      way = set.hand;
+      set.hand = (set.hand + 1) % ways;
+      ++shard.stats.evictions;
+    }
+    set.tags[way] = tag;
+    set.referenced &= static_cast<u16>(~(1u << way));
+    Entry& e = set.entries[way];
+    e.message = message;
+    e.key = key;
+    std::memcpy(e.plain, plain, MAX_MESSAGE_LENGTH);
+  }
+
+  static void record(u64& count, u64& ns, std::chrono::steady_clock::time_point t0)
+  {
+    auto t1 = std::chrono::steady_clock::now();
+    ++count;
+    ns += static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+  }
+
+  std::vector<Shard> _shards;
+  std::size_t _shardMask;
+  std::size_t _setsPerShard {1};
+};
+
+#endif
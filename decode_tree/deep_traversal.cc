@@ -0,0 +1,139 @@
+//
+// Tests for the iterative traversal engine in traversal.hh.
+//
+//  1. on small random trees walkPath ends on the same node as the recursive version from the
+//     question and traverse visits nodes in the same order a recursive depth first would.
+//
+//  2. walkPath and traverse both get to the bottom of a 10 million deep tree, on a thread
+//     with a 64KiB stack. The recursive version from the question would need ~11GB of stack
+//     for that (1104 bytes a frame, see Q14.cpp), and even the 'fixed' recursion with 80
+//     byte frames would need ~800MB; the default is 8MiB.
+//
+
+#include "secret_tree.hh"
+#include "traversal.hh"
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <pthread.h>
+
+//
+// the question's function, with the missing stop at the bottom of the tree.
+//
+const node* recurseDecodeSecretMessage(const node *n)
+{
+  char temp[MAX_MESSAGE_LENGTH];
+  decodeSecretMessage(temp, n->message, n->key);
+  const node *next = std::strcmp(temp, "Go Left") == 0 ? n->leftNode : n->rightNode;
+  return next ? recurseDecodeSecretMessage(next) : n;
+}
+
+void recursePreOrder(const node *n, std::vector<const node*>& out)
+{
+  if(!n)
+    return;
+  out.push_back(n);
+  recursePreOrder(n->leftNode, out);
+  recursePreOrder(n->rightNode, out);
+}
+
+struct Recorder
+{
+  std::vector<const node*> pre, post;
+
+  bool enter(const node *n, std::size_t)
+  {
+    pre.push_back(n);
+    return true;
+  }
+
+  void leave(const node *n, std::size_t)
+  { post.push_back(n); }
+};
+
+struct Counter
+{
+  std::size_t entered {0}, left {0};
+
+  bool enter(const node*, std::size_t)
+  {
+    ++entered;
+    return true;
+  }
+
+  void leave(const node*, std::size_t)
+  { ++left; }
+};
+
+void testSmallTrees()
+{
+  PointerTree pt;
+  TraversalScratch scratch;
+  for(u64 seed {1}; seed <= 50; ++seed){
+    SecretTree tree;
+    buildRandomTree(tree, 1 + seed * 37, seed);
+    assert(walkPath(pt, tree.root, DecodeThenBranch{}, scratch) ==
+           recurseDecodeSecretMessage(tree.root));
+
+    Recorder rec;
+    TraversalStack<const node*> stack;
+    traverse(pt, static_cast<const node*>(tree.root), rec, stack);
+    std::vector<const node*> expected;
+    recursePreOrder(tree.root, expected);
+    assert(rec.pre == expected);
+    assert(rec.post.size() == tree.nodes.size());
+    assert(rec.post.back() == tree.root);
+  }
+  std::cout << "small trees: walkPath and traverse match the recursive versions" << std::endl;
+}
+
+void* testDeepTree(void*)
+{
+  constexpr std::size_t depth {10'000'000};
+  SecretTree tree;
+  buildDeepTree(tree, depth);
+
+  PointerTree pt;
+  TraversalScratch scratch;
+  std::size_t steps {0};
+  auto t0 = std::chrono::steady_clock::now();
+  const node *last = walkPath(pt, tree.root, DecodeThenBranch{}, scratch, &steps);
+  auto t1 = std::chrono::steady_clock::now();
+  assert(steps == depth);
+  assert(last == &tree.nodes.back());
+  std::cout << "walkPath: " << steps << " levels in "
+            << std::chrono::duration<double, std::milli>(t1 - t0).count() << "ms" << std::endl;
+
+  Counter counter;
+  TraversalStack<const node*> stack;
+  t0 = std::chrono::steady_clock::now();
+  traverse(pt, static_cast<const node*>(tree.root), counter, stack);
+  t1 = std::chrono::steady_clock::now();
+  assert(counter.entered == depth && counter.left == depth);
+  assert(stack.maxDepth == depth);
+  std::cout << "traverse: " << counter.entered << " nodes, max depth " << stack.maxDepth
+            << ", " << stack.frames.capacity() * sizeof(stack.frames[0]) / (1 << 20)
+            << "MiB of heap stack, in "
+            << std::chrono::duration<double, std::milli>(t1 - t0).count() << "ms" << std::endl;
+  return nullptr;
+}
+
+int main()
+{
+  testSmallTrees();
+
+  //
+  // the deep test runs on a thread with a tiny stack to prove the point.
+  //
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 64 * 1024);
+  pthread_t thread;
+  int err = pthread_create(&thread, &attr, &testDeepTree, nullptr);
+  assert(err == 0);
+  pthread_join(thread, nullptr);
+  pthread_attr_destroy(&attr);
+  std::cout << "10M deep on a 64KiB stack: ok" << std::endl;
+}
@@ -0,0 +1,128 @@
+//
+// Tests and steps per second for the direction bit decoder (direction_decode.hh) against the
+// question's decode then strcmp.
+//
+// The tests check the decoder gives the same answer as strcmp for every message in a tree
+// full of near misses ("Go Left!", "Go Lef", "go left", "Go Leftish", ""), and the same for a
+// phrase long enough to need the 16 byte SSE compare.
+//
+
+#include "secret_tree.hh"
+#include "traversal.hh"
+#include "direction_decode.hh"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+bool decodeThenCompare(const char *message, u64 key, const char *phrase)
+{
+  char temp[MAX_MESSAGE_LENGTH];
+  decodeSecretMessage(temp, message, key);
+  return std::strcmp(temp, phrase) == 0;
+}
+
+void testMatches(const SecretTree& tree)
+{
+  DirectionDecoder decoder;
+  std::vector<const char*> messages;
+  std::vector<u64> keys;
+  for(const node& n : tree.nodes){
+    assert(decoder.matches(n.message, n.key) == decodeThenCompare(n.message, n.key, "Go Left"));
+    messages.push_back(n.message);
+    keys.push_back(n.key);
+  }
+  std::vector<u8> out(messages.size());
+  decoder.matches(messages.data(), keys.data(), messages.size(), out.data());
+  for(std::size_t i {0}; i < out.size(); ++i)
+    assert(out[i] == decoder.matches(messages[i], keys[i]));
+
+  //
+  // a 15 character phrase, all 16 bytes matter.
+  //
+  const char *phrase = "Turn Left Here!";
+  DirectionDecoder longDecoder {phrase};
+  MessageArena arena;
+  std::mt19937_64 rng {8};
+  for(const char *m : {"Turn Left Here!", "Turn Left Here", "Turn Left Here!!", "Turn Left Herf!",
+                       "turn Left Here!", "Go Left", "", "Turn Left Here! and then some"}){
+    u64 key = rng() | 1;
+    const char *enc = arena.encode(m, key);
+    assert(longDecoder.matches(enc, key) == decodeThenCompare(enc, key, phrase));
+    assert(longDecoder.matches(enc, key) == (std::strcmp(m, phrase) == 0));
+  }
+  std::cout << "direction bits match strcmp for " << tree.nodes.size()
+            << " messages (single and batch) and the 16 byte phrase" << std::endl;
+}
+
+template<typename F>
+double stepsPerSecond(std::size_t steps, F&& f)
+{
+  double best {0.0};
+  for(int r {0}; r < 3; ++r){
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto t1 = std::chrono::steady_clock::now();
+    best = std::max(best, steps / std::chrono::duration<double>(t1 - t0).count());
+  }
+  return best / 1e6;
+}
+
+int main()
+{
+  SecretTree random;
+  buildRandomTree(random, 1'000'000, 11);
+  testMatches(random);
+
+  //
+  // walks; the 10M deep tree from deep_traversal.cc, one decision per level.
+  //
+  constexpr std::size_t depth {10'000'000};
+  SecretTree deep;
+  buildDeepTree(deep, depth);
+  PointerTree pt;
+  TraversalScratch scratch;
+  DirectionDecoder decoder;
+  const node *a {nullptr}, *b {nullptr};
+  double full = stepsPerSecond(depth, [&]{
+    a = walkPath(pt, deep.root, DecodeThenBranch{}, scratch);
+  });
+  double bit = stepsPerSecond(depth, [&]{
+    b = walkPath(pt, deep.root, DirectionBitBranch{&decoder}, scratch);
+  });
+  assert(a == b);
+  std::cout << "walk, decode then strcmp: " << full << " Msteps/s" << std::endl;
+  std::cout << "walk, direction bit:      " << bit << " Msteps/s (" << bit / full << "x)"
+            << std::endl;
+
+  //
+  // batch; every node of the deep tree decided in one go.
+  //
+  std::vector<const char*> messages(depth);
+  std::vector<u64> keys(depth);
+  for(std::size_t i {0}; i < depth; ++i){
+    messages[i] = deep.nodes[i].message;
+    keys[i] = deep.nodes[i].key;
+  }
+  std::vector<u8> out(depth), ref(depth);
+  double batchFull = stepsPerSecond(depth, [&]{
+    char temp[MAX_MESSAGE_LENGTH];
+    for(std::size_t i {0}; i < depth; ++i){
+      decodeSecretMessage(temp, messages[i], keys[i]);
+      ref[i] = std::strcmp(temp, "Go Left") == 0;
+    }
+  });
+  double batchScalar = stepsPerSecond(depth, [&]{
+    for(std::size_t i {0}; i < depth; ++i)
+      out[i] = decoder.matches(messages[i], keys[i]);
+  });
+  double batchSimd = stepsPerSecond(depth, [&]{
+    decoder.matches(messages.data(), keys.data(), depth, out.data());
+  });
+  assert(out == ref);
+  std::cout << "batch, decode then strcmp: " << batchFull << " Msteps/s" << std::endl;
+  std::cout << "batch, direction bit:      " << batchScalar << " Msteps/s ("
+            << batchScalar / batchFull << "x)" << std::endl;
+  std::cout << "batch, direction bit simd: " << batchSimd << " Msteps/s ("
+            << batchSimd / batchFull << "x)" << std::endl;
+}
@@ -0,0 +1,127 @@
+#ifndef _DIRECTION_DECODE_HH_
+#define _DIRECTION_DECODE_HH_
+
+#include "secret_tree.hh"
+#include "traversal.hh"
+
+#include <cassert>
+#include <cstring>
+
+#include <immintrin.h>
+
+//
+// Decoding just the direction.
+//
+// Every step of the Q14 walk decodes the whole message into temp and then strcmp's it with
+// "Go Left", i.e. it decodes and compares every byte to get one bit out. But strcmp(temp,
+// "Go Left") == 0 only needs the first 8 bytes; if they are exactly "Go Left\0" it is a match
+// and nothing after the terminator matters, and if they are anything else it is not. With the
+// encoding from secret_tree.hh the first 8 bytes are one 64 bit word xor the key, so
+//
+//   goLeft = (load64(message) ^ key) == "Go Left\0"
+//
+// one load, one xor, one compare, no temp buffer. The decoder is general for any phrase up to
+// 15 characters; phrases which fit in 8 bytes (with the terminator) use the 64 bit compare,
+// longer ones decode the first 16 bytes with SSE and compare those. Either way nothing is
+// ever written out. This relies on encoded messages always being padded to 16 bytes.
+//
+// The batch form does 4 (AVX2) or 8 (AVX-512) messages at a time; the message words are
+// gathered from wherever the messages are, xor'd with their keys and compared in one go.
+//
+
+class DirectionDecoder
+{
+public:
+  explicit DirectionDecoder(const char *phrase = "Go Left")
+  {
+    std::size_t len = std::strlen(phrase) + 1;    // include the terminator.
+    assert(len <= 16 && "phrase too long");
+    std::memset(_target, 0, sizeof(_target));
+    std::memcpy(_target, phrase, len);
+    _len = static_cast<int>(len);
+    std::memcpy(&_target64, _target, 8);
+    _mask64 = len >= 8 ? ~u64{0} : (u64{1} << (8 * len)) - 1;
+    _target64 &= _mask64;
+    _mask16 = (1u << len) - 1;
+  }
+
+  //
+  // the same answer as strcmp(decoded, phrase) == 0.
+  //
+  bool matches(const char *message, u64 key) const
+  {
+    if(_len <= 8){
+      u64 w;
+      std::memcpy(&w, message, 8);
+      return ((w ^ key) & _mask64) == _target64;
+    }
+    __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(message));
+    __m128i k = _mm_set_epi64x(static_cast<long long>(blockKey(key, 1)),
+                               static_cast<long long>(key));
+    __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_target));
+    unsigned eq = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_xor_si128(m, k), t)));
+    return (eq & _mask16) == _mask16;
+  }
+
+  //
+  // out[i] = matches(messages[i], keys[i])
+  //
+  void matches(const char *const *messages, const u64 *keys, std::size_t n, u8 *out) const
+  {
+    std::size_t i {0};
+    if(_len <= 8){
+#if defined(__AVX512F__)
+      const __m512i target = _mm512_set1_epi64(static_cast<long long>(_target64));
+      const __m512i mask = _mm512_set1_epi64(static_cast<long long>(_mask64));
+      for(; i + 8 <= n; i += 8){
+        //
+        // a gather with a null base, so the 'indices' are the message addresses themselves.
+        //
+        __m512i ptrs = _mm512_loadu_si512(messages + i);
+        __m512i w = _mm512_i64gather_epi64(ptrs, nullptr, 1);
+        w = _mm512_xor_si512(w, _mm512_loadu_si512(keys + i));
+        __mmask8 eq = _mm512_cmpeq_epi64_mask(_mm512_and_si512(w, mask), target);
+        for(int j {0}; j < 8; ++j)
+          out[i + j] = (eq >> j) & 1;
+      }
+#elif defined(__AVX2__)
+      const __m256i target = _mm256_set1_epi64x(static_cast<long long>(_target64));
+      const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(_mask64));
+      for(; i + 4 <= n; i += 4){
+        __m256i ptrs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(messages + i));
+        __m256i w = _mm256_i64gather_epi64(static_cast<const long long*>(nullptr), ptrs, 1);
+        w = _mm256_xor_si256(w, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)));
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_and_si256(w, mask), target);
+        int bits = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        for(int j {0}; j < 4; ++j)
+          out[i + j] = (bits >> j) & 1;
+      }
+#endif
+    }
+    for(; i < n; ++i)
+      out[i] = matches(messages[i], keys[i]);
+  }
+
+private:
+  alignas(16) char _target[16];
+  u64 _target64;
+  u64 _mask64;
+  unsigned _mask16;
+  int _len;
+};
+
+//
+// walkPath visitor; the question's decode-then-branch without the decode.
+//
+struct DirectionBitBranch
+{
+  const DirectionDecoder *decoder;
+
+  void prefetch(const node *n) const
+  { __builtin_prefetch(n->message); }
+
+  Branch operator()(const node *n, char*) const
+  { return decoder->matches(n->message, n->key) ? Branch::left : Branch::right; }
+};
+
+#endif
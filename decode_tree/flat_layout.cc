@@ -0,0 +1,71 @@
+//
+// Root to leaf latency of the Q14 walk over the pointer tree and its flattened layouts
+// (flat_tree.hh) for complete trees of 1K to 16M nodes.
+//
+// The walks are salted (salted_decode.hh) so they go everywhere rather than all following
+// the one path the messages spell out.
+//
+// The pointer tree's nodes are shuffled in memory (buildRandomTree) which is what a tree
+// built up with new over a long time looks like.
+//
+
+#include "secret_tree.hh"
+#include "traversal.hh"
+#include "flat_tree.hh"
+#include "salted_decode.hh"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+//
+// ns per walk over 'queries' random walks.
+//
+template<typename Tree>
+double timeWalks(const Tree& tree, typename Tree::NodeRef root, std::size_t queries,
+                 u64& checksum)
+{
+  TraversalScratch scratch;
+  std::mt19937_64 rng {99};
+  auto t0 = std::chrono::steady_clock::now();
+  for(std::size_t q {0}; q < queries; ++q){
+    SaltedDecode<Tree> visitor {&tree, rng()};
+    auto leaf = walkPath(tree, root, visitor, scratch);
+    checksum += keyOf(tree, leaf);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / queries;
+}
+
+int main()
+{
+  PointerTree pt;
+  TraversalScratch scratch;
+  std::cout << "nodes      levels  pointer(ns/walk)  bfs(ns/walk)  veb(ns/walk)  "
+               "(ns/level: pointer bfs veb)" << std::endl;
+  for(int levels : {10, 14, 17, 20, 22, 24}){
+    std::size_t count = (std::size_t{1} << levels) - 1;
+    SecretTree tree;
+    buildRandomTree(tree, count, levels);
+    FlatTree bfs = flatten(tree.root, FlatLayout::bfs);
+    FlatTree veb = flatten(tree.root, FlatLayout::veb);
+    assert(bfs.size() == count && veb.size() == count);
+
+    //
+    // the unsalted walk must end on the same node in every layout.
+    //
+    const node *leaf = walkPath(pt, tree.root, DecodeThenBranch{}, scratch);
+    assert(bfs.key(walkPath(bfs, bfs.root(), FlatDecodeThenBranch{&bfs}, scratch)) == leaf->key);
+    assert(veb.key(walkPath(veb, veb.root(), FlatDecodeThenBranch{&veb}, scratch)) == leaf->key);
+
+    std::size_t queries = std::max<std::size_t>(200'000, count / 8);
+    u64 sums[3] {0, 0, 0};
+    double tp = timeWalks(pt, static_cast<const node*>(tree.root), queries, sums[0]);
+    double tb = timeWalks(bfs, bfs.root(), queries, sums[1]);
+    double tv = timeWalks(veb, veb.root(), queries, sums[2]);
+    assert(sums[0] == sums[1] && sums[1] == sums[2]);
+    std::cout << count << "\t" << levels << "\t" << tp << "\t\t" << tb << "\t\t" << tv
+              << "\t\t" << tp / levels << " " << tb / levels << " " << tv / levels
+              << std::endl;
+  }
+}
@@ -0,0 +1,235 @@
+#ifndef _FLAT_TREE_HH_
+#define _FLAT_TREE_HH_
+
+#include "secret_tree.hh"
+#include "traversal.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+//
+// Flattened trees.
+//
+// Every level of the Q14 walk follows a leftNode/rightNode pointer to wherever new put that
+// node, so once the tree is bigger than L2 every level is a cache miss (and past the TLB
+// reach, a page walk too). A flat tree copies the nodes into one array in an order that puts
+// nodes which are visited together next to each other,
+//
+//   bfs  level by level (for a complete tree this is the Eytzinger layout; the children of i
+//        are at 2i+1 and 2i+2). The top few levels share lines and stay hot, but the further
+//        down you get the further apart a parent and child are.
+//
+//   veb  van Emde Boas; cut the tree at half its height, lay out the top half recursively,
+//        then each of the bottom subtrees recursively. Any path of length h touches
+//        about h / log2(B) blocks whatever the block size B is, i.e. it is good for every
+//        level of the memory hierarchy at once without knowing their sizes.
+//
+// Children are 32 bit indices rather than pointers (a node is 24 bytes rather than 32) and
+// messages are copied into their own arena in the same order as the nodes, so the walk does
+// not drag message bytes through the cache when it only wants the child indices and the
+// decode does not drag node bytes through when it only wants the message.
+//
+
+enum class FlatLayout { bfs, veb };
+
+struct FlatNode
+{
+  u64 key;
+  u32 message;    // offset into the arena in 16 byte units, so the arena can reach 64GiB.
+  u32 left;
+  u32 right;
+};
+
+class FlatTree
+{
+public:
+  using NodeRef = u32;
+  static constexpr u32 null {~0u};
+
+  NodeRef left(NodeRef n) const
+  { return _nodes[n].left; }
+
+  NodeRef right(NodeRef n) const
+  { return _nodes[n].right; }
+
+  bool valid(NodeRef n) const
+  { return n != null; }
+
+  void prefetch(NodeRef n) const
+  { __builtin_prefetch(&_nodes[n]); }
+
+  NodeRef root() const
+  { return _nodes.empty() ? null : 0; }
+
+  u64 key(NodeRef n) const
+  { return _nodes[n].key; }
+
+  const char* message(NodeRef n) const
+  { return _messages.data() + std::size_t{_nodes[n].message} * 16; }
+
+  std::size_t size() const
+  { return _nodes.size(); }
+
+  std::size_t bytes() const
+  { return _nodes.size() * sizeof(FlatNode) + _messages.size(); }
+
+  friend FlatTree flatten(const node *root, FlatLayout layout);
+
+private:
+  std::vector<FlatNode> _nodes;
+  std::vector<char> _messages;
+};
+
+//
+// the question's visitor again, for flat trees.
+//
+struct FlatDecodeThenBranch
+{
+  const FlatTree *tree;
+
+  void prefetch(u32 n) const
+  { __builtin_prefetch(tree->message(n)); }
+
+  Branch operator()(u32 n, char *scratch) const
+  {
+    decodeSecretMessage(scratch, tree->message(n), tree->key(n));
+    return std::strcmp(scratch, "Go Left") == 0 ? Branch::left : Branch::right;
+  }
+};
+
+namespace flat_detail
+{
+  //
+  // every node exactly 'depth' below root, left to right. Iterative, the tree may be deep.
+  //
+  inline void collectAtDepth(const node *root, std::size_t depth,
+                             std::vector<const node*>& out,
+                             std::vector<std::pair<const node*, std::size_t>>& stack)
+  {
+    stack.clear();
+    stack.push_back({root, 0});
+    while(!stack.empty()){
+      auto [n, d] = stack.back();
+      stack.pop_back();
+      if(d == depth){
+        out.push_back(n);
+        continue;
+      }
+      if(n->rightNode)
+        stack.push_back({n->rightNode, d + 1});
+      if(n->leftNode)
+        stack.push_back({n->leftNode, d + 1});
+    }
+  }
+
+  //
+  // recursive, but only log2(height) deep; each level halves the height.
+  //
+  inline void vebOrder(const node *root, std::size_t height, std::vector<const node*>& out,
+                       std::vector<std::pair<const node*, std::size_t>>& stack)
+  {
+    if(height == 1){
+      out.push_back(root);
+      return;
+    }
+    if(height == 2){
+      out.push_back(root);
+      if(root->leftNode) out.push_back(root->leftNode);
+      if(root->rightNode) out.push_back(root->rightNode);
+      return;
+    }
+    std::size_t top = height / 2, bottom = height - top;
+    vebOrder(root, top, out, stack);
+    std::vector<const node*> roots;
+    collectAtDepth(root, top, roots, stack);
+    for(const node *r : roots)
+      vebOrder(r, bottom, out, stack);
+  }
+
+  inline std::size_t height(const node *root)
+  {
+    struct Deepest
+    {
+      std::size_t deepest {0};
+      bool enter(const node*, std::size_t depth)
+      {
+        deepest = std::max(deepest, depth + 1);
+        return true;
+      }
+      void leave(const node*, std::size_t)
+      {}
+    } visitor;
+    TraversalStack<const node*> stack;
+    traverse(PointerTree{}, root, visitor, stack);
+    return visitor.deepest;
+  }
+
+  //
+  // bytes an encoded message takes, found by decoding it to the terminator.
+  //
+  inline std::size_t encodedLength(const node *n)
+  {
+    char temp[MAX_MESSAGE_LENGTH];
+    decodeSecretMessage(temp, n->message, n->key);
+    std::size_t len = std::strlen(temp) + 1;
+    return (len + 15) / 16 * 16;
+  }
+}
+
+inline FlatTree flatten(const node *root, FlatLayout layout)
+{
+  using namespace flat_detail;
+  FlatTree tree;
+  if(!root)
+    return tree;
+
+  std::vector<const node*> order;
+  if(layout == FlatLayout::bfs){
+    order.push_back(root);
+    for(std::size_t head {0}; head < order.size(); ++head){
+      if(order[head]->leftNode) order.push_back(order[head]->leftNode);
+      if(order[head]->rightNode) order.push_back(order[head]->rightNode);
+    }
+  }
+  else{
+    std::vector<std::pair<const node*, std::size_t>> stack;
+    vebOrder(root, height(root), order, stack);
+  }
+  assert(order.size() < FlatTree::null);
+
+  //
+  // pointer -> index. A sorted array rather than a hash map, it is half the memory and for
+  // 10s of millions of nodes that matters.
+  //
+  std::vector<std::pair<const node*, u32>> index(order.size());
+  for(std::size_t i {0}; i < order.size(); ++i)
+    index[i] = {order[i], static_cast<u32>(i)};
+  std::sort(index.begin(), index.end());
+  auto find = [&](const node *n) -> u32 {
+    if(!n)
+      return FlatTree::null;
+    auto it = std::lower_bound(index.begin(), index.end(), std::make_pair(n, u32{0}));
+    return it->second;
+  };
+
+  std::size_t arenaBytes {0};
+  for(const node *n : order)
+    arenaBytes += encodedLength(n);
+  tree._messages.resize(arenaBytes);
+  tree._nodes.resize(order.size());
+  std::size_t offset {0};
+  for(std::size_t i {0}; i < order.size(); ++i){
+    const node *n = order[i];
+    std::size_t len = encodedLength(n);
+    std::memcpy(tree._messages.data() + offset, n->message, len);
+    tree._nodes[i] = FlatNode {n->key, static_cast<u32>(offset / 16), find(n->leftNode),
+                               find(n->rightNode)};
+    offset += len;
+  }
+  return tree;
+}
+
+#endif
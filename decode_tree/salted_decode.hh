@@ -0,0 +1,49 @@
+#ifndef _SALTED_DECODE_HH_
+#define _SALTED_DECODE_HH_
+
+#include "secret_tree.hh"
+#include "traversal.hh"
+#include "flat_tree.hh"
+
+#include <cstring>
+
+//
+// A visitor for benchmarking walks.
+//
+// If every walk followed the messages they would all take the same path and every layout
+// would be cache hot after the first walk. So each query has a random salt and the direction
+// at each level is the decoded direction xor'd with the next bit of the salt. Each step still
+// does the full decode and compare, the walks just go everywhere.
+//
+
+inline const char* messageOf(const PointerTree&, const node *n)
+{ return n->message; }
+
+inline u64 keyOf(const PointerTree&, const node *n)
+{ return n->key; }
+
+inline const char* messageOf(const FlatTree& t, u32 n)
+{ return t.message(n); }
+
+inline u64 keyOf(const FlatTree& t, u32 n)
+{ return t.key(n); }
+
+template<typename Tree>
+struct SaltedDecode
+{
+  const Tree *tree;
+  u64 salt;
+
+  void prefetch(typename Tree::NodeRef n) const
+  { __builtin_prefetch(messageOf(*tree, n)); }
+
+  Branch operator()(typename Tree::NodeRef n, char *scratch)
+  {
+    decodeSecretMessage(scratch, messageOf(*tree, n), keyOf(*tree, n));
+    bool left = (std::strcmp(scratch, "Go Left") == 0) != (salt & 1);
+    salt = salt >> 1 | salt << 63;
+    return left ? Branch::left : Branch::right;
+  }
+};
+
+#endif
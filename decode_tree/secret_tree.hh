@@ -0,0 +1,182 @@
+#ifndef _SECRET_TREE_HH_
+#define _SECRET_TREE_HH_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+//
+// A concrete version of the tree from the Q14 question (dambuster_questions/Q14.cpp),
+//
+//   void recurseDecodeSecretMessage(node *n)
+//   {
+//     char temp[MAX_MESSAGE_LENGTH];
+//     decodeSecreteMessage(temp, n->message, n->key);
+//     if(strcmp(temp, "Go Left") == 0)
+//       recurseDecodeSecretMessage(n->leftNode);
+//     else
+//       recurseDecodeSecretMessage(n->rightNode);
+//   }
+//
+// The question never says what the encoding is, so I have made one up; the message is
+// processed in 8 byte blocks and block j is xor'd with key * (2j + 1). Cheap, but every byte
+// still depends on the key so you cannot compare without decoding.
+//
+// Encoded messages are always padded with zeros to a multiple of 16 bytes, so a decoder is
+// allowed to read the first 16 bytes of any message without checking its length.
+//
+
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+constexpr int MAX_MESSAGE_LENGTH {64};
+
+struct node
+{
+  const char *message;
+  u64 key;
+  node *leftNode;
+  node *rightNode;
+};
+
+inline u64 blockKey(u64 key, int block)
+{ return key * (2 * static_cast<u64>(block) + 1); }
+
+//
+// decodes until (and including) the block that holds the terminating zero. out must have
+// room for MAX_MESSAGE_LENGTH bytes.
+//
+inline void decodeSecretMessage(char *out, const char *message, u64 key)
+{
+  for(int j {0}; j < MAX_MESSAGE_LENGTH / 8; ++j){
+    u64 w;
+    std::memcpy(&w, message + 8 * j, 8);
+    w ^= blockKey(key, j);
+    std::memcpy(out + 8 * j, &w, 8);
+    //
+    // the classic 'has a zero byte' bit trick.
+    //
+    if((w - 0x0101010101010101ull) & ~w & 0x8080808080808080ull)
+      return;
+  }
+  out[MAX_MESSAGE_LENGTH - 1] = '\0';
+}
+
+//
+// messages live in big blocks so millions of nodes don't mean millions of allocations, and
+// so a message never moves once a node points at it.
+//
+class MessageArena
+{
+public:
+  static constexpr std::size_t blockSize {1 << 20};
+
+  const char* encode(const char *plain, u64 key)
+  {
+    std::size_t len = std::strlen(plain) + 1;
+    std::size_t padded = (len + 15) / 16 * 16;
+    char *out = allocate(padded);
+    std::memset(out, 0, padded);
+    std::memcpy(out, plain, len);
+    for(std::size_t j {0}; j < padded / 8; ++j){
+      u64 w;
+      std::memcpy(&w, out + 8 * j, 8);
+      w ^= blockKey(key, static_cast<int>(j));
+      std::memcpy(out + 8 * j, &w, 8);
+    }
+    return out;
+  }
+
+  std::size_t bytesUsed() const
+  { return _blocks.size() * blockSize; }
+
+private:
+  char* allocate(std::size_t bytes)
+  {
+    if(_blocks.empty() || _used + bytes > blockSize){
+      _blocks.push_back(std::make_unique<char[]>(blockSize));
+      _used = 0;
+    }
+    char *p = _blocks.back().get() + _used;
+    _used += bytes;
+    return p;
+  }
+
+  std::vector<std::unique_ptr<char[]>> _blocks;
+  std::size_t _used {0};
+};
+
+//
+// The things a node might say. Only an exact "Go Left" goes left, so the near misses are
+// there to catch decoders which take shortcuts they shouldn't.
+//
+inline const char* randomMessage(bool left, std::mt19937_64& rng)
+{
+  static const char* rights[] {"Go Right", "Go Left!", "Go Lef", "go left", "Go Leftish",
+                               "", "Take the road less travelled by"};
+  if(left)
+    return "Go Left";
+  return rights[rng() % (sizeof(rights) / sizeof(rights[0]))];
+}
+
+//
+// A tree and the arena that owns its nodes and messages.
+//
+struct SecretTree
+{
+  std::vector<node> nodes;
+  MessageArena messages;
+  node *root {nullptr};
+};
+
+//
+// a path 'depth' nodes long; each node sends you down one side to the next node and the other
+// side is empty. This is the worst case for the recursive version.
+//
+inline void buildDeepTree(SecretTree& tree, std::size_t depth, u64 seed = 1)
+{
+  std::mt19937_64 rng {seed};
+  tree.nodes.assign(depth, node{});
+  for(std::size_t i {0}; i < depth; ++i){
+    bool left = rng() & 1;
+    u64 key = rng() | 1;
+    node& n = tree.nodes[i];
+    n.key = key;
+    n.message = tree.messages.encode(randomMessage(left, rng), key);
+    node *next = i + 1 < depth ? &tree.nodes[i + 1] : nullptr;
+    n.leftNode = left ? next : nullptr;
+    n.rightNode = left ? nullptr : next;
+  }
+  tree.root = depth ? &tree.nodes[0] : nullptr;
+}
+
+//
+// a complete tree with 'count' nodes, in heap order (children of i are 2i+1 and 2i+2) but the
+// nodes are shuffled in memory like they would be after a real tree had been built with new
+// over time. Each node's message is random.
+//
+inline void buildRandomTree(SecretTree& tree, std::size_t count, u64 seed = 1)
+{
+  std::mt19937_64 rng {seed};
+  std::vector<u32> where(count);
+  for(std::size_t i {0}; i < count; ++i)
+    where[i] = static_cast<u32>(i);
+  for(std::size_t i {count}; i > 1; --i)
+    std::swap(where[i - 1], where[rng() % i]);
+  tree.nodes.assign(count, node{});
+  for(std::size_t i {0}; i < count; ++i){
+    node& n = tree.nodes[where[i]];
+    n.key = rng() | 1;
+    n.message = tree.messages.encode(randomMessage(rng() & 1, rng), n.key);
+    std::size_t l = 2 * i + 1, r = 2 * i + 2;
+    n.leftNode = l < count ? &tree.nodes[where[l]] : nullptr;
+    n.rightNode = r < count ? &tree.nodes[where[r]] : nullptr;
+  }
+  tree.root = count ? &tree.nodes[where[0]] : nullptr;
+}
+
+#endif
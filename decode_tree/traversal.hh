@@ -0,0 +1,177 @@
+#ifndef _TRAVERSAL_HH_
+#define _TRAVERSAL_HH_
+
+#include "secret_tree.hh"
+
+#include <cstring>
+#include <vector>
+
+//
+// Iterative tree traversal.
+//
+// Q14.cpp found the recursive decode blows the stack because every frame carries its own
+// char temp[MAX_MESSAGE_LENGTH], and the fix it suggested (move the buffer into a called
+// function) only shrinks the frame from ~1100 to ~80 bytes; a few million levels deep and
+// it still overflows, just later. The real fix is to not recurse at all.
+//
+// For decode-then-branch there is nothing to come back to; the recursive call is the last
+// thing the function does (a tail call) so the walk is just a loop. The only state is the
+// current node and one scratch buffer which every step reuses. That is walkPath.
+//
+// For traversals which do have to come back (visit every node, post-order, ...) the call
+// stack is replaced with an explicit stack on the heap. That is traverse. It still grows
+// with depth, but by 16 bytes a level in memory we can have gigabytes of, rather than a
+// frame a level in the 8MiB the OS gave the thread.
+//
+// Both are templates on a Tree policy so the same engine walks the pointer nodes from the
+// question and the flattened layouts (flat_tree.hh). A Tree provides,
+//
+//   using NodeRef = ...;                   // something cheap to copy
+//   NodeRef left(NodeRef) const;
+//   NodeRef right(NodeRef) const;
+//   bool valid(NodeRef) const;             // false for the 'null' child
+//   void prefetch(NodeRef) const;          // start loading the node (see batch_traversal.hh)
+//
+
+struct PointerTree
+{
+  using NodeRef = const node*;
+
+  NodeRef left(NodeRef n) const
+  { return n->leftNode; }
+
+  NodeRef right(NodeRef n) const
+  { return n->rightNode; }
+
+  bool valid(NodeRef n) const
+  { return n != nullptr; }
+
+  void prefetch(NodeRef n) const
+  { __builtin_prefetch(n); }
+};
+
+enum class Branch { left, right, stop };
+
+//
+// The scratch buffer every step decodes into. One per walk, allocated once, however deep.
+//
+struct TraversalScratch
+{
+  std::vector<char> buffer = std::vector<char>(MAX_MESSAGE_LENGTH);
+
+  char* data()
+  { return buffer.data(); }
+};
+
+//
+// Walks from root, asking the visitor at each node which way to go,
+//
+//   Branch visitor(NodeRef n, char *scratch);
+//
+// until the visitor says stop or the chosen child is not there. Returns the last node
+// visited and counts the nodes visited in steps if given. Constant stack usage.
+//
+template<typename Tree, typename Visitor>
+typename Tree::NodeRef walkPath(const Tree& tree, typename Tree::NodeRef root, Visitor&& visitor,
+                                TraversalScratch& scratch, std::size_t *steps = nullptr)
+{
+  typename Tree::NodeRef n = root;
+  std::size_t count {0};
+  while(tree.valid(n)){
+    ++count;
+    Branch b = visitor(n, scratch.data());
+    if(b == Branch::stop)
+      break;
+    typename Tree::NodeRef next = b == Branch::left ? tree.left(n) : tree.right(n);
+    if(!tree.valid(next))
+      break;
+    n = next;
+  }
+  if(steps)
+    *steps = count;
+  return n;
+}
+
+//
+// The question's visitor; decode into the scratch buffer then compare.
+//
+struct DecodeThenBranch
+{
+  void prefetch(const node *n) const
+  { __builtin_prefetch(n->message); }
+
+  Branch operator()(const node *n, char *scratch) const
+  {
+    decodeSecretMessage(scratch, n->message, n->key);
+    return std::strcmp(scratch, "Go Left") == 0 ? Branch::left : Branch::right;
+  }
+};
+
+//
+// Depth first over every node with an explicit stack. The visitor gets,
+//
+//   bool enter(NodeRef n, std::size_t depth);   // return false to skip n's children
+//   void leave(NodeRef n, std::size_t depth);   // after all n's children have been left
+//
+// i.e. pre and post order in one go, left child first. The stack is kept in the
+// TraversalStack so repeated traversals reuse the memory.
+//
+template<typename NodeRef>
+struct TraversalStack
+{
+  struct Frame
+  {
+    NodeRef node;
+    std::size_t state;    // 0 = not entered, 1 = left done, 2 = right done
+  };
+
+  std::vector<Frame> frames;
+  std::size_t maxDepth {0};
+};
+
+template<typename Tree, typename Visitor>
+void traverse(const Tree& tree, typename Tree::NodeRef root, Visitor&& visitor,
+              TraversalStack<typename Tree::NodeRef>& stack)
+{
+  using NodeRef = typename Tree::NodeRef;
+  stack.frames.clear();
+  if(!tree.valid(root))
+    return;
+  stack.frames.push_back({root, 0});
+  while(!stack.frames.empty()){
+    auto& top = stack.frames.back();
+    std::size_t depth = stack.frames.size() - 1;
+    NodeRef n = top.node;
+    NodeRef child {};
+    bool descend {false};
+    switch(top.state){
+      case 0:
+        if(depth + 1 > stack.maxDepth)
+          stack.maxDepth = depth + 1;
+        if(!visitor.enter(n, depth)){
+          top.state = 2;
+          continue;
+        }
+        top.state = 1;
+        child = tree.left(n);
+        descend = tree.valid(child);
+        break;
+      case 1:
+        top.state = 2;
+        child = tree.right(n);
+        descend = tree.valid(child);
+        break;
+      default:
+        visitor.leave(n, depth);
+        stack.frames.pop_back();
+        continue;
+    }
+    //
+    // careful, push_back may reallocate so top is dead after this.
+    //
+    if(descend)
+      stack.frames.push_back({child, 0});
+  }
+}
+
+#endif
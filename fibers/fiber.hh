@@ -0,0 +1,286 @@
+#ifndef _FIBER_HH_
+#define _FIBER_HH_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+//
+// Fibers (stackful coroutines) on big, lazily committed stacks.
+//
+// Q14.cpp's answer is to rewrite the recursion so it doesn't need the stack, and
+// decode_tree/traversal.hh does that properly, but rewriting every deep recursion in a code
+// base isn't going to happen. The other way out is to give the recursion a stack big enough.
+// A thread's stack is fixed when it starts (8MiB for main by default) but a fiber's can be
+// whatever you like, and with mmap it costs nothing until it is used;
+//
+//  - the whole stack is reserved up front (MAP_NORESERVE, so not counted against overcommit),
+//    1GiB by default, but a page only gets real memory the first time it is touched, so a
+//    shallow call uses a few pages and a 1M deep recursion uses what it needs and no more.
+//  - there is a PROT_NONE guard at the bottom so running off the end is a clean SIGSEGV, not
+//    a scribble over whatever is mapped below.
+//  - the pages go back to the OS when the fiber is destroyed (or on trim()).
+//
+// Switching is a few instructions of asm (fiber_switch, below) saving the callee saved
+// registers and swapping rsp; no signal mask and no kernel, unlike swapcontext. x86-64 SysV
+// only.
+//
+// Usage; onBigStack(f) to run f to completion on a fresh fiber, or Fiber for coroutines which
+// yield() back to whoever resume()'d them.
+//
+
+class FiberStack
+{
+public:
+  static constexpr std::size_t defaultReserve {std::size_t{1} << 30};
+  static constexpr std::size_t guardBytes {64 * 1024};
+
+  explicit FiberStack(std::size_t reserve = defaultReserve)
+  {
+    std::size_t page = pageSize();
+    _size = (reserve + page - 1) / page * page + guardBytes;
+    void *p = mmap(nullptr, _size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if(p == MAP_FAILED)
+      throw std::bad_alloc();
+    _base = static_cast<char*>(p);
+    mprotect(_base, guardBytes, PROT_NONE);
+  }
+
+  FiberStack(const FiberStack&) = delete;
+  FiberStack& operator=(const FiberStack&) = delete;
+
+  ~FiberStack()
+  { munmap(_base, _size); }
+
+  //
+  // usable bounds; the stack starts at top() and grows down towards bottom().
+  //
+  char* top() const
+  { return _base + _size; }
+
+  char* bottom() const
+  { return _base + guardBytes; }
+
+  std::size_t reserved() const
+  { return _size - guardBytes; }
+
+  //
+  // bytes of the stack with real memory behind them right now.
+  //
+  std::size_t committed() const
+  {
+    std::size_t page = pageSize();
+    std::vector<unsigned char> resident(reserved() / page);
+    mincore(bottom(), reserved(), resident.data());
+    std::size_t n {0};
+    for(unsigned char r : resident)
+      n += r & 1;
+    return n * page;
+  }
+
+  //
+  // gives back the pages more than 'keep' bytes below the top. Only while nothing is running
+  // on the stack that deep, i.e. between resumes.
+  //
+  void trim(std::size_t keep = 0)
+  {
+    std::size_t page = pageSize();
+    keep = (keep + page - 1) / page * page;
+    if(keep < reserved())
+      madvise(bottom(), reserved() - keep, MADV_DONTNEED);
+  }
+
+  static std::size_t pageSize()
+  {
+    static const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return page;
+  }
+
+private:
+  char *_base {nullptr};
+  std::size_t _size {0};
+};
+
+//
+// void fiber_switch(void **save, void *next)
+//
+// pushes the callee saved registers (and the SSE/x87 control words, which the ABI also says
+// are preserved) on the current stack, stores rsp in *save, loads next as rsp and pops the
+// same from there. In a comdat section so every translation unit including this can have it.
+//
+asm(R"(
+  .pushsection .text.fiber_switch,"axG",@progbits,fiber_switch,comdat
+  .globl fiber_switch
+  .type fiber_switch, @function
+  .hidden fiber_switch
+fiber_switch:
+  pushq %rbp
+  pushq %rbx
+  pushq %r12
+  pushq %r13
+  pushq %r14
+  pushq %r15
+  subq $8, %rsp
+  stmxcsr (%rsp)
+  fnstcw 4(%rsp)
+  movq %rsp, (%rdi)
+  movq %rsi, %rsp
+  ldmxcsr (%rsp)
+  fldcw 4(%rsp)
+  addq $8, %rsp
+  popq %r15
+  popq %r14
+  popq %r13
+  popq %r12
+  popq %rbx
+  popq %rbp
+  ret
+  .size fiber_switch, .-fiber_switch
+  .popsection
+
+  .pushsection .text.fiber_start,"axG",@progbits,fiber_start,comdat
+  .globl fiber_start
+  .type fiber_start, @function
+  .hidden fiber_start
+fiber_start:
+  movq %r12, %rdi
+  callq *%r13
+  ud2
+  .size fiber_start, .-fiber_start
+  .popsection
+)");
+
+extern "C" void fiber_switch(void **save, void *next);
+extern "C" void fiber_start();
+
+class Fiber
+{
+public:
+  explicit Fiber(std::function<void()> body, std::size_t reserve = FiberStack::defaultReserve)
+    : _stack(reserve), _body(std::move(body))
+  {
+    //
+    // a frame for fiber_switch to 'return' from into fiber_start, which calls entry(this).
+    // top is 16 byte aligned so after the ret rsp is too, as it should be before a call.
+    //
+    void **sp = reinterpret_cast<void**>(_stack.top());
+    *--sp = nullptr;                                           // padding
+    *--sp = nullptr;                                           // fake return address
+    *--sp = reinterpret_cast<void*>(&fiber_start);
+    *--sp = nullptr;                                           // rbp, ends frame pointer walks
+    *--sp = nullptr;                                           // rbx
+    *--sp = this;                                              // r12, entry's argument
+    *--sp = reinterpret_cast<void*>(&entry);                   // r13
+    *--sp = nullptr;                                           // r14
+    *--sp = nullptr;                                           // r15
+    --sp;
+    std::uint32_t controls[2];
+    asm volatile("stmxcsr %0\n\tfnstcw %1" : "=m"(controls[0]), "=m"(controls[1]));
+    __builtin_memcpy(sp, controls, 8);
+    _sp = sp;
+  }
+
+  Fiber(const Fiber&) = delete;
+  Fiber& operator=(const Fiber&) = delete;
+
+  //
+  // a fiber must have finished (or never started) before it is destroyed; there is no way to
+  // unwind a suspended one.
+  //
+  ~Fiber()
+  { assert((!_started || _finished) && "destroying a suspended fiber"); }
+
+  //
+  // runs the fiber until it yields or finishes. Rethrows anything the body threw.
+  //
+  void resume()
+  {
+    assert(!_finished && "resuming a finished fiber");
+    Fiber *outer = current();
+    current() = this;
+    _started = true;
+    fiber_switch(&_caller, _sp);
+    current() = outer;
+    if(_exception)
+      std::rethrow_exception(std::exchange(_exception, nullptr));
+  }
+
+  //
+  // from inside a fiber; back to the resume() which got here.
+  //
+  static void yield()
+  {
+    Fiber *self = current();
+    assert(self && "yield outside a fiber");
+    fiber_switch(&self->_sp, self->_caller);
+  }
+
+  bool finished() const
+  { return _finished; }
+
+  FiberStack& stack()
+  { return _stack; }
+
+  static Fiber*& current()
+  {
+    static thread_local Fiber *fiber {nullptr};
+    return fiber;
+  }
+
+private:
+  static void entry(Fiber *self)
+  {
+    try{
+      self->_body();
+    }
+    catch(...){
+      self->_exception = std::current_exception();
+    }
+    self->_finished = true;
+    void *dead;
+    fiber_switch(&dead, self->_caller);
+  }
+
+  FiberStack _stack;
+  std::function<void()> _body;
+  void *_sp {nullptr};
+  void *_caller {nullptr};
+  std::exception_ptr _exception;
+  bool _started {false};
+  bool _finished {false};
+};
+
+//
+// f() on its own fiber with 'reserve' bytes of stack, to completion; for recursion that is
+// too deep for the thread's stack. f must not yield.
+//
+template<typename F>
+auto onBigStack(F&& f, std::size_t reserve = FiberStack::defaultReserve)
+{
+  using R = std::invoke_result_t<F&>;
+  if constexpr(std::is_void_v<R>){
+    Fiber fiber {[&]{ f(); }, reserve};
+    fiber.resume();
+    assert(fiber.finished() && "onBigStack body yielded");
+  }
+  else{
+    std::optional<R> result;
+    Fiber fiber {[&]{ result.emplace(f()); }, reserve};
+    fiber.resume();
+    assert(fiber.finished() && "onBigStack body yielded");
+    return std::move(*result);
+  }
+}
+
+#endif
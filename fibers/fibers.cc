@@ -0,0 +1,249 @@
+//
+// Tests and benchmarks for the fibers in fiber.hh.
+//
+//  1. the recursion from Q14.cpp with the 1KiB buffer in every frame, a million deep on a
+//     fiber; ~1GiB of stack, which the main thread's 8MiB would run out of at ~7500. Only the
+//     pages it touched are committed, and they go back afterwards.
+//  2. a shallow call on the same size of stack commits a few pages.
+//  3. yield / resume pass control back and forth in the right order, exceptions come out of
+//     resume(), and running off the bottom of the stack hits the guard (in a child process).
+//
+// Then what a switch costs against swapcontext and against handing over between two threads,
+// and what making a fiber costs.
+//
+
+#include "fiber.hh"
+
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <ucontext.h>
+
+//
+// Q14's foo_with_inline_buffer, without the printing and not a tail call.
+//
+__attribute__((noinline)) long long foo_with_inline_buffer(int depth)
+{
+  volatile char c[1024];
+  for(int i {0}; i < 1024; ++i)
+    c[i] = static_cast<char>(i);
+  if(depth == 0)
+    return c[0];
+  long long below = foo_with_inline_buffer(depth - 1);
+  asm volatile("" : "+r"(below));
+  return below + c[depth % 1024];
+}
+
+void testDeepRecursion()
+{
+  constexpr int depth {1'000'000};
+  long long result {0};
+  Fiber fiber {[&]{ result = foo_with_inline_buffer(depth); }, std::size_t{2} << 30};
+  auto t0 = std::chrono::steady_clock::now();
+  fiber.resume();
+  auto t1 = std::chrono::steady_clock::now();
+  assert(fiber.finished());
+  long long expected {0};
+  for(int d {1}; d <= depth; ++d)
+    expected += static_cast<signed char>(d % 1024);
+  assert(result == expected);
+
+  std::size_t committed = fiber.stack().committed();
+  assert(committed >= std::size_t{depth} * 1024);
+  assert(committed < fiber.stack().reserved());
+  fiber.stack().trim();
+  assert(fiber.stack().committed() == 0);
+  std::cout << depth << " deep: " << std::chrono::duration<double, std::milli>(t1 - t0).count()
+            << "ms, " << committed / (1024 * 1024) << "MiB of "
+            << fiber.stack().reserved() / (1024 * 1024) << "MiB committed ("
+            << committed / depth << " bytes a frame), 0 after trim" << std::endl;
+}
+
+void testShallow()
+{
+  Fiber fiber {[]{ foo_with_inline_buffer(2); }};
+  fiber.resume();
+  std::size_t committed = fiber.stack().committed();
+  assert(committed <= 4 * FiberStack::pageSize());
+  std::cout << "3 deep: " << committed << " bytes of " << fiber.stack().reserved() / (1024 * 1024)
+            << "MiB committed" << std::endl;
+
+  assert(onBigStack([]{ return foo_with_inline_buffer(10); }) ==
+         foo_with_inline_buffer(10));
+}
+
+void testYield()
+{
+  std::vector<int> trace;
+  Fiber fiber {[&]{
+    for(int i {0}; i < 3; ++i){
+      trace.push_back(i);
+      Fiber::yield();
+    }
+  }};
+  for(int i {0}; !fiber.finished(); ++i){
+    fiber.resume();
+    trace.push_back(100 + i);
+  }
+  assert((trace == std::vector<int>{0, 100, 1, 101, 2, 102, 103}));
+
+  //
+  // a fiber resuming another; yield goes back to the right one.
+  //
+  trace.clear();
+  Fiber inner {[&]{ trace.push_back(2); Fiber::yield(); trace.push_back(4); }};
+  Fiber outer {[&]{
+    trace.push_back(1);
+    inner.resume();
+    trace.push_back(3);
+    Fiber::yield();
+    inner.resume();
+    trace.push_back(5);
+  }};
+  outer.resume();
+  outer.resume();
+  assert(inner.finished() && outer.finished());
+  assert((trace == std::vector<int>{1, 2, 3, 4, 5}));
+
+  bool caught {false};
+  Fiber thrower {[]{ throw std::runtime_error("from the fiber"); }};
+  try{
+    thrower.resume();
+  }
+  catch(const std::runtime_error& e){
+    caught = std::string(e.what()) == "from the fiber";
+  }
+  assert(caught && thrower.finished());
+  std::cout << "yield, nested resume and exceptions ok" << std::endl;
+}
+
+void testGuard()
+{
+  pid_t child = fork();
+  if(child == 0){
+    //
+    // 1MiB of stack, ~1000 of these frames; 10000 runs it into the guard.
+    //
+    onBigStack([]{ return foo_with_inline_buffer(10'000); }, 1024 * 1024);
+    _exit(0);
+  }
+  int status {0};
+  waitpid(child, &status, 0);
+  assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+  std::cout << "overflow hits the guard: SIGSEGV" << std::endl;
+}
+
+template<typename F>
+double nsPer(std::size_t n, F&& f)
+{
+  double best {1e30};
+  for(int r {0}; r < 5; ++r){
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto t1 = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / n);
+  }
+  return best;
+}
+
+ucontext_t mainContext, ucontextFiber;
+volatile bool ucontextStop {false};
+
+void ucontextBody()
+{
+  while(!ucontextStop)
+    swapcontext(&ucontextFiber, &mainContext);
+}
+
+void benchSwitch()
+{
+  //
+  // one round trip is two switches, into the fiber and back out.
+  //
+  constexpr std::size_t trips {10'000'000};
+  bool stop {false};
+  Fiber fiber {[&]{ while(!stop) Fiber::yield(); }};
+  double fiberNs = nsPer(trips, [&]{
+    for(std::size_t i {0}; i < trips; ++i)
+      fiber.resume();
+  });
+  stop = true;
+  fiber.resume();
+
+  std::vector<char> stack(64 * 1024);
+  getcontext(&ucontextFiber);
+  ucontextFiber.uc_stack.ss_sp = stack.data();
+  ucontextFiber.uc_stack.ss_size = stack.size();
+  ucontextFiber.uc_link = &mainContext;
+  makecontext(&ucontextFiber, &ucontextBody, 0);
+  constexpr std::size_t ucontextTrips {1'000'000};
+  double ucontextNs = nsPer(ucontextTrips, [&]{
+    for(std::size_t i {0}; i < ucontextTrips; ++i)
+      swapcontext(&mainContext, &ucontextFiber);
+  });
+  ucontextStop = true;
+  swapcontext(&mainContext, &ucontextFiber);
+
+  //
+  // the same hand over between two threads; a condition variable each way.
+  //
+  constexpr std::size_t threadTrips {100'000};
+  std::mutex m;
+  std::condition_variable cv;
+  int turn {0};
+  bool done {false};
+  std::thread other {[&]{
+    std::unique_lock<std::mutex> lock {m};
+    while(true){
+      cv.wait(lock, [&]{ return turn == 1 || done; });
+      if(done)
+        return;
+      turn = 0;
+      cv.notify_one();
+    }
+  }};
+  double threadNs = nsPer(threadTrips, [&]{
+    std::unique_lock<std::mutex> lock {m};
+    for(std::size_t i {0}; i < threadTrips; ++i){
+      turn = 1;
+      cv.notify_one();
+      cv.wait(lock, [&]{ return turn == 0; });
+    }
+  });
+  {
+    std::lock_guard<std::mutex> lock {m};
+    done = true;
+  }
+  cv.notify_one();
+  other.join();
+
+  std::cout << "round trip (2 switches): fiber " << fiberNs << "ns, swapcontext " << ucontextNs
+            << "ns (" << ucontextNs / fiberNs << "x), threads " << threadNs << "ns ("
+            << threadNs / fiberNs << "x)" << std::endl;
+
+  constexpr std::size_t fibers {10'000};
+  double createNs = nsPer(fibers, [&]{
+    for(std::size_t i {0}; i < fibers; ++i){
+      Fiber f {[]{}};
+      f.resume();
+    }
+  });
+  std::cout << "create, run and destroy a fiber with 1GiB reserved: " << createNs << "ns"
+            << std::endl;
+}
+
+int main()
+{
+  testDeepRecursion();
+  testShallow();
+  testYield();
+  testGuard();
+  benchSwitch();
+}
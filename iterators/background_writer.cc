@@ -0,0 +1,200 @@
+//
+// BackgroundOutputIterator (background_writer.hh) against BufferedOutputIterator on an
+// FdWriter, which does its write(2)s itself.
+//
+// First that what is written is what FdWriter writes, with two buffers and more, with big
+// delimiters going through append, by write(2) and by io_uring, and that a write error comes
+// back as std::system_error from flush.
+//
+// Then 50M ints (315MB of text) with mycopy (mycopy.hh), the time the producer takes, and
+// how often and for how long it waited for a buffer; to /dev/null, to a new file in /tmp,
+// and to a "disk"; a pipe read by another process at a fixed rate, so write(2) waits on it
+// as it does on a real device. At 1GB/s the disk is faster than the producer (which formats
+// about 500MB/s), at 250MB/s slower.
+//
+
+#include "background_writer.hh"
+#include "buffered_output.hh"
+#include "experiment.hh"
+#include "mycopy.hh"
+
+#include <cassert>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using Submit = BackgroundWriter::Submit;
+
+void test()
+{
+  std::vector<int> ints;
+  std::mt19937 rng {49};
+  for(int i {0}; i < 20000; ++i)
+    ints.push_back(static_cast<int>(rng()) >> (rng() % 32));
+  std::string longDelimiter(100, '-');
+  std::vector<Submit> submits {Submit::write};
+  if(BackgroundWriter::uringSupported())
+    submits.push_back(Submit::uring);
+  for(const char *delimiter : {"", " ", " ## :) ## ", longDelimiter.c_str()}){
+    for(std::size_t capacity : {std::size_t{1} << 20, std::size_t{4096}, BackgroundWriter::minCapacity}){
+      std::string expected = captured([&](int fd){
+        FdWriter writer {fd, capacity};
+        mycopy(ints.begin(), ints.end(), BufferedOutputIterator<int>(writer, delimiter));
+      });
+      for(std::size_t buffers : {2, 3, 8}){
+        for(Submit submit : submits){
+          assert(captured([&](int fd){
+            BackgroundWriter writer {fd, capacity, buffers, submit};
+            assert(writer.submitting() == submit);
+            mycopy(ints.begin(), ints.end(), BackgroundOutputIterator<int>(writer, delimiter));
+          }) == expected);
+          //
+          // one at a time, through the iterator rather than mycopy's bulk write.
+          //
+          assert(captured([&](int fd){
+            BackgroundWriter writer {fd, capacity, buffers, submit};
+            BackgroundOutputIterator<int> out {writer, delimiter};
+            for(int v : ints)
+              *out++ = v;
+            writer.flush();
+          }) == expected);
+        }
+      }
+    }
+  }
+
+  for(Submit submit : submits){
+    int fd = open("/dev/null", O_RDONLY);
+    bool thrown {false};
+    try{
+      BackgroundWriter writer {fd, 4096, 2, submit};
+      mycopy(ints.begin(), ints.end(), BackgroundOutputIterator<int>(writer, " "));
+      writer.flush();
+    }
+    catch(const std::system_error& e){
+      thrown = e.code().value() == EBADF;
+    }
+    assert(thrown);
+    close(fd);
+  }
+  std::cout << "BackgroundOutputIterator writes what BufferedOutputIterator does"
+            << (BackgroundWriter::uringSupported() ? ", by write(2) and by io_uring;" : " (no io_uring here);")
+            << " write errors are thrown" << std::endl;
+}
+
+//
+// a pipe to a process which reads it at bytesPerSecond. The pipe holds 64KiB, a 16th of a
+// buffer, so a write to it returns about when the "disk" has taken it all; as a write(2)
+// does which has to wait for the device, where a page cache would take the data at once and
+// the device would be the kernel's problem.
+//
+// Each read is due to finish its bytes' time after the last finished, or after it started
+// if the disk was idle waiting for it (so idle time isn't made up afterwards), and the
+// reader sleeps until then, with the timer slack taken down from 50us so that it wakes
+// when it should.
+//
+struct Disk
+{
+  int fd;
+  pid_t reader;
+};
+
+Disk slowDisk(double bytesPerSecond)
+{
+  int fds[2];
+  pipe(fds);
+  fcntl(fds[1], F_SETPIPE_SZ, 1 << 16);
+  pid_t reader = fork();
+  if(reader == 0){
+    close(fds[1]);
+    prctl(PR_SET_TIMERSLACK, 1);
+    using Clock = std::chrono::steady_clock;
+    std::vector<char> buffer(1 << 16);
+    Clock::time_point due {Clock::now()};
+    ssize_t n;
+    while((n = read(fds[0], buffer.data(), buffer.size())) > 0){
+      Clock::time_point now {Clock::now()};
+      due = std::max(due, now) + std::chrono::duration_cast<Clock::duration>(
+                                       std::chrono::duration<double>(n / bytesPerSecond));
+      std::this_thread::sleep_until(due);
+    }
+    _exit(0);
+  }
+  close(fds[0]);
+  return {fds[1], reader};
+}
+
+template<typename Run>
+void report(const char *what, Run&& run)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  std::string stalls = run();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  std::cout << "    " << what << ": " << seconds << "s" << stalls << std::endl;
+}
+
+void benchmark(const char *to, const std::vector<int>& values, int (*open)(), void (*close)(int))
+{
+  std::cout << "  to " << to << ";" << std::endl;
+  report("FdWriter", [&]{
+    int fd = open();
+    {
+      FdWriter writer {fd};
+      mycopy(values.begin(), values.end(), BufferedOutputIterator<int>(writer, " "));
+      writer.flush();
+    }
+    close(fd);
+    return std::string();
+  });
+  for(Submit submit : {Submit::write, Submit::uring}){
+    if(submit == Submit::uring && !BackgroundWriter::uringSupported())
+      continue;
+    report(submit == Submit::uring ? "BackgroundWriter, io_uring" : "BackgroundWriter, write(2)", [&]{
+      int fd = open();
+      std::string stalls;
+      {
+        BackgroundWriter writer {fd, BackgroundWriter::defaultCapacity, 2, submit};
+        mycopy(values.begin(), values.end(), BackgroundOutputIterator<int>(writer, " "));
+        writer.flush();
+        stalls = ", " + std::to_string(writer.stalls()) + " stalls, " + std::to_string(writer.stalledSeconds()) +
+                 "s stalled";
+      }
+      close(fd);
+      return stalls;
+    });
+  }
+}
+
+Disk disk;
+
+int main()
+{
+  std::signal(SIGPIPE, SIG_IGN);
+  test();
+  std::vector<int> values(50'000'000);
+  std::mt19937 rng {2};
+  for(auto& v : values)
+    v = static_cast<int>(rng()) >> (rng() % 32);
+  std::cout << "mycopy of " << values.size() / 1'000'000 << "M ints, 1MiB buffers;" << std::endl;
+  benchmark("/dev/null", values, []{ return ::open("/dev/null", O_WRONLY); }, [](int fd){ ::close(fd); });
+  benchmark("a new file in /tmp", values,
+            []{ return ::open("/tmp/background_writer.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644); },
+            [](int fd){
+              ::close(fd);
+              std::remove("/tmp/background_writer.txt");
+            });
+  benchmark("a 1GB/s disk", values, []{ disk = slowDisk(1e9); return disk.fd; },
+            [](int fd){ ::close(fd); waitpid(disk.reader, nullptr, 0); });
+  benchmark("a 250MB/s disk", values, []{ disk = slowDisk(250e6); return disk.fd; },
+            [](int fd){ ::close(fd); waitpid(disk.reader, nullptr, 0); });
+}
@@ -0,0 +1,413 @@
+#ifndef _BACKGROUND_WRITER_HH_
+#define _BACKGROUND_WRITER_HH_
+
+#include "buffered_output.hh"
+#include "spsc_queue.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//
+// FdWriter (buffered_output.hh) with the write(2)s taken off the producing thread. There are
+// a few buffers (two by default); the producer formats into one while a writer thread of the
+// BackgroundWriter's own writes out the others, so the producer only waits when every other
+// buffer is still waiting to be written; when it has outrun the descriptor. With FdWriter
+// (and ostream_iterator, as 2.output_it.cpp's fwriter) it waits for every write.
+//
+// Full buffers go to the writer thread through one SpscQueue (spsc_queue.hh) and come back
+// written through another, each with an Event for the side which has run out to sleep on.
+// The writer thread writes with write(2), or, asked for with Submit::uring and where the
+// kernel has it, io_uring (raw system calls; there is no liburing here), a write submitted
+// and waited for in one io_uring_enter. Either way the writes are in order, one at a time.
+//
+// The writer thread needs the CPU for a moment each time it wakes, to start the next write;
+// if it has to wait for the producer's time slice to run out, the descriptor sits idle. It
+// asks for short slices (see shortSlices) so that it runs when it wakes.
+//
+// The interface is FdWriter's, so BufferedOutputIterator writes to one; that's
+// BackgroundOutputIterator below. flush() waits until everything is written. A write error
+// stops the writing (what is after it is dropped) and is thrown as std::system_error from
+// the producer's next reserve, append or flush that has to wait for a buffer, or from flush.
+// The destructor flushes, swallowing errors, and stops the thread.
+//
+
+namespace background_detail
+{
+  //
+  // struct sched_attr, which glibc only has from 2.41.
+  //
+  struct SchedAttr
+  {
+    std::uint32_t size;
+    std::uint32_t policy;
+    std::uint64_t flags;
+    std::int32_t nice;
+    std::uint32_t priority;
+    std::uint64_t runtime;
+    std::uint64_t deadline;
+    std::uint64_t period;
+  };
+
+  //
+  // The calling thread asks for 100us slices (sched_setattr's sched_runtime, for a normal
+  // thread, EEVDF kernels from 6.12; ignored before). The scheduler picks the runnable thread
+  // with the earliest virtual deadline, which is the start plus the slice, so a thread with a
+  // short slice preempts a busy one as soon as it wakes rather than waiting for the busy
+  // one's slice to run out. It needs no privilege and takes no more CPU; it's for threads
+  // which wake, do a little, and sleep again.
+  //
+  inline void shortSlices()
+  {
+    SchedAttr attr {};
+    attr.size = sizeof attr;
+    attr.policy = SCHED_OTHER;
+    attr.runtime = 100'000;
+    syscall(SYS_sched_setattr, 0, &attr, 0);
+  }
+
+  inline int uringSetup(unsigned entries, io_uring_params *params)
+  { return static_cast<int>(syscall(__NR_io_uring_setup, entries, params)); }
+
+  inline int uringEnter(int ring, unsigned submit, unsigned wait, unsigned flags)
+  { return static_cast<int>(syscall(__NR_io_uring_enter, ring, submit, wait, flags, nullptr, 0)); }
+
+  //
+  // an io_uring with one write at a time in it; the submission queue ring, its entries and
+  // the completion queue ring mapped from the kernel, as liburing would. open() is null if
+  // there's no io_uring (an old kernel, or turned off with io_uring_disabled, or seccomp),
+  // or it can't write at the file position (IORING_FEAT_RW_CUR_POS, 5.6).
+  //
+  class Uring
+  {
+  public:
+    static std::unique_ptr<Uring> open()
+    {
+      std::unique_ptr<Uring> uring {new Uring};
+      io_uring_params params {};
+      uring->_ring = uringSetup(2, &params);
+      if(uring->_ring < 0 || !(params.features & IORING_FEAT_RW_CUR_POS))
+        return nullptr;
+      uring->_sqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      uring->_cqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      uring->_sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+      uring->_sq = uring->map(uring->_sqBytes, IORING_OFF_SQ_RING);
+      uring->_cq = uring->map(uring->_cqBytes, IORING_OFF_CQ_RING);
+      uring->_sqes = static_cast<io_uring_sqe*>(uring->map(uring->_sqesBytes, IORING_OFF_SQES));
+      if(!uring->_sq || !uring->_cq || !uring->_sqes)
+        return nullptr;
+      char *sq = static_cast<char*>(uring->_sq), *cq = static_cast<char*>(uring->_cq);
+      uring->_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+      uring->_sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+      uring->_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+      uring->_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+      uring->_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+      uring->_cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+      uring->_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+      return uring;
+    }
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    ~Uring()
+    {
+      if(_sqes)
+        munmap(_sqes, _sqesBytes);
+      if(_cq)
+        munmap(_cq, _cqBytes);
+      if(_sq)
+        munmap(_sq, _sqBytes);
+      if(_ring >= 0)
+        close(_ring);
+    }
+
+    //
+    // as write(2), at the file position; bytes written, or -errno.
+    //
+    long write(int fd, const char *data, std::size_t n)
+    {
+      unsigned tail = *_sqTail, index = tail & *_sqMask;
+      io_uring_sqe& sqe = _sqes[index];
+      std::memset(&sqe, 0, sizeof sqe);
+      sqe.opcode = IORING_OP_WRITE;
+      sqe.fd = fd;
+      sqe.addr = reinterpret_cast<std::uintptr_t>(data);
+      sqe.len = static_cast<std::uint32_t>(std::min<std::size_t>(n, 1u << 30));
+      sqe.off = ~std::uint64_t{0};
+      _sqArray[index] = index;
+      __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+      unsigned submit {1};
+      for(;;){
+        unsigned head = *_cqHead;
+        if(head != __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)){
+          long result = _cqes[head & *_cqMask].res;
+          __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+          return result;
+        }
+        int submitted = uringEnter(_ring, submit, 1, IORING_ENTER_GETEVENTS);
+        if(submitted < 0 && errno != EINTR)
+          return -errno;
+        if(submitted > 0)
+          submit = 0;
+      }
+    }
+
+  private:
+    Uring() = default;
+
+    void* map(std::size_t bytes, off_t what)
+    {
+      void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, what);
+      return p == MAP_FAILED ? nullptr : p;
+    }
+
+    int _ring {-1};
+    void *_sq {nullptr};
+    void *_cq {nullptr};
+    io_uring_sqe *_sqes {nullptr};
+    std::size_t _sqBytes {0};
+    std::size_t _cqBytes {0};
+    std::size_t _sqesBytes {0};
+    unsigned *_sqTail {nullptr};
+    unsigned *_sqMask {nullptr};
+    unsigned *_sqArray {nullptr};
+    unsigned *_cqHead {nullptr};
+    unsigned *_cqTail {nullptr};
+    unsigned *_cqMask {nullptr};
+    io_uring_cqe *_cqes {nullptr};
+  };
+}
+
+class BackgroundWriter
+{
+public:
+  static constexpr std::size_t defaultCapacity {FdWriter::defaultCapacity};
+  static constexpr std::size_t minCapacity {FdWriter::minCapacity};
+
+  enum class Submit {write, uring};
+
+  static bool uringSupported()
+  {
+    static const bool supported {background_detail::Uring::open() != nullptr};
+    return supported;
+  }
+
+  //
+  // capacity is of each buffer; at least two buffers.
+  //
+  explicit BackgroundWriter(int fd, std::size_t capacity = defaultCapacity, std::size_t buffers = 2,
+                            Submit submit = Submit::write)
+    : _fd(fd), _capacity(std::max(capacity, minCapacity)), _buffers(std::max<std::size_t>(buffers, 2)),
+      _storage(new char[_capacity * _buffers]), _full(_buffers + 1), _written(_buffers)
+  {
+    if(submit == Submit::uring)
+      _uring = background_detail::Uring::open();
+    for(std::size_t b {_buffers - 1}; b > 0; --b)
+      _free.push_back(static_cast<std::uint32_t>(b));
+    _thread = std::thread {[this]{ writeOut(); }};
+  }
+
+  BackgroundWriter(const BackgroundWriter&) = delete;
+  BackgroundWriter& operator=(const BackgroundWriter&) = delete;
+
+  ~BackgroundWriter()
+  {
+    try{
+      flush();
+    }
+    catch(const std::system_error&){
+    }
+    _full.push(Job{0, stop});
+    _fullEvent.notify();
+    _thread.join();
+  }
+
+  int fd() const
+  { return _fd; }
+
+  std::size_t capacity() const
+  { return _capacity; }
+
+  Submit submitting() const
+  { return _uring ? Submit::uring : Submit::write; }
+
+  //
+  // how many times, and for how long in all, the producer has waited for a buffer.
+  //
+  std::size_t stalls() const
+  { return _stalls; }
+
+  double stalledSeconds() const
+  { return _stalled.count(); }
+
+  char* reserve(std::size_t n)
+  {
+    if(_capacity - _used < n)
+      handOff();
+    return buffer(_current) + _used;
+  }
+
+  void commit(std::size_t n)
+  { _used += n; }
+
+  //
+  // bigger than a buffer goes through the buffers a buffer at a time, to stay in order with
+  // what's before and after it.
+  //
+  void append(const char *data, std::size_t n)
+  {
+    while(n){
+      if(_used == _capacity)
+        handOff();
+      std::size_t piece {std::min(n, _capacity - _used)};
+      std::memcpy(buffer(_current) + _used, data, piece);
+      _used += piece;
+      data += piece;
+      n -= piece;
+    }
+  }
+
+  void flush()
+  {
+    if(_used)
+      handOff();
+    while(_outstanding)
+      takeWritten();
+    throwIfFailed();
+  }
+
+private:
+  static constexpr std::size_t stop {~std::size_t{0}};
+
+  struct Job
+  {
+    std::uint32_t index;
+    std::size_t bytes;
+  };
+
+  char* buffer(std::uint32_t index)
+  { return _storage.get() + index * _capacity; }
+
+  //
+  // the current buffer to the writer thread, and another to go on with.
+  //
+  void handOff()
+  {
+    _full.push(Job{_current, _used});
+    _fullEvent.notify();
+    ++_outstanding;
+    while(_free.empty())
+      takeWritten();
+    _current = _free.back();
+    _free.pop_back();
+    _used = 0;
+    throwIfFailed();
+  }
+
+  //
+  // a buffer back from the writer thread, waiting for it if none is back yet; a stall.
+  //
+  void takeWritten()
+  {
+    std::uint32_t index;
+    if(!_written.pop(index)){
+      ++_stalls;
+      auto t0 = std::chrono::steady_clock::now();
+      for(;;){
+        std::uint32_t seen = _writtenEvent.count();
+        if(_written.pop(index))
+          break;
+        _writtenEvent.wait(seen);
+      }
+      _stalled += std::chrono::steady_clock::now() - t0;
+    }
+    _free.push_back(index);
+    --_outstanding;
+  }
+
+  void throwIfFailed()
+  {
+    if(int error = _error.load(std::memory_order_acquire))
+      throw std::system_error(error, std::generic_category(), "write");
+  }
+
+  //
+  // the writer thread.
+  //
+  void writeOut()
+  {
+    background_detail::shortSlices();
+    for(;;){
+      Job job;
+      for(;;){
+        std::uint32_t seen = _fullEvent.count();
+        if(_full.pop(job))
+          break;
+        _fullEvent.wait(seen);
+      }
+      if(job.bytes == stop)
+        return;
+      if(!_error.load(std::memory_order_relaxed))
+        writeAll(buffer(job.index), job.bytes);
+      _written.push(job.index);
+      _writtenEvent.notify();
+    }
+  }
+
+  void writeAll(const char *data, std::size_t n)
+  {
+    while(n){
+      long written = _uring ? _uring->write(_fd, data, n) : ::write(_fd, data, n);
+      if(written < 0){
+        int error = _uring ? static_cast<int>(-written) : errno;
+        if(error == EINTR)
+          continue;
+        _error.store(error, std::memory_order_release);
+        return;
+      }
+      data += written;
+      n -= written;
+    }
+  }
+
+  int _fd;
+  std::size_t _capacity;
+  std::size_t _buffers;
+  std::unique_ptr<char[]> _storage;
+  std::unique_ptr<background_detail::Uring> _uring;
+
+  // the producer's
+  std::uint32_t _current {0};
+  std::size_t _used {0};
+  std::vector<std::uint32_t> _free;
+  std::size_t _outstanding {0};
+  std::size_t _stalls {0};
+  std::chrono::duration<double> _stalled {0};
+
+  SpscQueue<Job> _full;
+  Event _fullEvent;
+  SpscQueue<std::uint32_t> _written;
+  Event _writtenEvent;
+  std::atomic<int> _error {0};
+  std::thread _thread;
+};
+
+template<typename T>
+using BackgroundOutputIterator = BufferedOutputIterator<T, BackgroundWriter>;
+
+#endif
@@ -0,0 +1,122 @@
+//
+// BufferedOutputIterator (buffered_output.hh) against std::ostream_iterator.
+//
+// First that it writes exactly what ostream_iterator writes for integers, whatever the buffer
+// size (down to a buffer that flushes on nearly every value) and however long the delimiter,
+// and that floats read back as the same float.
+//
+// Then 2.output_it.cpp's mycopy (elementCopy, experiment.hh) of 100M ints to a file, with
+// each; ints per second and MB/s. The file is in /tmp, so the write(2)s go to the page cache
+// and the time is the formatting and the copies, not the disk; the same again to /dev/null
+// takes the page cache out too.
+//
+
+#include "buffered_output.hh"
+#include "experiment.hh"
+
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+template<typename T>
+std::string viaOstream(const std::vector<T>& values, const char *delimiter)
+{
+  std::ostringstream os;
+  elementCopy(values.begin(), values.end(), std::ostream_iterator<T>(os, delimiter));
+  return os.str();
+}
+
+template<typename T>
+std::string viaBuffered(const std::vector<T>& values, const char *delimiter, std::size_t capacity)
+{
+  return captured([&](int fd){
+    FdWriter writer {fd, capacity};
+    elementCopy(values.begin(), values.end(), BufferedOutputIterator<T>(writer, delimiter));
+  });
+}
+
+void test()
+{
+  std::vector<int> ints {0, 1, -1, 9, 10, 99, 100, -100, INT_MAX, INT_MIN, 12345, -98765};
+  std::mt19937 rng {45};
+  for(int i {0}; i < 10000; ++i)
+    ints.push_back(static_cast<int>(rng()) >> (rng() % 32));
+  std::vector<long long> longs {LLONG_MAX, LLONG_MIN, 0, -1};
+  std::vector<unsigned> unsigneds {0, UINT_MAX, 4000000000u};
+  std::string longDelimiter(100, '-');
+  for(const char *delimiter : {"", " ", " < ", " ## :) ## ", "\n", longDelimiter.c_str()}){
+    for(std::size_t capacity : {std::size_t{1} << 20, std::size_t{4096}, FdWriter::minCapacity}){
+      assert(viaBuffered(ints, delimiter, capacity) == viaOstream(ints, delimiter));
+      assert(viaBuffered(longs, delimiter, capacity) == viaOstream(longs, delimiter));
+      assert(viaBuffered(unsigneds, delimiter, capacity) == viaOstream(unsigneds, delimiter));
+    }
+  }
+
+  std::vector<double> doubles {0.0, -0.0, 0.1, 1.0 / 3, 1e300, -2.5e-310, 3.141592653589793, 1e6};
+  for(int i {0}; i < 10000; ++i)
+    doubles.push_back(std::ldexp(static_cast<double>(rng()) - 2e9, static_cast<int>(rng() % 200) - 100));
+  std::istringstream in {viaBuffered(doubles, " ", 4096)};
+  for(double d : doubles){
+    double back;
+    in >> back;
+    assert(back == d);
+  }
+  std::cout << "BufferedOutputIterator writes what ostream_iterator does, at any buffer size;"
+            << " doubles read back the same" << std::endl;
+}
+
+void benchmark(const char *path, const std::vector<int>& values)
+{
+  auto report = [&](const char *what, auto&& run){
+    auto t0 = std::chrono::steady_clock::now();
+    run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::ifstream written {path, std::ios::ate | std::ios::binary};
+    double bytes = std::string(path) == "/dev/null" ? 0 : static_cast<double>(written.tellg());
+    std::cout << "  " << what << ": " << seconds << "s, " << values.size() / seconds / 1e6
+              << "M ints/s";
+    if(bytes)
+      std::cout << ", " << bytes / seconds / 1e6 << "MB/s (" << bytes / 1e6 << "MB)";
+    std::cout << std::endl;
+  };
+  std::cout << "mycopy of " << values.size() / 1'000'000 << "M ints to " << path << ";" << std::endl;
+  report("ostream_iterator", [&]{
+    std::ofstream ofs {path};
+    elementCopy(values.begin(), values.end(), std::ostream_iterator<int>(ofs, " "));
+  });
+  report("BufferedOutputIterator", [&]{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    {
+      FdWriter writer {fd};
+      elementCopy(values.begin(), values.end(), BufferedOutputIterator<int>(writer, " "));
+    }
+    close(fd);
+  });
+}
+
+int main()
+{
+  test();
+  //
+  // mixed lengths, 1 to 10 digits and signs, as dumped data would be.
+  //
+  std::vector<int> values(100'000'000);
+  std::mt19937 rng {2};
+  for(auto& v : values)
+    v = static_cast<int>(rng()) >> (rng() % 32);
+  benchmark("/tmp/buffered_output.txt", values);
+  benchmark("/dev/null", values);
+  std::remove("/tmp/buffered_output.txt");
+}
@@ -0,0 +1,286 @@
+#ifndef _BUFFERED_OUTPUT_HH_
+#define _BUFFERED_OUTPUT_HH_
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+
+#include <unistd.h>
+
+//
+// An output iterator with std::ostream_iterator's contract (*it = v; ++it; writes v and then
+// the delimiter) for dumping big collections to a file descriptor quickly.
+//
+// ostream_iterator does os << v for every element; that constructs a sentry (which checks
+// and flushes tied streams), goes through the locale's num_put facet, and writes into the
+// streambuf a piece at a time, for each int. Here a value is formatted straight into a big
+// private buffer with no locale and no state (integers two digits at a time from a table,
+// floats with std::to_chars, the shortest digits that read back the same), the delimiter is
+// memcpy'd after it, and when the buffer is full it goes out in one write(2). Nothing else
+// touches the data on its way to the kernel.
+//
+// FdWriter is the buffer; the iterators are a pointer to it and the delimiter, so, as with
+// ostream_iterator and its stream, all copies of an iterator write to the same place. (The
+// iterator's Writer parameter takes anything with FdWriter's capacity, reserve, commit and
+// append; background_writer.hh's BackgroundWriter is another.) FdWriter doesn't own the
+// descriptor. What is buffered goes when it fills, on flush(), and when the
+// FdWriter is destroyed; write errors throw std::system_error, except from the destructor,
+// which can't (call flush() first if they matter).
+//
+// The output is the same as ostream_iterator's on a stream with the "C" locale and default
+// flags, for integers; floats are shortest round trip where ostream uses 6 significant
+// digits, so those differ (3.1415927 against 3.14159).
+//
+
+class FdWriter
+{
+public:
+  static constexpr std::size_t defaultCapacity {std::size_t{1} << 20};
+
+  //
+  // enough for any one number, formatted; see maxChars below.
+  //
+  static constexpr std::size_t minCapacity {64};
+
+  explicit FdWriter(int fd, std::size_t capacity = defaultCapacity)
+    : _fd(fd), _capacity(std::max(capacity, minCapacity)), _buffer(new char[_capacity])
+  {}
+
+  FdWriter(const FdWriter&) = delete;
+  FdWriter& operator=(const FdWriter&) = delete;
+
+  ~FdWriter()
+  {
+    try{
+      flush();
+    }
+    catch(const std::system_error&){
+    }
+  }
+
+  int fd() const
+  { return _fd; }
+
+  std::size_t capacity() const
+  { return _capacity; }
+
+  //
+  // room for at least n more bytes (n no more than the capacity), flushing to make it; write
+  // up to n bytes at the pointer returned and then commit() how many were written.
+  //
+  char* reserve(std::size_t n)
+  {
+    if(_capacity - _used < n)
+      flush();
+    return _buffer.get() + _used;
+  }
+
+  void commit(std::size_t n)
+  { _used += n; }
+
+  void append(const char *data, std::size_t n)
+  {
+    if(_capacity - _used < n){
+      flush();
+      //
+      // no point copying something as big as the buffer into it; it would go straight out.
+      //
+      if(n >= _capacity){
+        writeAll(data, n);
+        return;
+      }
+    }
+    std::memcpy(_buffer.get() + _used, data, n);
+    _used += n;
+  }
+
+  void flush()
+  {
+    std::size_t used = _used;
+    _used = 0;
+    writeAll(_buffer.get(), used);
+  }
+
+private:
+  void writeAll(const char *data, std::size_t n)
+  {
+    while(n){
+      ssize_t written = ::write(_fd, data, n);
+      if(written < 0){
+        if(errno == EINTR)
+          continue;
+        throw std::system_error(errno, std::generic_category(), "write");
+      }
+      data += written;
+      n -= written;
+    }
+  }
+
+  int _fd;
+  std::size_t _capacity;
+  std::unique_ptr<char[]> _buffer;
+  std::size_t _used {0};
+};
+
+//
+// how to write a T as text; numbers, but not the character types (or bool), which an ostream
+// writes as characters. formatted(buffer, value) writes the text at buffer and returns its
+// end; it may scribble on up to maxChars<T> bytes from buffer.
+//
+template<typename T>
+constexpr bool formattable = std::is_arithmetic_v<T> && !std::is_same_v<T, bool> &&
+                             !std::is_same_v<T, char> && !std::is_same_v<T, signed char> &&
+                             !std::is_same_v<T, unsigned char> && !std::is_same_v<T, wchar_t> &&
+                             !std::is_same_v<T, char16_t> && !std::is_same_v<T, char32_t>;
+
+namespace format_detail
+{
+  inline constexpr char pairs[] {
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899"};
+
+  //
+  // the digits of the biggest U, and how many bytes writing them may touch; U is uint32_t or
+  // uint64_t.
+  //
+  template<typename U>
+  constexpr std::size_t digits {std::numeric_limits<U>::digits10 + 1};
+
+  template<typename U>
+  constexpr std::size_t span {(digits<U> + 7) / 8 * 8};
+
+  template<typename U>
+  struct Powers
+  {
+    U value[digits<U>] {};
+
+    constexpr Powers()
+    {
+      U p {1};
+      for(std::size_t k {0}; k < digits<U>; ++k, p *= 10)
+        value[k] = p;
+    }
+  };
+
+  template<typename U>
+  constexpr Powers<U> powers {};
+
+  //
+  // All the digits of the biggest U, two at a time from a table, right aligned in a scratch
+  // buffer, and then the last n of them copied out as a block of span<U> bytes (which is
+  // why maxChars allows for more than the digits). No branch depends on the value, so mixed
+  // lengths cost the same as one length; std::to_chars's loops stop as soon as they can,
+  // which is quicker for one length and slower, mispredicting, for a mix.
+  //
+  template<typename U>
+  char* formatUnsigned(char *at, U v)
+  {
+    std::size_t n {1};
+    for(std::size_t k {1}; k < digits<U>; ++k)
+      n += v >= powers<U>.value[k];
+    char scratch[digits<U> + span<U>];
+    for(std::size_t k {0}; k < digits<U> / 2; ++k){
+      std::memcpy(scratch + digits<U> - 2 * k - 2, pairs + 2 * (v % 100), 2);
+      v /= 100;
+    }
+    std::memcpy(at, scratch + digits<U> - n, span<U>);
+    return at + n;
+  }
+
+  template<typename T>
+  using Unsigned = std::conditional_t<sizeof(T) <= 4, std::uint32_t, std::uint64_t>;
+}
+
+//
+// integers are a sign and then the digits, written as a block (see formatUnsigned); floating
+// point is the shortest round trip, at most 21 significant digits (long double), a sign, a
+// point and an exponent.
+//
+template<typename T>
+constexpr std::size_t maxChars {std::is_integral_v<T> ? 1 + format_detail::span<format_detail::Unsigned<T>> : 32};
+
+template<typename T>
+std::enable_if_t<formattable<T> && std::is_integral_v<T>, char*> formatted(char *at, T value)
+{
+  using U = format_detail::Unsigned<T>;
+  U v = static_cast<U>(value);
+  if constexpr(std::is_signed_v<T>){
+    *at = '-';
+    at += value < 0;
+    v = value < 0 ? U{0} - v : v;
+  }
+  return format_detail::formatUnsigned(at, v);
+}
+
+template<typename T>
+std::enable_if_t<formattable<T> && std::is_floating_point_v<T>, char*> formatted(char *at, T value)
+{ return std::to_chars(at, at + maxChars<T>, value).ptr; }
+
+template<typename T, typename Writer = FdWriter>
+class BufferedOutputIterator
+{
+public:
+  using iterator_category = std::output_iterator_tag;
+  using value_type = void;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = void;
+
+  static_assert(formattable<T>, "BufferedOutputIterator writes integers and floating point");
+
+  explicit BufferedOutputIterator(Writer& writer, const char *delimiter = "")
+    : _writer(&writer), _delimiter(delimiter),
+      _together(_delimiter.size() + maxChars<T> <= writer.capacity())
+  {}
+
+  BufferedOutputIterator& operator=(const T& value)
+  {
+    //
+    // the value and the delimiter in one reserve() unless the delimiter is too big for that.
+    //
+    if(_together){
+      char *start = _writer->reserve(maxChars<T> + _delimiter.size());
+      char *end = formatted(start, value);
+      std::memcpy(end, _delimiter.data(), _delimiter.size());
+      _writer->commit(end - start + _delimiter.size());
+    }
+    else{
+      char *start = _writer->reserve(maxChars<T>);
+      _writer->commit(formatted(start, value) - start);
+      _writer->append(_delimiter.data(), _delimiter.size());
+    }
+    return *this;
+  }
+
+  BufferedOutputIterator& operator*()
+  { return *this; }
+
+  BufferedOutputIterator& operator++()
+  { return *this; }
+
+  BufferedOutputIterator& operator++(int)
+  { return *this; }
+
+  Writer& writer() const
+  { return *_writer; }
+
+  std::string_view delimiter() const
+  { return _delimiter; }
+
+private:
+  Writer *_writer;
+  std::string_view _delimiter;
+  bool _together;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _EXPERIMENT_HH_
+#define _EXPERIMENT_HH_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//
+// What the iterators programs share.
+//
+
+//
+// mycopy from 2.output_it.cpp, one element at a time through whatever the iterators are; the
+// loop everything in mycopy.hh is measured against (and its GenericTag path).
+//
+template<typename InputIterator, typename OutputIterator>
+OutputIterator elementCopy(InputIterator from_pos,
+                           InputIterator from_end,
+                           OutputIterator to_pos)
+{
+  while(from_pos != from_end)
+    *to_pos++ = *from_pos++;
+  return to_pos;
+}
+
+//
+// everything written to a temporary file, read back.
+//
+template<typename F>
+std::string captured(F&& write)
+{
+  std::FILE *file = std::tmpfile();
+  int fd = fileno(file);
+  write(fd);
+  std::string text(lseek(fd, 0, SEEK_END), '\0');
+  pread(fd, text.data(), text.size(), 0);
+  std::fclose(file);
+  return text;
+}
+
+//
+// this program run again in a process of its own, with argv, and with stdin the file at path;
+// or if piped, a pipe which another process feeds from the file, so the reader can't map it
+// or know how long it is. Things which must be done before any I/O (sync_with_stdio) or
+// measured for the process alone (peak RSS) are done this way. True if it exits with 0.
+//
+inline bool rerunOn(const char *path, bool piped, const std::vector<std::string>& argv)
+{
+  pid_t child = fork();
+  if(child == 0){
+    int file = open(path, O_RDONLY);
+    if(piped){
+      int fds[2];
+      pipe(fds);
+      if(fork() == 0){
+        close(fds[0]);
+        std::vector<char> buffer(1 << 20);
+        ssize_t n;
+        while((n = read(file, buffer.data(), buffer.size())) > 0)
+          for(ssize_t done {0}; done < n; ){
+            ssize_t w = write(fds[1], buffer.data() + done, n - done);
+            if(w < 0)
+              _exit(0);
+            done += w;
+          }
+        _exit(0);
+      }
+      close(fds[1]);
+      dup2(fds[0], 0);
+      close(fds[0]);
+    }
+    else
+      dup2(file, 0);
+    close(file);
+    std::vector<char*> args;
+    for(const std::string& a : argv)
+      args.push_back(const_cast<char*>(a.c_str()));
+    args.push_back(nullptr);
+    execv("/proc/self/exe", args.data());
+    _exit(127);
+  }
+  int status;
+  waitpid(child, &status, 0);
+  while(waitpid(-1, nullptr, WNOHANG) > 0){
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+#endif
@@ -0,0 +1,307 @@
+//
+// lazy_range.hh's adaptors, and a pipeline of them against 3.input_it.cpp's way of reading
+// everything into a vector first.
+//
+// First that each adaptor, and compositions of them, give what a hand-written loop does over
+// a vector, and that over a stream take and chunk leave the stream where they should.
+//
+// Then ints from stdin (about 1GB of text, one a line) through
+//
+//   filter (not a multiple of 3) | transform (/ 16) | chunk<4> | transform (sum of the chunk)
+//
+// to /dev/null with BufferedOutputIterator, time and peak RSS (VmHWM), in processes of their
+// own;
+//
+//  - lazy; the pipeline straight over MappedInputIterator.
+//  - materialised; the ints read into a std::vector first, as 3.input_it.cpp does, and then
+//    the same pipeline over the vector.
+//  - loop; the same written out by hand as one loop, for what the adaptors cost.
+//
+// and then the same with | take(1000) on the end. stdin is a pipe, so InputBuffer reads
+// through its 1MiB buffer; a mapped file would put its pages in the RSS of all of them.
+//
+
+#include "buffered_output.hh"
+#include "experiment.hh"
+#include "lazy_range.hh"
+#include "mapped_input.hh"
+#include "mycopy.hh"
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+template<typename R>
+auto collected(const R& r)
+{
+  std::vector<typename std::iterator_traits<typename R::iterator>::value_type> out;
+  mycopy(r.begin(), r.end(), std::back_inserter(out));
+  return out;
+}
+
+template<std::size_t N>
+std::vector<int> chunkSums(const std::vector<int>& in)
+{
+  std::vector<int> sums;
+  for(std::size_t i {0}; i < in.size(); i += N){
+    int s {0};
+    for(std::size_t j {i}; j < in.size() && j < i + N; ++j)
+      s += in[j];
+    sums.push_back(s);
+  }
+  return sums;
+}
+
+void test()
+{
+  auto odd = [](int v){ return v % 2 != 0; };
+  auto squared = [](int v){ return v * v; };
+  auto sum = [](const auto& chunk){
+    int s {0};
+    for(int v : chunk)
+      s += v;
+    return s;
+  };
+
+  for(int n : {0, 1, 2, 7, 8, 9, 100}){
+    std::vector<int> values;
+    for(int i {0}; i < n; ++i)
+      values.push_back(i * 7 % 11);
+    std::vector<int> odds, squares;
+    for(int v : values){
+      if(odd(v))
+        odds.push_back(v);
+      squares.push_back(squared(v));
+    }
+
+    assert(collected(lazy::range(values)) == values);
+    assert(collected(lazy::range(values) | lazy::filter(odd)) == odds);
+    assert(collected(lazy::range(values) | lazy::transform(squared)) == squares);
+    for(std::size_t k : {0, 1, 5, 200}){
+      std::vector<int> first(values.begin(), values.begin() + std::min<std::size_t>(k, n));
+      assert(collected(lazy::range(values) | lazy::take(k)) == first);
+    }
+    assert(collected(lazy::range(values) | lazy::chunk<1>() | lazy::transform(sum)) == values);
+    assert(collected(lazy::range(values) | lazy::chunk<3>() | lazy::transform(sum)) == chunkSums<3>(values));
+    assert(collected(lazy::range(values) | lazy::chunk<8>() | lazy::transform(sum)) == chunkSums<8>(values));
+
+    std::vector<int> composed {chunkSums<2>(odds)};
+    for(auto& v : composed)
+      v = squared(v);
+    composed.resize(std::min<std::size_t>(composed.size(), 4));
+    assert(collected(lazy::range(values) | lazy::filter(odd) | lazy::chunk<2>() | lazy::transform(sum) |
+                     lazy::transform(squared) | lazy::take(4)) == composed);
+  }
+
+  //
+  // over a stream; what take and chunk leave unread is still there.
+  //
+  {
+    std::istringstream in {"1 2 3 4 5 6 7 8 9 10"};
+    auto r = lazy::range(std::istream_iterator<int>(in), std::istream_iterator<int>()) | lazy::take(3);
+    assert(collected(r) == (std::vector<int> {1, 2, 3}));
+    int next;
+    in >> next;
+    assert(next == 4);
+  }
+  {
+    std::istringstream in {"1 2 3 4 5 6 7 8 9 10"};
+    auto r = lazy::range(std::istream_iterator<int>(in), std::istream_iterator<int>()) | lazy::chunk<2>() |
+             lazy::transform(sum) | lazy::take(2);
+    assert(collected(r) == (std::vector<int> {3, 7}));
+    int next;
+    in >> next;
+    assert(next == 5);
+  }
+
+  //
+  // MappedInputIterator to BufferedOutputIterator, as in the benchmark.
+  //
+  std::FILE *file = std::tmpfile();
+  std::fputs("5 -3 12 7\n 8 9 -21 4 100", file);
+  std::rewind(file);
+  std::string text;
+  {
+    InputBuffer input {fileno(file)};
+    std::FILE *out = std::tmpfile();
+    {
+      FdWriter writer {fileno(out)};
+      auto r = lazy::range(MappedInputIterator<int>(input), MappedInputIterator<int>()) |
+               lazy::filter([](int v){ return v > 0; }) | lazy::transform([](int v){ return v * 10; });
+      mycopy(r.begin(), r.end(), BufferedOutputIterator<int>(writer, ","));
+    }
+    text.resize(lseek(fileno(out), 0, SEEK_END));
+    pread(fileno(out), text.data(), text.size(), 0);
+    std::fclose(out);
+  }
+  std::fclose(file);
+  assert(text == "50,120,70,80,90,40,1000,");
+  std::cout << "the adaptors give what hand-written loops do; take and chunk read no further than they must"
+            << std::endl;
+}
+
+//
+// the benchmark's pipeline; a running checksum of what comes out, to check every way gives
+// the same.
+//
+constexpr std::size_t taken {1000};
+
+struct Checksum
+{
+  unsigned long long value {0};
+
+  void add(long long s)
+  { value = value * 31 + static_cast<unsigned long long>(s); }
+};
+
+template<typename R>
+auto stages(R source, Checksum& checksum)
+{
+  return std::move(source) | lazy::filter([](int v){ return v % 3 != 0; }) |
+         lazy::transform([](int v){ return v / 16; }) | lazy::chunk<4>() |
+         lazy::transform([&checksum](const auto& chunk){
+           long long s {0};
+           for(int v : chunk)
+             s += v;
+           checksum.add(s);
+           return s;
+         });
+}
+
+template<typename R>
+void written(const R& r, FdWriter& writer)
+{ mycopy(r.begin(), r.end(), BufferedOutputIterator<long long>(writer, "\n")); }
+
+long long peakKiB()
+{
+  std::ifstream status {"/proc/self/status"};
+  std::string line;
+  while(std::getline(status, line))
+    if(line.compare(0, 6, "VmHWM:") == 0)
+      return std::atoll(line.c_str() + 6);
+  return 0;
+}
+
+//
+// run in a process of its own; stdin is a pipe from the file.
+//
+int runner(const std::string& mode, unsigned long long expected)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  bool take {mode.size() > 5 && mode.compare(mode.size() - 5, 5, "-take") == 0};
+  std::string how {take ? mode.substr(0, mode.size() - 5) : mode};
+  Checksum checksum;
+  {
+    int out = open("/dev/null", O_WRONLY);
+    FdWriter writer {out};
+    InputBuffer input {0};
+    auto source = lazy::range(MappedInputIterator<int>(input), MappedInputIterator<int>());
+    if(how == "lazy"){
+      if(take)
+        written(stages(source, checksum) | lazy::take(taken), writer);
+      else
+        written(stages(source, checksum), writer);
+    }
+    else if(how == "materialised"){
+      std::vector<int> idata {};
+      for(int v : source)
+        idata.push_back(v);
+      if(take)
+        written(stages(lazy::range(idata), checksum) | lazy::take(taken), writer);
+      else
+        written(stages(lazy::range(idata), checksum), writer);
+    }
+    else{
+      BufferedOutputIterator<long long> to {writer, "\n"};
+      long long s {0};
+      std::size_t inChunk {0}, count {0}, most {take ? taken : ~std::size_t{0}};
+      for(auto it = source.begin(), end = source.end(); it != end && count < most; ++it){
+        if(*it % 3 == 0)
+          continue;
+        s += *it / 16;
+        if(++inChunk == 4){
+          checksum.add(s);
+          *to++ = s;
+          s = 0;
+          inChunk = 0;
+          ++count;
+        }
+      }
+      if(inChunk && count < most){
+        checksum.add(s);
+        *to++ = s;
+      }
+    }
+    writer.flush();
+    close(out);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  std::cout << "  " << mode << ": " << seconds << "s, peak RSS " << peakKiB() / 1024 << "MB" << std::endl;
+  return checksum.value == expected ? 0 : 1;
+}
+
+void run(const char *path, const char *mode, unsigned long long expected)
+{
+  bool ok = rerunOn(path, true, {"lazy_range", mode, std::to_string(expected)});
+  assert(ok);
+}
+
+int main(int argc, char **argv)
+{
+  if(argc == 3)
+    return runner(argv[1], std::strtoull(argv[2], nullptr, 10));
+
+  test();
+  //
+  // the file, and what each way should make of it, worked out as it's written.
+  //
+  const char *path {"/tmp/lazy_range.txt"};
+  std::size_t count {170'000'000};
+  Checksum all, first;
+  {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    FdWriter writer {fd};
+    BufferedOutputIterator<int> out {writer, "\n"};
+    std::mt19937 rng {48};
+    long long s {0};
+    std::size_t inChunk {0}, chunks {0};
+    for(std::size_t i {0}; i < count; ++i){
+      int v = static_cast<int>(rng()) >> (rng() % 32);
+      *out++ = v;
+      if(v % 3 == 0)
+        continue;
+      s += v / 16;
+      if(++inChunk == 4){
+        all.add(s);
+        if(chunks++ < taken)
+          first.add(s);
+        s = 0;
+        inChunk = 0;
+      }
+    }
+    if(inChunk)
+      all.add(s);
+    writer.flush();
+    std::cout << "pipeline over " << count / 1'000'000 << "M ints, " << lseek(fd, 0, SEEK_CUR) / 1'000'000
+              << "MB, from a pipe;" << std::endl;
+    close(fd);
+  }
+  run(path, "lazy", all.value);
+  run(path, "materialised", all.value);
+  run(path, "loop", all.value);
+  run(path, "lazy-take", first.value);
+  run(path, "materialised-take", first.value);
+  run(path, "loop-take", first.value);
+  std::remove(path);
+}
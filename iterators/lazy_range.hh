@@ -0,0 +1,439 @@
+#ifndef _LAZY_RANGE_HH_
+#define _LAZY_RANGE_HH_
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+//
+// Lazy range adaptors; filter, transform, take and chunk, composed with |, so that
+//
+//   auto r = lazy::range(MappedInputIterator<int>(input), MappedInputIterator<int>())
+//          | lazy::filter([](int v){ return v >= 0; })
+//          | lazy::transform([](int v){ return v / 16; })
+//          | lazy::take(1000);
+//   mycopy(r.begin(), r.end(), BufferedOutputIterator<int>(writer, "\n"));
+//
+// reads, filters, transforms and writes each value in turn, in one pass, with nothing held
+// but the value in hand; where 3.input_it.cpp reads everything into a vector first and
+// then goes over the vector. Each adaptor is a range holding the range it adapts and its
+// function, and its iterator wraps the inner range's iterator, so after inlining the stages
+// are one loop.
+//
+// They are as lazy as the input allows. Nothing is read until begin() (which, over an input
+// iterator, reads the first value, so call it once), take stops without reading the value
+// after its last (so the rest of a stream is left for whatever reads it next), and chunk
+// doesn't read the value after a full chunk until the next chunk is asked for.
+//
+// Iterators point at the function in the range that made them, so the range has to outlive
+// them; they are input iterators, whatever they wrap, and the values of transform and
+// chunk are temporaries.
+//
+
+namespace lazy
+{
+  template<typename It>
+  class Range
+  {
+  public:
+    using iterator = It;
+
+    Range(It first, It last)
+      : _first(first), _last(last)
+    {}
+
+    It begin() const
+    { return _first; }
+
+    It end() const
+    { return _last; }
+
+  private:
+    It _first;
+    It _last;
+  };
+
+  template<typename It>
+  Range<It> range(It first, It last)
+  { return {first, last}; }
+
+  template<typename C>
+  auto range(C& container)
+  { return range(std::begin(container), std::end(container)); }
+
+  template<typename R>
+  using IteratorOf = decltype(std::declval<const R&>().begin());
+
+  //
+  // the values of the inner range for which pred is true.
+  //
+  template<typename It, typename P>
+  class FilterIterator
+  {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = typename std::iterator_traits<It>::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = typename std::iterator_traits<It>::reference;
+
+    FilterIterator(It it, It last, const P *pred)
+      : _it(it), _last(last), _pred(pred)
+    { skip(); }
+
+    reference operator*() const
+    { return *_it; }
+
+    FilterIterator& operator++()
+    {
+      ++_it;
+      skip();
+      return *this;
+    }
+
+    FilterIterator operator++(int)
+    {
+      FilterIterator old {*this};
+      ++*this;
+      return old;
+    }
+
+    friend bool operator==(const FilterIterator& a, const FilterIterator& b)
+    { return a._it == b._it; }
+
+    friend bool operator!=(const FilterIterator& a, const FilterIterator& b)
+    { return !(a == b); }
+
+  private:
+    void skip()
+    {
+      while(_it != _last && !(*_pred)(*_it))
+        ++_it;
+    }
+
+    It _it;
+    It _last;
+    const P *_pred;
+  };
+
+  template<typename R, typename P>
+  class FilterRange
+  {
+  public:
+    using iterator = FilterIterator<IteratorOf<R>, P>;
+
+    FilterRange(R base, P pred)
+      : _base(std::move(base)), _pred(std::move(pred))
+    {}
+
+    iterator begin() const
+    { return {_base.begin(), _base.end(), &_pred}; }
+
+    iterator end() const
+    { return {_base.end(), _base.end(), &_pred}; }
+
+  private:
+    R _base;
+    P _pred;
+  };
+
+  //
+  // f of each value of the inner range, called as each is read.
+  //
+  template<typename It, typename F>
+  class TransformIterator
+  {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::decay_t<std::invoke_result_t<const F&, typename std::iterator_traits<It>::reference>>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    TransformIterator(It it, const F *f)
+      : _it(it), _f(f)
+    {}
+
+    value_type operator*() const
+    { return (*_f)(*_it); }
+
+    TransformIterator& operator++()
+    {
+      ++_it;
+      return *this;
+    }
+
+    TransformIterator operator++(int)
+    {
+      TransformIterator old {*this};
+      ++_it;
+      return old;
+    }
+
+    friend bool operator==(const TransformIterator& a, const TransformIterator& b)
+    { return a._it == b._it; }
+
+    friend bool operator!=(const TransformIterator& a, const TransformIterator& b)
+    { return !(a == b); }
+
+  private:
+    It _it;
+    const F *_f;
+  };
+
+  template<typename R, typename F>
+  class TransformRange
+  {
+  public:
+    using iterator = TransformIterator<IteratorOf<R>, F>;
+
+    TransformRange(R base, F f)
+      : _base(std::move(base)), _f(std::move(f))
+    {}
+
+    iterator begin() const
+    { return {_base.begin(), &_f}; }
+
+    iterator end() const
+    { return {_base.end(), &_f}; }
+
+  private:
+    R _base;
+    F _f;
+  };
+
+  //
+  // the first n values of the inner range, or all of them if there are fewer. Stepping off
+  // the last one doesn't step the inner iterator, which for an input stream would read one
+  // more.
+  //
+  template<typename It>
+  class TakeIterator
+  {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = typename std::iterator_traits<It>::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = typename std::iterator_traits<It>::reference;
+
+    TakeIterator(It it, It last, std::size_t n)
+      : _it(it), _last(last), _n(n)
+    {}
+
+    reference operator*() const
+    { return *_it; }
+
+    TakeIterator& operator++()
+    {
+      if(--_n != 0)
+        ++_it;
+      return *this;
+    }
+
+    TakeIterator operator++(int)
+    {
+      TakeIterator old {*this};
+      ++*this;
+      return old;
+    }
+
+    friend bool operator==(const TakeIterator& a, const TakeIterator& b)
+    { return a.done() == b.done() && (a.done() || (a._it == b._it && a._n == b._n)); }
+
+    friend bool operator!=(const TakeIterator& a, const TakeIterator& b)
+    { return !(a == b); }
+
+  private:
+    bool done() const
+    { return _n == 0 || _it == _last; }
+
+    It _it;
+    It _last;
+    std::size_t _n;
+  };
+
+  template<typename R>
+  class TakeRange
+  {
+  public:
+    using iterator = TakeIterator<IteratorOf<R>>;
+
+    TakeRange(R base, std::size_t n)
+      : _base(std::move(base)), _n(n)
+    {}
+
+    iterator begin() const
+    { return {_base.begin(), _base.end(), _n}; }
+
+    iterator end() const
+    { return {_base.end(), _base.end(), 0}; }
+
+  private:
+    R _base;
+    std::size_t _n;
+  };
+
+  //
+  // N values of the inner range at a time (fewer in the last), copied into the iterator; N is
+  // a constant so a chunk is an array and copying the iterator (as *it++ does) costs no
+  // allocation.
+  //
+  template<typename T, std::size_t N>
+  struct Chunk
+  {
+    std::array<T, N> values;
+    std::size_t size {0};
+
+    const T* begin() const
+    { return values.data(); }
+
+    const T* end() const
+    { return values.data() + size; }
+  };
+
+  template<typename It, std::size_t N>
+  class ChunkIterator
+  {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Chunk<typename std::iterator_traits<It>::value_type, N>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    ChunkIterator(It it, It last)
+      : _it(it), _last(last)
+    { fill(); }
+
+    const value_type& operator*() const
+    { return _chunk; }
+
+    const value_type* operator->() const
+    { return &_chunk; }
+
+    ChunkIterator& operator++()
+    {
+      fill();
+      return *this;
+    }
+
+    ChunkIterator operator++(int)
+    {
+      ChunkIterator old {*this};
+      fill();
+      return old;
+    }
+
+    friend bool operator==(const ChunkIterator& a, const ChunkIterator& b)
+    {
+      bool aEnd {a._chunk.size == 0}, bEnd {b._chunk.size == 0};
+      return aEnd == bEnd && (aEnd || (a._it == b._it && a._taken == b._taken));
+    }
+
+    friend bool operator!=(const ChunkIterator& a, const ChunkIterator& b)
+    { return !(a == b); }
+
+  private:
+    //
+    // the next chunk; _taken is whether *_it is already in the last one, left unstepped
+    // until now.
+    //
+    void fill()
+    {
+      _chunk.size = 0;
+      if(_taken){
+        ++_it;
+        _taken = false;
+      }
+      while(_it != _last){
+        _chunk.values[_chunk.size++] = *_it;
+        if(_chunk.size == N){
+          _taken = true;
+          break;
+        }
+        ++_it;
+      }
+    }
+
+    It _it;
+    It _last;
+    bool _taken {false};
+    value_type _chunk;
+  };
+
+  template<typename R, std::size_t N>
+  class ChunkRange
+  {
+  public:
+    using iterator = ChunkIterator<IteratorOf<R>, N>;
+
+    explicit ChunkRange(R base)
+      : _base(std::move(base))
+    {}
+
+    iterator begin() const
+    { return {_base.begin(), _base.end()}; }
+
+    iterator end() const
+    { return {_base.end(), _base.end()}; }
+
+  private:
+    R _base;
+  };
+
+  //
+  // what goes on the right of |; range | filter(pred) is FilterRange(range, pred), and so on.
+  //
+  template<typename P>
+  struct Filter
+  { P pred; };
+
+  template<typename F>
+  struct Transform
+  { F f; };
+
+  struct Take
+  { std::size_t n; };
+
+  template<std::size_t N>
+  struct ChunkOf {};
+
+  template<typename P>
+  Filter<P> filter(P pred)
+  { return {std::move(pred)}; }
+
+  template<typename F>
+  Transform<F> transform(F f)
+  { return {std::move(f)}; }
+
+  inline Take take(std::size_t n)
+  { return {n}; }
+
+  template<std::size_t N>
+  ChunkOf<N> chunk()
+  {
+    static_assert(N > 0, "chunks of at least one");
+    return {};
+  }
+
+  template<typename R, typename P>
+  FilterRange<R, P> operator|(R base, Filter<P> adaptor)
+  { return {std::move(base), std::move(adaptor.pred)}; }
+
+  template<typename R, typename F>
+  TransformRange<R, F> operator|(R base, Transform<F> adaptor)
+  { return {std::move(base), std::move(adaptor.f)}; }
+
+  template<typename R>
+  TakeRange<R> operator|(R base, Take adaptor)
+  { return {std::move(base), adaptor.n}; }
+
+  template<typename R, std::size_t N>
+  ChunkRange<R, N> operator|(R base, ChunkOf<N>)
+  { return ChunkRange<R, N>(std::move(base)); }
+}
+
+#endif
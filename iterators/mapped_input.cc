@@ -0,0 +1,193 @@
+//
+// MappedInputIterator (mapped_input.hh) against std::istream_iterator.
+//
+// First that it reads the same values as istream_iterator and stops in the same place, from
+// a file (mapped) and from a pipe (buffered, with a buffer small enough to be refilled in the
+// middle of numbers, and numbers longer than the buffer), for well formed input, odd
+// whitespace, signs, and input which goes wrong part way; and that a file is read from the
+// descriptor's offset, and left with the offset just past what was read.
+//
+// Then 3.input_it.cpp's loop, summing 50M ints from stdin, ints per second; istream_iterator
+// on std::cin with and without sync_with_stdio(false), and MappedInputIterator, with stdin
+// a file and with stdin a pipe. sync_with_stdio has to be called before any I/O, so each
+// is run in its own process; this program runs itself with the file or a pipe as stdin.
+//
+
+#include "buffered_output.hh"
+#include "experiment.hh"
+#include "mapped_input.hh"
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+template<typename T>
+std::vector<T> viaIstream(const std::string& text)
+{
+  std::istringstream in {text};
+  return {std::istream_iterator<T>(in), std::istream_iterator<T>()};
+}
+
+template<typename T>
+std::vector<T> viaMapped(int fd, std::size_t capacity)
+{
+  InputBuffer input {fd, capacity};
+  return {MappedInputIterator<T>(input), MappedInputIterator<T>()};
+}
+
+template<typename T>
+void check(const std::string& text)
+{
+  std::vector<T> expected = viaIstream<T>(text);
+
+  //
+  // the text after some junk which the descriptor has been moved past, less than a page of
+  // it, a page, and more; read half way, then the rest by another InputBuffer from where
+  // the first left the offset.
+  //
+  for(std::size_t skip : {0, 1, 4096, 5003}){
+    std::FILE *file = std::tmpfile();
+    std::string junk(skip, '#');
+    std::fwrite(junk.data(), 1, junk.size(), file);
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::fflush(file);
+    int fd = fileno(file);
+    lseek(fd, skip, SEEK_SET);
+    {
+      InputBuffer input {fd};
+      assert(input.mapped() == !text.empty());
+    }
+    assert(lseek(fd, 0, SEEK_CUR) == static_cast<off_t>(skip));
+    std::vector<T> got;
+    {
+      InputBuffer input {fd};
+      T value;
+      while(got.size() < expected.size() / 2 && input.next(value))
+        got.push_back(value);
+    }
+    std::vector<T> rest = viaMapped<T>(fd, InputBuffer::defaultCapacity);
+    got.insert(got.end(), rest.begin(), rest.end());
+    assert(got == expected);
+    std::fclose(file);
+  }
+
+  for(std::size_t capacity : {std::size_t{128}, std::size_t{1000}}){
+    int fds[2];
+    pipe(fds);
+    //
+    // written in dribs and drabs from another thread, so reads come back short.
+    //
+    std::thread writer {[&]{
+      for(std::size_t i {0}; i < text.size(); i += 77)
+        write(fds[1], text.data() + i, std::min<std::size_t>(77, text.size() - i));
+      close(fds[1]);
+    }};
+    assert(viaMapped<T>(fds[0], capacity) == expected);
+    writer.join();
+    close(fds[0]);
+  }
+}
+
+void test()
+{
+  std::mt19937 rng {46};
+  std::string ints;
+  for(int i {0}; i < 5000; ++i){
+    ints += std::to_string(static_cast<int>(rng()) >> (rng() % 32));
+    ints += " \n\t\r\v\f"[rng() % 6];
+    if(rng() % 8 == 0)
+      ints += "   \n\n";
+  }
+  check<int>(ints);
+  check<long long>(ints);
+  check<int>("");
+  check<int>("   \n  ");
+  check<int>("42");
+  check<int>("+5 -0 +0 -7\n");
+  check<int>("1 2 3 12abc 4 5");
+  check<int>("1 2 99999999999 3");
+  check<int>("1 2 - 3");
+  check<int>("1 2 + 3");
+  check<int>("1 +-5 2");
+  check<int>(std::string(300, '0') + "17 " + std::string(500, ' ') + "-" + std::string(200, '0') + "3 8");
+  check<unsigned>("1 4294967295 4294967296 5");
+  check<double>("1.5 -2.25e10 3 .5 7. 1e400 9");
+  std::cout << "MappedInputIterator reads what istream_iterator does, from files and pipes" << std::endl;
+}
+
+//
+// run in a process of its own; stdin is the file or a pipe.
+//
+int reader(const std::string& mode, const std::string& label, long long expected)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  long long sum {0}, count {0};
+  if(mode == "mapped"){
+    InputBuffer input {0};
+    for(MappedInputIterator<int> it {input}, end; it != end; ++it, ++count)
+      sum += *it;
+  }
+  else{
+    if(mode == "istream-nosync")
+      std::ios::sync_with_stdio(false);
+    for(std::istream_iterator<int> it {std::cin}, end; it != end; ++it, ++count)
+      sum += *it;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  std::cout << "  " << label << ": " << seconds << "s, " << count / seconds / 1e6 << "M ints/s"
+            << std::endl;
+  return sum == expected ? 0 : 1;
+}
+
+void run(const char *path, const char *mode, bool piped, const std::string& label, long long sum)
+{
+  bool ok = rerunOn(path, piped, {"mapped_input", mode, label, std::to_string(sum)});
+  assert(ok);
+}
+
+int main(int argc, char **argv)
+{
+  if(argc == 4)
+    return reader(argv[1], argv[2], std::atoll(argv[3]));
+
+  test();
+  //
+  // mixed lengths, one a line, written with buffered_output.hh.
+  //
+  const char *path {"/tmp/mapped_input.txt"};
+  std::size_t count {50'000'000};
+  long long sum {0};
+  {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    FdWriter writer {fd};
+    BufferedOutputIterator<int> out {writer, "\n"};
+    std::mt19937 rng {3};
+    for(std::size_t i {0}; i < count; ++i){
+      int v = static_cast<int>(rng()) >> (rng() % 32);
+      sum += v;
+      *out++ = v;
+    }
+    writer.flush();
+    close(fd);
+  }
+  std::cout << "summing " << count / 1'000'000 << "M ints from stdin;" << std::endl;
+  for(bool piped : {false, true}){
+    std::string from = piped ? ", pipe" : ", file";
+    run(path, "istream", piped, "istream_iterator" + from, sum);
+    run(path, "istream-nosync", piped, "istream_iterator, sync_with_stdio(false)" + from, sum);
+    run(path, "mapped", piped, std::string("MappedInputIterator") + from, sum);
+  }
+  std::remove(path);
+}
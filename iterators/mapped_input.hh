@@ -0,0 +1,271 @@
+#ifndef _MAPPED_INPUT_HH_
+#define _MAPPED_INPUT_HH_
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <system_error>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+// An input iterator with std::istream_iterator's contract (it reads a value when constructed
+// and on every ++, and becomes equal to the default constructed end iterator when a read
+// fails or the input runs out) for reading big streams of numbers quickly.
+//
+// istream_iterator does is >> v for every value; a sentry, the locale's num_get facet, and
+// a call into the streambuf per character; with std::cin still synchronised with stdio
+// (the default) the streambuf is unbuffered and every character is a call to getc.
+// Here the numbers are parsed in place with std::from_chars (no locale, no copy) from;
+//
+//  - a regular file, mapped with mmap from the descriptor's offset to the end (from the page
+//    that offset is in, as mmap wants, and the start of the page skipped). When the
+//    InputBuffer goes the offset is moved on to just after the last value read, so whatever
+//    reads the descriptor next carries on from there, as it would after read(2)s.
+//    madvise(MADV_SEQUENTIAL) tells the kernel to read ahead hard and drop pages behind,
+//    and as the parse goes along the next 8MiB is asked for with MADV_WILLNEED so the page
+//    cache is being filled ahead of it.
+//  - anything else (a pipe, a terminal), through a 1MiB buffer refilled with read(2), the
+//    unparsed tail moved to the front first so no number is split. What has been read
+//    ahead into the buffer is gone from the descriptor, as with a stdio buffer.
+//
+// InputBuffer is the input; it doesn't own the descriptor. The iterators are a pointer to
+// it and the last value read, and, as with istream_iterator, copies read from the same
+// input, so only one of them should be advanced.
+//
+// Tokens are whatever isn't C locale whitespace; a token which doesn't parse as a T (or
+// doesn't fit one) ends the input as it does for istream_iterator, and so does a T followed
+// directly by something else, at the next read ("12abc" reads 12, then stops). A leading
+// '+' is allowed, as by istream; a '-' on an unsigned number isn't (istream wraps it round).
+//
+
+class InputBuffer
+{
+public:
+  static constexpr std::size_t defaultCapacity {std::size_t{1} << 20};
+  static constexpr std::size_t willNeedBytes {std::size_t{8} << 20};
+
+  //
+  // bytes ahead a token must have in the window before it is parsed, unless the input ends
+  // sooner; longer than any number that isn't padded with zeros. Longer ones are parsed
+  // again after a refill, see next().
+  //
+  static constexpr std::size_t lookahead {64};
+
+  explicit InputBuffer(int fd, std::size_t capacity = defaultCapacity)
+    : _fd(fd), _capacity(std::max(capacity, 2 * lookahead))
+  {
+    struct stat st;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if(offset >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > offset){
+      off_t page = sysconf(_SC_PAGESIZE);
+      off_t from = offset / page * page;
+      void *p = mmap(nullptr, st.st_size - from, PROT_READ, MAP_PRIVATE, fd, from);
+      if(p != MAP_FAILED){
+        _map = static_cast<char*>(p);
+        _mapBytes = st.st_size - from;
+        _mapOffset = from;
+        _pos = _map + (offset - from);
+        _end = _map + _mapBytes;
+        _eof = true;
+        _advised = offset - from;
+        posix_fadvise(fd, offset, 0, POSIX_FADV_SEQUENTIAL);
+        madvise(_map, _mapBytes, MADV_SEQUENTIAL);
+        adviseAhead();
+        return;
+      }
+    }
+    _buffer.reset(new char[_capacity]);
+    _pos = _end = _buffer.get();
+  }
+
+  InputBuffer(const InputBuffer&) = delete;
+  InputBuffer& operator=(const InputBuffer&) = delete;
+
+  ~InputBuffer()
+  {
+    if(_map){
+      lseek(_fd, _mapOffset + (_pos - _map), SEEK_SET);
+      munmap(_map, _mapBytes);
+    }
+  }
+
+  bool mapped() const
+  { return _map != nullptr; }
+
+  //
+  // the next T, or false at the end of the input or a token which isn't one.
+  //
+  template<typename T>
+  bool next(T& value)
+  {
+    for(;;){
+      while(_pos != _end && isSpace(*_pos))
+        ++_pos;
+      if(static_cast<std::size_t>(_end - _pos) >= lookahead || _eof)
+        break;
+      refill();
+    }
+    if(_map && _advised < _mapBytes && static_cast<std::size_t>(_pos - _map) + willNeedBytes / 2 >= _advised)
+      adviseAhead();
+    for(;;){
+      if(_pos == _end)
+        return false;
+      const char *p = _pos + (*_pos == '+');
+      if(p != _pos && p != _end && *p == '-')
+        return false;
+      auto [end, ec] = std::from_chars(p, _end, value);
+      //
+      // up against the end of the window with more to come; the token may go on, so get more
+      // and parse it again.
+      //
+      if(end == _end && !_eof){
+        refill();
+        continue;
+      }
+      if(ec != std::errc{})
+        return false;
+      _pos = end;
+      return true;
+    }
+  }
+
+private:
+  static bool isSpace(char c)
+  { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+  //
+  // the next willNeedBytes after what has been asked for so far; madvise wants a page
+  // aligned start.
+  //
+  void adviseAhead()
+  {
+    std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t from = _advised / page * page;
+    _advised = std::min(_mapBytes, _advised + willNeedBytes);
+    madvise(_map + from, _advised - from, MADV_WILLNEED);
+  }
+
+  //
+  // keep [_pos, _end), moved to the front of the buffer (which doubles if it is already all
+  // one token), and read as much as fits after it.
+  //
+  void refill()
+  {
+    if(_eof)
+      return;
+    std::size_t kept = _end - _pos;
+    if(kept == _capacity){
+      std::unique_ptr<char[]> bigger {new char[2 * _capacity]};
+      std::memcpy(bigger.get(), _pos, kept);
+      _buffer = std::move(bigger);
+      _capacity *= 2;
+    }
+    else
+      std::memmove(_buffer.get(), _pos, kept);
+    _pos = _buffer.get();
+    _end = _pos + kept;
+    while(_end != _buffer.get() + _capacity){
+      char *at = _buffer.get() + (_end - _buffer.get());
+      ssize_t n = ::read(_fd, at, _capacity - (at - _buffer.get()));
+      if(n < 0){
+        if(errno == EINTR)
+          continue;
+        throw std::system_error(errno, std::generic_category(), "read");
+      }
+      if(n == 0){
+        _eof = true;
+        break;
+      }
+      _end += n;
+      //
+      // a pipe gives what it has; enough to go on with, rather than waiting for a full buffer.
+      //
+      if(static_cast<std::size_t>(_end - _pos) >= lookahead)
+        break;
+    }
+  }
+
+  int _fd;
+  std::size_t _capacity;
+  std::unique_ptr<char[]> _buffer;
+  char *_map {nullptr};
+  std::size_t _mapBytes {0};
+  off_t _mapOffset {0};          // where in the file _map starts
+  std::size_t _advised {0};      // bytes from _map asked for with MADV_WILLNEED
+  const char *_pos {nullptr};
+  const char *_end {nullptr};
+  bool _eof {false};
+};
+
+template<typename T>
+class MappedInputIterator
+{
+public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const T*;
+  using reference = const T&;
+
+  static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>,
+                "MappedInputIterator reads integers and floating point");
+
+  //
+  // the end of stream iterator.
+  //
+  MappedInputIterator() = default;
+
+  explicit MappedInputIterator(InputBuffer& input)
+    : _input(&input)
+  { read(); }
+
+  const T& operator*() const
+  { return _value; }
+
+  const T* operator->() const
+  { return &_value; }
+
+  MappedInputIterator& operator++()
+  {
+    read();
+    return *this;
+  }
+
+  MappedInputIterator operator++(int)
+  {
+    MappedInputIterator old {*this};
+    read();
+    return old;
+  }
+
+  //
+  // equal if both are at the end, or both are reading the same input.
+  //
+  friend bool operator==(const MappedInputIterator& a, const MappedInputIterator& b)
+  { return a._input == b._input; }
+
+  friend bool operator!=(const MappedInputIterator& a, const MappedInputIterator& b)
+  { return !(a == b); }
+
+private:
+  void read()
+  {
+    if(!_input->next(_value))
+      _input = nullptr;
+  }
+
+  InputBuffer *_input {nullptr};
+  T _value {};
+};
+
+#endif
@@ -0,0 +1,258 @@
+//
+// mycopy.hh's family against the generic loop from 2.output_it.cpp.
+//
+// First which way each pair of iterators goes, and that every way gives what the generic loop
+// gives; copies between vectors, arrays and strings (overlapping too), conversions between
+// arithmetic types both ways (wrapping and truncating as static_cast does), text written
+// through BufferedOutputIterator from contiguous and non-contiguous ranges, and the ranges
+// which must fall back to the loop.
+//
+// Then each way timed against the generic loop doing the same work;
+//
+//  - memmove; ints, vector to vector, 4K of them (in L1) and 4M (16MB, beyond the L2), GB/s.
+//  - convert; 4K elements, in L1, short to int, int to double, float to double (widening),
+//    double to float and int to short (narrowing), elements per ns.
+//  - bulk write; 50M ints to /dev/null through BufferedOutputIterator, ints per second.
+//
+
+#include "experiment.hh"
+#include "mycopy.hh"
+
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace mycopy_detail;
+
+template<typename In, typename Out, typename Tag>
+constexpr bool goes = std::is_same_v<strategy<In, Out>, Tag>;
+
+static_assert(goes<int*, int*, MemmoveTag>);
+static_assert(goes<const int*, int*, MemmoveTag>);
+static_assert(goes<std::vector<int>::const_iterator, std::vector<int>::iterator, MemmoveTag>);
+static_assert(goes<std::string::const_iterator, char*, MemmoveTag>);
+static_assert(goes<std::vector<short>::iterator, int*, ConvertTag>);
+static_assert(goes<const double*, std::vector<float>::iterator, ConvertTag>);
+static_assert(goes<std::list<int>::iterator, std::vector<int>::iterator, GenericTag>);
+static_assert(goes<std::vector<int>::iterator, std::back_insert_iterator<std::vector<int>>, GenericTag>);
+static_assert(goes<std::vector<bool>::iterator, std::vector<bool>::iterator, GenericTag>);
+static_assert(goes<std::vector<std::string>::iterator, std::string*, GenericTag>);
+static_assert(goes<std::vector<int>::iterator, BufferedOutputIterator<int>, BulkWriteTag>);
+static_assert(goes<std::list<double>::iterator, BufferedOutputIterator<double>, BulkWriteTag>);
+
+template<typename B, typename A>
+void checkConvert(const std::vector<A>& in)
+{
+  //
+  // every length up to two blocks and a bit, so the tail is tried at every size.
+  //
+  for(std::size_t n {0}; n <= 40 && n <= in.size(); ++n){
+    std::vector<B> expected(n + 1, B{7}), got(n + 1, B{7});
+    copy(in.begin(), in.begin() + n, expected.begin(), GenericTag{});
+    auto end = mycopy(in.begin(), in.begin() + n, got.begin());
+    assert(end == got.begin() + n && got == expected);
+  }
+  std::vector<B> expected(in.size()), got(in.size());
+  copy(in.begin(), in.end(), expected.begin(), GenericTag{});
+  mycopy(in.data(), in.data() + in.size(), got.data());
+  assert(got == expected);
+}
+
+template<typename T, typename In>
+void checkBulk(In first, In last, const char *delimiter)
+{
+  for(std::size_t capacity : {std::size_t{1} << 20, std::size_t{4096}, std::size_t{1000}, FdWriter::minCapacity}){
+    std::string expected = captured([&](int fd){
+      FdWriter writer {fd, capacity};
+      copy(first, last, BufferedOutputIterator<T>(writer, delimiter), GenericTag{});
+    });
+    std::string got = captured([&](int fd){
+      FdWriter writer {fd, capacity};
+      mycopy(first, last, BufferedOutputIterator<T>(writer, delimiter));
+    });
+    assert(got == expected);
+  }
+}
+
+struct Point
+{
+  double x, y;
+  bool operator==(const Point& p) const
+  { return x == p.x && y == p.y; }
+};
+
+void test()
+{
+  std::mt19937 rng {47};
+  std::vector<int> ints(10000);
+  for(auto& v : ints)
+    v = static_cast<int>(rng()) >> (rng() % 32);
+
+  std::vector<int> copied(ints.size());
+  assert(mycopy(ints.cbegin(), ints.cend(), copied.begin()) == copied.end() && copied == ints);
+  std::vector<int> none;
+  assert(mycopy(none.begin(), none.end(), copied.begin()) == copied.begin());
+  //
+  // overlapping, out before first, as std::copy allows.
+  //
+  std::vector<int> shifted {ints}, expected {ints};
+  copy(expected.begin() + 3, expected.end(), expected.begin(), GenericTag{});
+  mycopy(shifted.begin() + 3, shifted.end(), shifted.begin());
+  assert(shifted == expected);
+  std::string text {"a string to copy"}, textCopy(text.size(), ' ');
+  mycopy(text.begin(), text.end(), textCopy.data());
+  assert(textCopy == text);
+  Point points[] {{1, 2}, {3, 4}, {5, 6}}, pointsCopy[3];
+  mycopy(std::begin(points), std::end(points), pointsCopy);
+  assert(std::equal(std::begin(points), std::end(points), pointsCopy));
+
+  std::vector<short> shorts {0, 1, -1, SHRT_MAX, SHRT_MIN};
+  std::vector<float> floats {0.0f, -0.0f, 0.1f, -1.5f, 3e38f, 1e-40f};
+  std::vector<double> doubles {0.0, 1.0 / 3, -2.5, 1e300, 1e-300, 16777217.0};
+  std::vector<unsigned char> bytes {0, 1, 127, 128, 255};
+  for(int i {0}; i < 1000; ++i){
+    shorts.push_back(static_cast<short>(rng()));
+    floats.push_back(static_cast<float>(static_cast<int>(rng())) / 1024);
+    doubles.push_back(static_cast<double>(static_cast<int>(rng())) / 3);
+    bytes.push_back(static_cast<unsigned char>(rng()));
+  }
+  checkConvert<int>(shorts);
+  checkConvert<double>(ints);
+  checkConvert<double>(floats);
+  checkConvert<float>(ints);
+  checkConvert<float>(bytes);
+  checkConvert<float>(doubles);
+  checkConvert<short>(ints);
+  checkConvert<unsigned char>(ints);
+  checkConvert<long long>(ints);
+  checkConvert<unsigned>(shorts);
+  //
+  // doubles to int only where they fit; static_cast of one that doesn't is undefined.
+  //
+  std::vector<double> small(doubles.begin() + 6, doubles.end());
+  checkConvert<int>(small);
+  checkConvert<int>(std::vector<float>(floats.begin() + 6, floats.end()));
+
+  std::list<int> listed(ints.begin(), ints.end());
+  std::string longDelimiter(100, '-');
+  for(const char *delimiter : {"", " ", "\n", " ## :) ## ", longDelimiter.c_str()}){
+    checkBulk<int>(ints.begin(), ints.end(), delimiter);
+    checkBulk<int>(listed.begin(), listed.end(), delimiter);
+    checkBulk<long long>(ints.begin(), ints.end(), delimiter);
+    checkBulk<double>(doubles.begin(), doubles.end(), delimiter);
+    checkBulk<int>(none.begin(), none.end(), delimiter);
+  }
+
+  std::vector<int> appended;
+  mycopy(listed.begin(), listed.end(), std::back_inserter(appended));
+  assert(appended == ints);
+  std::cout << "every mycopy gives what the generic loop does" << std::endl;
+}
+
+template<typename F>
+double timed(F&& run)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  run();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+//
+// the same copy many times over; the result is summed into sink so none of it is dead.
+//
+volatile double sink;
+
+template<typename Tag>
+double copySeconds(const std::vector<int>& in, std::vector<int>& out, std::size_t times)
+{
+  return timed([&]{
+    for(std::size_t t {0}; t < times; ++t){
+      copy(in.begin(), in.end(), out.begin(), Tag{});
+      sink = out[t % out.size()];
+    }
+  });
+}
+
+void benchmarkMemmove(std::size_t n)
+{
+  std::vector<int> in(n), out(n);
+  for(std::size_t i {0}; i < n; ++i)
+    in[i] = static_cast<int>(i);
+  std::size_t times {(std::size_t{1} << 32) / (n * sizeof(int))};
+  double bytes = static_cast<double>(n * sizeof(int)) * times;
+  double generic = copySeconds<GenericTag>(in, out, times);
+  double moved = copySeconds<MemmoveTag>(in, out, times);
+  std::cout << "  " << n << " ints: generic " << bytes / generic / 1e9 << "GB/s, memmove "
+            << bytes / moved / 1e9 << "GB/s (" << generic / moved << "x)" << std::endl;
+}
+
+template<typename A, typename B>
+void benchmarkConvert(const char *what)
+{
+  std::size_t n {4096}, times {100'000};
+  std::vector<A> in(n);
+  std::vector<B> out(n);
+  for(std::size_t i {0}; i < n; ++i)
+    in[i] = static_cast<A>(static_cast<int>(i * 37 % 1000) - 500);
+  auto seconds = [&](auto tag){
+    return timed([&]{
+      for(std::size_t t {0}; t < times; ++t){
+        copy(in.begin(), in.end(), out.begin(), tag);
+        sink = out[t % n];
+      }
+    });
+  };
+  double elements = static_cast<double>(n) * times;
+  double generic = seconds(GenericTag{});
+  double converted = seconds(ConvertTag{});
+  std::cout << "  " << what << ": generic " << elements / generic / 1e9 << "/ns, convert "
+            << elements / converted / 1e9 << "/ns (" << generic / converted << "x)" << std::endl;
+}
+
+void benchmarkBulk(const std::vector<int>& values)
+{
+  auto seconds = [&](auto tag){
+    int fd = open("/dev/null", O_WRONLY);
+    double s = timed([&]{
+      FdWriter writer {fd};
+      copy(values.begin(), values.end(), BufferedOutputIterator<int>(writer, " "), tag);
+    });
+    close(fd);
+    return s;
+  };
+  double generic = seconds(GenericTag{});
+  double bulk = seconds(BulkWriteTag{});
+  std::cout << "  " << values.size() / 1'000'000 << "M ints to /dev/null: generic "
+            << values.size() / generic / 1e6 << "M ints/s, bulk write " << values.size() / bulk / 1e6
+            << "M ints/s (" << generic / bulk << "x)" << std::endl;
+}
+
+int main()
+{
+  test();
+  std::cout << "memmove, vector<int> to vector<int>;" << std::endl;
+  benchmarkMemmove(4096);
+  benchmarkMemmove(std::size_t{4} << 20);
+  std::cout << "convert, 4096 elements;" << std::endl;
+  benchmarkConvert<short, int>("short to int");
+  benchmarkConvert<int, double>("int to double");
+  benchmarkConvert<float, double>("float to double");
+  benchmarkConvert<double, float>("double to float");
+  benchmarkConvert<int, short>("int to short");
+  std::cout << "bulk write, BufferedOutputIterator<int>;" << std::endl;
+  std::vector<int> values(50'000'000);
+  std::mt19937 rng {2};
+  for(auto& v : values)
+    v = static_cast<int>(rng()) >> (rng() % 32);
+  benchmarkBulk(values);
+}
@@ -0,0 +1,161 @@
+#ifndef _MYCOPY_HH_
+#define _MYCOPY_HH_
+
+#include "buffered_output.hh"
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+//
+// 2.output_it.cpp's mycopy, as a family; the same call picks the fastest way to do the copy
+// from the iterator types, as std::copy does inside the standard library.
+//
+//   mycopy(first, last, out)
+//
+//  - generic; *out++ = *first++ until first == last, the loop from 2.output_it.cpp. Anything
+//    which isn't one of the below.
+//  - memmove; both ranges contiguous (pointers, std::vector or std::string iterators), of the
+//    same trivially copyable type. Overlapping is fine, as for std::copy when out is before
+//    first.
+//  - convert; both ranges contiguous, of different arithmetic types, so each element goes
+//    through static_cast (int to double, short to int, double to float, ...). Run in blocks
+//    of 16 with a fixed count inner loop, which -O2's vectoriser turns into SIMD widening
+//    and narrowing (vpmovsxwd, vcvtdq2pd, vcvtps2pd, vcvtpd2ps, ...); the plain loop isn't
+//    vectorised at -O2 as its count isn't known. The ranges mustn't overlap.
+//  - bulk write; into a BufferedOutputIterator (buffered_output.hh). Rather than reserving
+//    room in the buffer for each value, the loop reserves for as many values as fit and
+//    formats into it through a local pointer, committing once. Through the iterator every
+//    character stored might (as far as the compiler knows) have changed the FdWriter, so it
+//    is reloaded after each value.
+//
+// Which one is a tag, picked by strategy<In, Out>, and each is an overload of
+// mycopy_detail::copy taking that tag, so a benchmark can ask for any of them.
+//
+
+namespace mycopy_detail
+{
+  struct GenericTag {};
+  struct MemmoveTag {};
+  struct ConvertTag {};
+  struct BulkWriteTag {};
+
+  template<typename It>
+  using ValueOf = std::remove_cv_t<typename std::iterator_traits<It>::value_type>;
+
+  //
+  // contiguous iterators; there is no contiguous_iterator_tag before C++20, so pointers (which
+  // std::array's iterators are, in libstdc++) and the iterators of std::vector (not
+  // vector<bool>) and std::string, by name.
+  //
+  template<typename It, typename = void>
+  constexpr bool isContiguous {false};
+
+  template<typename T>
+  constexpr bool isContiguous<T*> {true};
+
+  template<typename It>
+  constexpr bool isContiguous<It, std::enable_if_t<!std::is_pointer_v<It> && !std::is_void_v<ValueOf<It>> &&
+                                                   !std::is_same_v<ValueOf<It>, bool>>> {
+    std::is_same_v<It, typename std::vector<ValueOf<It>>::iterator> ||
+    std::is_same_v<It, typename std::vector<ValueOf<It>>::const_iterator> ||
+    std::is_same_v<It, std::string::iterator> || std::is_same_v<It, std::string::const_iterator>};
+
+  template<typename Out>
+  constexpr bool isBuffered {false};
+
+  template<typename T, typename W>
+  constexpr bool isBuffered<BufferedOutputIterator<T, W>> {true};
+
+  template<typename In, typename Out, typename = void>
+  struct Strategy
+  { using type = GenericTag; };
+
+  template<typename In, typename Out>
+  struct Strategy<In, Out, std::enable_if_t<isBuffered<Out>>>
+  { using type = BulkWriteTag; };
+
+  template<typename In, typename Out>
+  struct Strategy<In, Out, std::enable_if_t<isContiguous<In> && isContiguous<Out>>>
+  {
+    using A = ValueOf<In>;
+    using B = ValueOf<Out>;
+    using type = std::conditional_t<std::is_same_v<A, B> && std::is_trivially_copyable_v<A>, MemmoveTag,
+                 std::conditional_t<std::is_arithmetic_v<A> && std::is_arithmetic_v<B>, ConvertTag,
+                                    GenericTag>>;
+  };
+
+  template<typename In, typename Out>
+  using strategy = typename Strategy<In, Out>::type;
+
+  template<typename It>
+  auto address(It it)
+  { return &*it; }
+
+  template<typename In, typename Out>
+  Out copy(In first, In last, Out out, GenericTag)
+  {
+    while(first != last)
+      *out++ = *first++;
+    return out;
+  }
+
+  template<typename In, typename Out>
+  Out copy(In first, In last, Out out, MemmoveTag)
+  {
+    auto n = last - first;
+    if(n > 0)
+      std::memmove(address(out), address(first), n * sizeof(ValueOf<In>));
+    return out + n;
+  }
+
+  template<typename A, typename B>
+  void convert(const A *__restrict in, std::size_t n, B *__restrict out)
+  {
+    std::size_t i {0};
+    for(; i + 16 <= n; i += 16)
+      for(std::size_t j {0}; j < 16; ++j)
+        out[i + j] = static_cast<B>(in[i + j]);
+    for(; i < n; ++i)
+      out[i] = static_cast<B>(in[i]);
+  }
+
+  template<typename In, typename Out>
+  Out copy(In first, In last, Out out, ConvertTag)
+  {
+    auto n = last - first;
+    if(n > 0)
+      convert(address(first), n, address(out));
+    return out + n;
+  }
+
+  template<typename In, typename T, typename W>
+  BufferedOutputIterator<T, W> copy(In first, In last, BufferedOutputIterator<T, W> out, BulkWriteTag)
+  {
+    W& writer = out.writer();
+    const std::string_view delimiter = out.delimiter();
+    const std::size_t most = maxChars<T> + delimiter.size();
+    const std::size_t batch = writer.capacity() / most;
+    if(batch < 16)
+      return copy(first, last, out, GenericTag{});
+    while(first != last){
+      char *start = writer.reserve(batch * most), *at = start;
+      for(std::size_t k {0}; k < batch && first != last; ++k, ++first){
+        at = formatted(at, static_cast<T>(*first));
+        std::memcpy(at, delimiter.data(), delimiter.size());
+        at += delimiter.size();
+      }
+      writer.commit(at - start);
+    }
+    return out;
+  }
+}
+
+template<typename In, typename Out>
+Out mycopy(In first, In last, Out out)
+{ return mycopy_detail::copy(first, last, out, mycopy_detail::strategy<In, Out>{}); }
+
+#endif
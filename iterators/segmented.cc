@@ -0,0 +1,200 @@
+//
+// segmented.hh's algorithms on std::deque against the loops everyone writes, one element at a
+// time through the deque's iterator (2.output_it.cpp's mycopy, and the same for the rest).
+//
+// First that each gives what std:: gives, from every offset into the first block to every
+// offset into the last, into and out of deques, vectors and lists, for ints, doubles and
+// strings.
+//
+// Then each, on a deque<int> of 16K (64KB, in L2) and of 4M (16MB, beyond it), against the
+// element at a time loop, and against std:: (which libstdc++ already segments for copy and
+// fill on a deque), elements per ns.
+//
+
+#include "segmented.hh"
+
+#include <cassert>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <numeric>
+#include <string>
+#include <vector>
+
+static_assert(segmented::isSegmented<std::deque<int>::iterator>);
+static_assert(segmented::isSegmented<std::deque<std::string>::const_iterator>);
+static_assert(!segmented::isSegmented<std::vector<int>::iterator>);
+static_assert(!segmented::isSegmented<int*>);
+
+template<typename T, typename Make>
+void check(Make make)
+{
+  //
+  // a block holds 512 / sizeof(T) (or 1) of them; three blocks and a bit, and a start part
+  // way into a block.
+  //
+  std::size_t block {std::max<std::size_t>(512 / sizeof(T), 1)};
+  std::deque<T> d;
+  for(std::size_t i {0}; i < 3 * block + 5; ++i)
+    d.push_back(make(i));
+  d.pop_front();
+  std::size_t n {d.size()};
+  std::vector<std::size_t> offsets {0, 1, block / 2, block - 1, block, block + 1, n - 1, n};
+  for(std::size_t a : offsets){
+    for(std::size_t b : offsets){
+      if(b < a)
+        continue;
+      auto first = d.begin() + a, last = d.begin() + b;
+
+      std::vector<T> expected(b - a), got(b - a);
+      std::copy(first, last, expected.begin());
+      assert(segmented::copy(first, last, got.begin()) == got.end() && got == expected);
+
+      std::deque<T> into(n + 3);
+      std::deque<T> intoExpected {into};
+      std::copy(expected.begin(), expected.end(), intoExpected.begin() + 3);
+      assert(segmented::copy(expected.begin(), expected.end(), into.begin() + 3) == into.begin() + 3 + (b - a));
+      assert(into == intoExpected);
+      std::deque<T> dequeToDeque(n + 7);
+      assert(segmented::copy(first, last, dequeToDeque.begin() + 7) == dequeToDeque.begin() + 7 + (b - a));
+      assert(std::equal(first, last, dequeToDeque.begin() + 7));
+
+      std::list<T> listed;
+      segmented::copy(first, last, std::back_inserter(listed));
+      assert(std::equal(listed.begin(), listed.end(), expected.begin(), expected.end()));
+
+      std::deque<T> filled {d}, filledExpected {d};
+      std::fill(filledExpected.begin() + a, filledExpected.begin() + b, make(999));
+      segmented::fill(filled.begin() + a, filled.begin() + b, make(999));
+      assert(filled == filledExpected);
+
+      for(std::size_t k : offsets){
+        T value {k < n ? d[k] : make(12345)};
+        assert(segmented::find(first, last, value) == std::find(first, last, value));
+      }
+    }
+  }
+}
+
+void test()
+{
+  check<int>([](std::size_t i){ return static_cast<int>(i * 7919 % 10007); });
+  check<double>([](std::size_t i){ return static_cast<double>(i) / 3; });
+  check<std::string>([](std::size_t i){ return std::string(i % 30, 'a' + i % 26); });
+
+  std::deque<int> ints;
+  for(int i {0}; i < 100000; ++i)
+    ints.push_back(i * 31 % 1001 - 500);
+  for(std::size_t a : {0, 1, 100, 127, 128, 5000})
+    assert(segmented::accumulate(ints.begin() + a, ints.end() - a / 2, 7LL) ==
+           std::accumulate(ints.begin() + a, ints.end() - a / 2, 7LL));
+  //
+  // big values alternating in sign; summed in order they never overflow, but each lane gets
+  // only the positive or only the negative ones.
+  //
+  std::deque<int> big;
+  for(int i {0}; i < 10000; ++i)
+    big.push_back(i % 2 ? -2'000'000'000 : 2'000'000'000 - i);
+  assert(segmented::accumulate(big.begin() + 1, big.end(), 5) ==
+         std::accumulate(big.begin() + 1, big.end(), 5));
+  std::deque<double> doubles(ints.begin(), ints.end());
+  for(auto& v : doubles)
+    v /= 7;
+  //
+  // doubles are added in the same order as std::accumulate does, so the same to the bit.
+  //
+  assert(segmented::accumulate(doubles.begin() + 3, doubles.end(), 0.0) ==
+         std::accumulate(doubles.begin() + 3, doubles.end(), 0.0));
+  std::cout << "segmented copy, fill, accumulate and find give what std:: does" << std::endl;
+}
+
+volatile long long sink;
+
+template<typename F>
+double perNs(std::size_t elements, std::size_t times, F&& run)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  for(std::size_t t {0}; t < times; ++t)
+    run(t);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return static_cast<double>(elements) * times / seconds / 1e9;
+}
+
+template<typename Naive, typename Std, typename Segmented>
+void compare(const char *what, std::size_t n, std::size_t times, Naive&& naive, Std&& standard,
+             Segmented&& segmented)
+{
+  double a = perNs(n, times, naive), b = perNs(n, times, standard), c = perNs(n, times, segmented);
+  std::cout << "    " << what << ": element at a time " << a << "/ns, std:: " << b << "/ns, segmented "
+            << c << "/ns (" << c / a << "x)" << std::endl;
+}
+
+void benchmark(std::size_t n)
+{
+  std::deque<int> d(n);
+  for(std::size_t i {0}; i < n; ++i)
+    d[i] = static_cast<int>(i % 1000);
+  std::vector<int> v(n);
+  std::size_t times {(std::size_t{1} << 30) / n};
+  std::cout << "  deque<int> of " << n << ";" << std::endl;
+
+  compare("copy to a vector", n, times,
+          [&](std::size_t t){
+            auto from = d.begin(), end = d.end();
+            auto to = v.begin();
+            while(from != end)
+              *to++ = *from++;
+            sink = v[t % n];
+          },
+          [&](std::size_t t){ std::copy(d.begin(), d.end(), v.begin()); sink = v[t % n]; },
+          [&](std::size_t t){ segmented::copy(d.begin(), d.end(), v.begin()); sink = v[t % n]; });
+  compare("copy from a vector", n, times,
+          [&](std::size_t t){
+            auto from = v.begin(), end = v.end();
+            auto to = d.begin();
+            while(from != end)
+              *to++ = *from++;
+            sink = d[t % n];
+          },
+          [&](std::size_t t){ std::copy(v.begin(), v.end(), d.begin()); sink = d[t % n]; },
+          [&](std::size_t t){ segmented::copy(v.begin(), v.end(), d.begin()); sink = d[t % n]; });
+  compare("fill", n, times,
+          [&](std::size_t t){
+            int value = static_cast<int>(t);
+            for(auto it = d.begin(), end = d.end(); it != end; ++it)
+              *it = value;
+            sink = d[t % n];
+          },
+          [&](std::size_t t){ std::fill(d.begin(), d.end(), static_cast<int>(t)); sink = d[t % n]; },
+          [&](std::size_t t){ segmented::fill(d.begin(), d.end(), static_cast<int>(t)); sink = d[t % n]; });
+  compare("accumulate", n, times,
+          [&](std::size_t){
+            long long s {0};
+            for(auto it = d.begin(), end = d.end(); it != end; ++it)
+              s += *it;
+            sink = s;
+          },
+          [&](std::size_t){ sink = std::accumulate(d.begin(), d.end(), 0LL); },
+          [&](std::size_t){ sink = segmented::accumulate(d.begin(), d.end(), 0LL); });
+  //
+  // a value which isn't there, so each looks at everything.
+  //
+  compare("find", n, times,
+          [&](std::size_t){
+            auto it = d.begin(), end = d.end();
+            while(it != end && *it != -1)
+              ++it;
+            sink = it - d.begin();
+          },
+          [&](std::size_t){ sink = std::find(d.begin(), d.end(), -1) - d.begin(); },
+          [&](std::size_t){ sink = segmented::find(d.begin(), d.end(), -1) - d.begin(); });
+}
+
+int main()
+{
+  test();
+  std::cout << "elements per ns;" << std::endl;
+  benchmark(std::size_t{16} << 10);
+  benchmark(std::size_t{4} << 20);
+}
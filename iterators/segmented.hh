@@ -0,0 +1,200 @@
+#ifndef _SEGMENTED_HH_
+#define _SEGMENTED_HH_
+
+#include "mycopy.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <numeric>
+#include <type_traits>
+
+//
+// Segmented iterators (Austern, "Segmented Iterators and Hierarchical Algorithms"); a
+// container which is a sequence of contiguous blocks, std::deque's 512 byte nodes say, has
+// iterators which are (block, position in block) pairs, and every ++ checks for the end of
+// the block. An algorithm which knows that can run its inner loop over each block's pointer
+// range instead, with no check per element; only the first and last blocks are partial.
+//
+// Segments<It> is the protocol; for a segmented iterator,
+//
+//   segment(it)        the block it is in, as an iterator over the blocks
+//   local(it)          where it is in the block, a pointer
+//   begin(s), end(s)   the block's pointer range
+//
+// and segmented::copy, fill, accumulate and find use it when they can and are std::'s when
+// they can't. The iterators they return are worked out from the ones passed in (first + n;
+// a deque iterator is random access), so nothing needs to put an iterator back together from
+// a block and a pointer.
+//
+// std::deque's iterators are segmented with libstdc++ (its _Deque_iterator's members are
+// public, and not documented, so only there). libstdc++ already does this itself for
+// std::copy and std::fill on deque iterators, not for accumulate or find, and not for
+// mycopy or any other loop written against the iterator; that is the comparison in
+// segmented.cc.
+//
+
+namespace segmented
+{
+  template<typename It, typename = void>
+  struct Segments
+  { static constexpr bool segmented {false}; };
+
+#ifdef __GLIBCXX__
+  template<typename T, typename Ref, typename Ptr>
+  struct Segments<std::_Deque_iterator<T, Ref, Ptr>>
+  {
+    using Iterator = std::_Deque_iterator<T, Ref, Ptr>;
+    using SegmentIterator = typename Iterator::_Map_pointer;
+    using LocalIterator = Ptr;
+
+    static constexpr bool segmented {true};
+
+    static SegmentIterator segment(const Iterator& it)
+    { return it._M_node; }
+
+    static LocalIterator local(const Iterator& it)
+    { return it._M_cur; }
+
+    static LocalIterator begin(SegmentIterator s)
+    { return *s; }
+
+    static LocalIterator end(SegmentIterator s)
+    { return *s + Iterator::_S_buffer_size(); }
+  };
+#endif
+
+  template<typename It>
+  constexpr bool isSegmented {Segments<It>::segmented};
+
+  namespace detail
+  {
+    //
+    // f(p, q) on each block's part of [first, last) in turn, until it returns false.
+    //
+    template<typename It, typename F>
+    void eachSegment(It first, It last, F&& f)
+    {
+      using S = Segments<It>;
+      auto from = S::segment(first), to = S::segment(last);
+      if(from == to){
+        f(S::local(first), S::local(last));
+        return;
+      }
+      if(!f(S::local(first), S::end(from)))
+        return;
+      for(++from; from != to; ++from)
+        if(!f(S::begin(from), S::end(from)))
+          return;
+      f(S::begin(to), S::local(last));
+    }
+
+    //
+    // sixteen sums running side by side, for integers (where the order they are added in
+    // doesn't matter); a loop -O2 vectorises. The lanes are unsigned, as a lane can overflow
+    // where the sum in order wouldn't (all the positive values in one lane, the negative in
+    // another); unsigned wraps, and the low bits come out the same whatever the order.
+    // Otherwise one after the other, as std::accumulate.
+    //
+    template<typename P, typename T>
+    T sum(P p, P q, T init)
+    {
+      using V = std::remove_cv_t<std::remove_reference_t<decltype(*p)>>;
+      if constexpr(std::is_integral_v<V> && std::is_integral_v<T> && !std::is_same_v<T, bool>){
+        using U = std::make_unsigned_t<T>;
+        U lanes[16] {};
+        U total = static_cast<U>(init);
+        std::size_t n = q - p, i {0};
+        for(; i + 16 <= n; i += 16)
+          for(std::size_t j {0}; j < 16; ++j)
+            lanes[j] += static_cast<U>(p[i + j]);
+        for(; i < n; ++i)
+          total += static_cast<U>(p[i]);
+        for(U lane : lanes)
+          total += lane;
+        return static_cast<T>(total);
+      }
+      else
+        return std::accumulate(p, q, init);
+    }
+  }
+
+  template<typename In, typename Out>
+  Out copy(In first, In last, Out out)
+  {
+    if constexpr(isSegmented<In>){
+      detail::eachSegment(first, last, [&](auto p, auto q){
+        out = segmented::copy(p, q, out);
+        return true;
+      });
+      return out;
+    }
+    //
+    // into a segmented range from a random access one; as much as fits in each block at once.
+    //
+    else if constexpr(isSegmented<Out> &&
+                      std::is_base_of_v<std::random_access_iterator_tag,
+                                        typename std::iterator_traits<In>::iterator_category>){
+      using S = Segments<Out>;
+      while(first != last){
+        auto room = S::end(S::segment(out)) - S::local(out);
+        auto n = std::min<std::ptrdiff_t>(room, last - first);
+        mycopy(first, first + n, S::local(out));
+        first += n;
+        out += n;
+      }
+      return out;
+    }
+    else
+      return mycopy(first, last, out);
+  }
+
+  template<typename It, typename T>
+  void fill(It first, It last, const T& value)
+  {
+    if constexpr(isSegmented<It>)
+      detail::eachSegment(first, last, [&](auto p, auto q){
+        std::fill(p, q, value);
+        return true;
+      });
+    else
+      std::fill(first, last, value);
+  }
+
+  template<typename It, typename T>
+  T accumulate(It first, It last, T init)
+  {
+    if constexpr(isSegmented<It>){
+      detail::eachSegment(first, last, [&](auto p, auto q){
+        init = detail::sum(p, q, init);
+        return true;
+      });
+      return init;
+    }
+    else if constexpr(std::is_pointer_v<It>)
+      return detail::sum(first, last, init);
+    else
+      return std::accumulate(first, last, init);
+  }
+
+  template<typename It, typename T>
+  It find(It first, It last, const T& value)
+  {
+    if constexpr(isSegmented<It>){
+      std::ptrdiff_t before {0};
+      bool found {false};
+      detail::eachSegment(first, last, [&](auto p, auto q){
+        auto at = std::find(p, q, value);
+        before += at - p;
+        found = at != q;
+        return !found;
+      });
+      return found ? first + before : last;
+    }
+    else
+      return std::find(first, last, value);
+  }
+}
+
+#endif
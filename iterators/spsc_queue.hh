@@ -0,0 +1,95 @@
+#ifndef _SPSC_QUEUE_HH_
+#define _SPSC_QUEUE_HH_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//
+// A bounded single producer, single consumer queue; one thread pushes, one other thread
+// pops, and neither takes a lock. The producer owns the tail and the consumer the head, each
+// on a cache line of its own, and each only reads the other's; an item is written before
+// the tail is released past it, and read before the head is released past it.
+//
+// push and pop don't wait, they say whether they could; a thread with nothing to do waits on
+// an Event, a futex, which the other thread notifies after pushing or popping. The waiter
+// takes the Event's count before looking at the queue, so a notify between looking and
+// waiting makes the wait return at once rather than sleep through it.
+//
+
+template<typename T>
+class SpscQueue
+{
+public:
+  //
+  // capacity rounded up to a power of two.
+  //
+  explicit SpscQueue(std::size_t capacity)
+  {
+    while(_size < capacity)
+      _size *= 2;
+    _items.reset(new T[_size]);
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  std::size_t capacity() const
+  { return _size; }
+
+  bool push(const T& item)
+  {
+    std::size_t tail = _tail.load(std::memory_order_relaxed);
+    if(tail - _head.load(std::memory_order_acquire) == _size)
+      return false;
+    _items[tail & (_size - 1)] = item;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& item)
+  {
+    std::size_t head = _head.load(std::memory_order_relaxed);
+    if(head == _tail.load(std::memory_order_acquire))
+      return false;
+    item = _items[head & (_size - 1)];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  alignas(64) std::atomic<std::size_t> _head {0};
+  alignas(64) std::atomic<std::size_t> _tail {0};
+  alignas(64) std::size_t _size {1};
+  std::unique_ptr<T[]> _items;
+};
+
+class Event
+{
+public:
+  std::uint32_t count() const
+  { return _count.load(std::memory_order_acquire); }
+
+  //
+  // sleep unless there has been a notify since count() returned seen; it may also return
+  // for no reason, so look again.
+  //
+  void wait(std::uint32_t seen)
+  { syscall(SYS_futex, &_count, FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0); }
+
+  void notify()
+  {
+    _count.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, &_count, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+  }
+
+private:
+  std::atomic<std::uint32_t> _count {0};
+};
+
+#endif
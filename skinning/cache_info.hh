@@ -0,0 +1,204 @@
+#ifndef _CACHE_INFO_HH_
+#define _CACHE_INFO_HH_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+//
+// Runtime cache topology.
+//
+// Q13 sizes its buffers with HALF_CACHE_SIZE and QUARTER_CACHE_SIZE as if the cache was
+// known at compile time, which it is on a console but not on a PC where the same binary can
+// run on a machine with a 32KiB or a 48KiB L1 and anything from 256KiB to 2MiB of L2.
+//
+// So, ask the OS first. On linux the kernel exports what cpuid told it under,
+//
+//   /sys/devices/system/cpu/cpu0/cache/indexN/{level,type,size,coherency_line_size}
+//
+// and if that is not there (containers, odd kernels, not linux) measure it. The measurement
+// is the classic pointer chase; walk a random cycle through a buffer so every load depends on
+// the last one and the prefetchers cannot guess the next address, then grow the buffer and
+// look for the sizes at which the time per load jumps.
+//
+
+struct CacheLevel
+{
+  int level;              // 1, 2, 3...
+  std::size_t size;       // bytes
+  std::size_t lineSize;   // bytes
+};
+
+struct CacheTopology
+{
+  std::vector<CacheLevel> levels;   // data/unified caches only, smallest level first.
+  bool measured {false};            // true if from the pointer chase rather than sysfs.
+
+  //
+  // size of the given level, or if we don't know that one, of the nearest level below it
+  // that we do (a chunk sized from it still fits). 0 if we know of none at or below it.
+  //
+  std::size_t size(int level) const
+  {
+    std::size_t s {0};
+    for(const CacheLevel& l : levels)
+      if(l.level <= level)
+        s = l.size;
+    return s;
+  }
+
+  std::size_t lineSize() const
+  { return levels.empty() ? 64 : levels.front().lineSize; }
+
+  std::size_t lastLevelSize() const
+  { return levels.empty() ? 0 : levels.back().size; }
+};
+
+namespace cache_detail
+{
+  inline bool readFile(const std::string& path, std::string& out)
+  {
+    std::ifstream f {path};
+    if(!f)
+      return false;
+    std::getline(f, out);
+    return !out.empty();
+  }
+
+  //
+  // sysfs sizes look like "48K" or "2048K", very occasionally "1M".
+  //
+  inline std::size_t parseSize(const std::string& s)
+  {
+    std::size_t value {0}, i {0};
+    while(i < s.size() && s[i] >= '0' && s[i] <= '9')
+      value = value * 10 + (s[i++] - '0');
+    if(i < s.size()){
+      if(s[i] == 'K') value <<= 10;
+      else if(s[i] == 'M') value <<= 20;
+      else if(s[i] == 'G') value <<= 30;
+    }
+    return value;
+  }
+
+  //
+  // average ns per load when chasing a random cycle through bytes of memory with one
+  // pointer per line.
+  //
+  inline double chase(std::size_t bytes, std::size_t lineSize, std::mt19937& rng)
+  {
+    std::size_t lines = std::max<std::size_t>(bytes / lineSize, 2);
+    std::size_t stride = lineSize / sizeof(void*);
+    std::vector<void*> mem(lines * stride);
+    std::vector<std::size_t> order(lines);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin() + 1, order.end(), rng);
+    for(std::size_t i {0}; i < lines; ++i)
+      mem[order[i] * stride] = &mem[order[(i + 1) % lines] * stride];
+
+    constexpr std::size_t steps {1 << 21};
+    void **p = reinterpret_cast<void**>(mem[0]);
+    for(std::size_t i {0}; i < lines; ++i)           // warm up
+      p = reinterpret_cast<void**>(*p);
+    auto t0 = std::chrono::steady_clock::now();
+    for(std::size_t i {0}; i < steps; ++i)
+      p = reinterpret_cast<void**>(*p);
+    auto t1 = std::chrono::steady_clock::now();
+
+    //
+    // make the chase observable so the compiler cannot throw it away.
+    //
+    static void* volatile sink;
+    sink = p;
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / steps;
+  }
+}
+
+inline CacheTopology readSysfsCacheTopology()
+{
+  using namespace cache_detail;
+  CacheTopology topo;
+  const std::string base {"/sys/devices/system/cpu/cpu0/cache/index"};
+  for(int i {0}; i < 16; ++i){
+    std::string dir = base + std::to_string(i) + "/";
+    std::string level, type, size, line;
+    if(!readFile(dir + "level", level))
+      break;
+    if(!readFile(dir + "type", type) || !readFile(dir + "size", size))
+      continue;
+    if(type == "Instruction")
+      continue;
+    std::size_t lineSize {64};
+    if(readFile(dir + "coherency_line_size", line))
+      lineSize = parseSize(line);
+    std::size_t bytes = parseSize(size);
+    if(bytes == 0)
+      continue;
+    topo.levels.push_back({std::stoi(level), bytes, lineSize ? lineSize : 64});
+  }
+  std::sort(topo.levels.begin(), topo.levels.end(),
+            [](const CacheLevel& a, const CacheLevel& b){ return a.level < b.level; });
+  return topo;
+}
+
+//
+// the fallback. A level boundary is where the latency rises more than 40% above that of the
+// current plateau; the size before the rise is taken as the size of the level. Sizes step
+// by 2x so the answer is only ever a power of 2, which is near enough for picking chunks.
+//
+inline CacheTopology measureCacheTopology(std::size_t maxBytes = std::size_t{64} << 20)
+{
+  CacheTopology topo;
+  topo.measured = true;
+  constexpr std::size_t lineSize {64};
+  std::mt19937 rng {1234};
+
+  double plateau = cache_detail::chase(std::size_t{4} << 10, lineSize, rng);
+  std::size_t prev {std::size_t{4} << 10};
+  for(std::size_t bytes {prev * 2}; bytes <= maxBytes && topo.levels.size() < 3; bytes *= 2){
+    double ns = cache_detail::chase(bytes, lineSize, rng);
+    if(ns > plateau * 1.4){
+      topo.levels.push_back({static_cast<int>(topo.levels.size()) + 1, prev, lineSize});
+      plateau = ns;
+    }
+    prev = bytes;
+  }
+  return topo;
+}
+
+//
+// sysfs if we can, else measure. Done once, the first call pays for it.
+//
+inline const CacheTopology& cacheTopology()
+{
+  static const CacheTopology topo = []{
+    CacheTopology t = readSysfsCacheTopology();
+    return t.levels.empty() ? measureCacheTopology() : t;
+  }();
+  return topo;
+}
+
+//
+// The chunk size for a streaming kernel which keeps 'buffers' equal sized buffers resident
+// in the given cache level. Half the level is left for everything else (the bone palette,
+// the stack, the other hyperthread) which is what the sweep in chunk_sweep.cc suggests is
+// about right. Rounded down to whole lines.
+//
+inline std::size_t streamingChunkBytes(int buffers, int level = 1)
+{
+  const CacheTopology& topo = cacheTopology();
+  std::size_t budget = topo.size(level);
+  if(budget == 0)
+    budget = 32 * 1024;
+  std::size_t bytes = budget / 2 / buffers;
+  std::size_t line = topo.lineSize();
+  return std::max(line, bytes / line * line);
+}
+
+#endif
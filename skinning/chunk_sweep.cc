@@ -0,0 +1,71 @@
+//
+// Sweeps the chunk size of the Q13 Answer 1 skinning loop to check the chunk size picked by
+// streamingChunkBytes (cache_info.hh) is somewhere near the best one on this machine.
+//
+// Also prints what sysfs says about the caches next to what the pointer chase measures, so
+// the fallback can be sanity checked on a machine where sysfs does work.
+//
+
+#include "skinning.hh"
+#include "cache_info.hh"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+void printTopology(const char* name, const CacheTopology& topo)
+{
+  std::cout << name << ":";
+  for(const CacheLevel& l : topo.levels)
+    std::cout << " L" << l.level << "=" << (l.size >> 10) << "KiB";
+  std::cout << std::endl;
+}
+
+int main()
+{
+  printTopology("sysfs", readSysfsCacheTopology());
+  printTopology("measured", measureCacheTopology());
+
+  constexpr u32 numVerts {2'000'000};      // 88MB each way, well past the LLC on most things.
+  std::mt19937 rng {7};
+  std::vector<vert> in(numVerts), out(numVerts);
+  std::vector<mat34> palette(numBones);
+  makeCharacter(in.data(), numVerts, rng);
+  makePalette(palette.data(), rng);
+
+  std::size_t chosen = streamingChunkBytes(2);
+  std::cout << "streamingChunkBytes(2): " << chosen << " bytes ("
+            << chosen / sizeof(vert) << " verts)" << std::endl;
+
+  std::vector<std::size_t> sizes;
+  for(std::size_t bytes {1024}; bytes <= (std::size_t{8} << 20); bytes *= 2)
+    sizes.push_back(bytes);
+  sizes.push_back(chosen);
+
+  long long best {-1}, chosenUs {0};
+  std::size_t bestBytes {0};
+  for(std::size_t bytes : sizes){
+    u32 chunkVerts = static_cast<u32>(bytes / sizeof(vert));
+    std::vector<vert> input(chunkVerts), output(chunkVerts);
+    long long us {-1};
+    for(int r {0}; r < 5; ++r){
+      auto t0 = std::chrono::steady_clock::now();
+      skinCharacter(out.data(), in.data(), numVerts, palette.data(), input.data(),
+                    output.data(), chunkVerts);
+      auto t1 = std::chrono::steady_clock::now();
+      long long t = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+      if(us < 0 || t < us)
+        us = t;
+    }
+    std::cout << (bytes == chosen ? "* " : "  ") << "chunk " << bytes << " bytes: "
+              << us << "us" << std::endl;
+    if(bytes == chosen)
+      chosenUs = us;
+    if(best < 0 || us < best){
+      best = us;
+      bestBytes = bytes;
+    }
+  }
+  std::cout << "best: " << bestBytes << " bytes, chosen is "
+            << 100.0 * (chosenUs - best) / best << "% slower" << std::endl;
+}
@@ -0,0 +1,186 @@
+//
+// Answer 2 of Q13 (callbacks) on top of the job system in job_system.hh, and a benchmark that
+// skins 1000 characters at once using every core.
+//
+// Each character is split into chunks and each chunk into 3 jobs,
+//
+//   in(i)   'streamIntoCache', copy chunk i into the character's staging slot i%2.
+//   skin(i) skin the staging input into the staging output.
+//   out(i)  'streamOutOfCache', copy the staging output to the output array.
+//
+// with the dependencies,
+//
+//   in(i) -> skin(i) -> out(i)      the transfer completing schedules the skin and so on.
+//   skin(i) -> in(i+2)              the input slot is free once skin(i) has read it.
+//   out(i) -> skin(i+2)             the output slot is free once out(i) has copied it.
+//
+// so with 2 slots per character the next transfer in overlaps the current skin, which is the
+// background/alive buffer idea from the end of Q13.cpp, and no thread ever waits on a
+// transfer; it just goes and does someone else's work.
+//
+
+#include "skinning.hh"
+#include "job_system.hh"
+#include "cache_info.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+//
+// the question's 'cache' budget; each character gets 2 slots of input+output buffers, i.e.
+// 4 buffers each what was QUARTER_CACHE_SIZE, now sized from the real L1 at startup.
+//
+const u32 chunkVerts = static_cast<u32>(streamingChunkBytes(4) / sizeof(vert));
+
+constexpr int numCharacters {1000};
+constexpr u32 vertsPerCharacter {2048};
+
+struct Character
+{
+  const vert *in;
+  vert *out;
+  u32 numVerts;
+  const mat34 *palette;
+  vert *staging;      // [slot][input|output][chunkVerts]
+
+  vert* input(u32 slot)
+  { return staging + (slot * 2 + 0) * chunkVerts; }
+
+  vert* output(u32 slot)
+  { return staging + (slot * 2 + 1) * chunkVerts; }
+};
+
+struct ChunkData
+{
+  Character *character;
+  u32 first;
+  u32 n;
+  u32 slot;
+};
+
+void transferIn(Job&, const void* data)
+{
+  auto& d = *static_cast<const ChunkData*>(data);
+  std::memcpy(d.character->input(d.slot), d.character->in + d.first, d.n * sizeof(vert));
+}
+
+void skin(Job&, const void* data)
+{
+  auto& d = *static_cast<const ChunkData*>(data);
+  vert *input = d.character->input(d.slot);
+  vert *output = d.character->output(d.slot);
+  for(u32 i {0}; i < d.n; ++i)
+    skinVertex(&output[i], &input[i], d.character->palette);
+}
+
+void transferOut(Job&, const void* data)
+{
+  auto& d = *static_cast<const ChunkData*>(data);
+  std::memcpy(d.character->out + d.first, d.character->output(d.slot), d.n * sizeof(vert));
+}
+
+void empty(Job&, const void*)
+{}
+
+//
+// builds the job graph for one character, all jobs are children of root.
+//
+void skinCharacter(JobSystem& js, Character& c, Job* root)
+{
+  u32 numChunks = (c.numVerts + chunkVerts - 1) / chunkVerts;
+  std::vector<Job*> jobs(numChunks * 3);
+  for(u32 i {0}; i < numChunks; ++i){
+    ChunkData d {&c, i * chunkVerts, std::min(chunkVerts, c.numVerts - i * chunkVerts), i % 2};
+    Job *in = jobs[i * 3 + 0] = js.createJob(&transferIn, d, root);
+    Job *sk = jobs[i * 3 + 1] = js.createJob(&skin, d, root);
+    Job *out = jobs[i * 3 + 2] = js.createJob(&transferOut, d, root);
+    js.addContinuation(in, sk);
+    js.addContinuation(sk, out);
+    if(i >= 2){
+      js.addDependency(in, jobs[(i - 2) * 3 + 1]);
+      js.addDependency(sk, jobs[(i - 2) * 3 + 2]);
+    }
+  }
+  for(Job* job : jobs)
+    js.run(job);
+}
+
+template<typename F>
+long long bestOf(int runs, F&& f)
+{
+  long long best {-1};
+  for(int r {0}; r < runs; ++r){
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto t1 = std::chrono::steady_clock::now();
+    long long us = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+    if(best < 0 || us < best)
+      best = us;
+  }
+  return best;
+}
+
+int main()
+{
+  std::mt19937 rng {42};
+  std::size_t total = std::size_t{numCharacters} * vertsPerCharacter;
+  std::vector<vert> in(total), expected(total), out(total);
+  std::vector<mat34> palettes(std::size_t{numCharacters} * numBones);
+  std::vector<vert> staging(std::size_t{numCharacters} * 4 * chunkVerts);
+  for(int c {0}; c < numCharacters; ++c){
+    makeCharacter(&in[c * vertsPerCharacter], vertsPerCharacter, rng);
+    makePalette(&palettes[c * numBones], rng);
+  }
+
+  std::vector<Character> characters(numCharacters);
+  for(int c {0}; c < numCharacters; ++c)
+    characters[c] = Character {&in[c * vertsPerCharacter], &out[c * vertsPerCharacter],
+                               vertsPerCharacter, &palettes[c * numBones],
+                               &staging[c * 4 * chunkVerts]};
+
+  //
+  // Answer 1 on a single thread as the baseline (and the reference output).
+  //
+  long long serial = bestOf(5, [&]{
+    for(int c {0}; c < numCharacters; ++c)
+      skinCharacter(&expected[c * vertsPerCharacter], &in[c * vertsPerCharacter],
+                    vertsPerCharacter, &palettes[c * numBones], characters[c].input(0),
+                    characters[c].output(0), chunkVerts);
+  });
+  std::cout << "chunk: " << chunkVerts << " verts, " << numCharacters << " characters of "
+            << vertsPerCharacter << " verts" << std::endl;
+  std::cout << "serial (answer 1): " << serial << "us" << std::endl;
+
+  //
+  // now the chunk size comes from the machine the number of jobs per character is not known
+  // up front; a small L1 could mean more jobs than fit in the job ring buffer. So characters
+  // are submitted in waves which each use at most half the ring. A wave is still hundreds of
+  // characters, plenty to keep every core busy.
+  //
+  std::size_t jobsPerCharacter = 3 * ((vertsPerCharacter + chunkVerts - 1) / chunkVerts);
+  std::size_t perWave = std::max<std::size_t>(1, JobSystem::jobsPerThread / 2 / jobsPerCharacter);
+
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  for(unsigned workers : {1u, cores}){
+    JobSystem js {workers};
+    std::fill(out.begin(), out.end(), vert{});
+    long long us = bestOf(5, [&]{
+      for(std::size_t first {0}; first < characters.size(); first += perWave){
+        std::size_t last = std::min(characters.size(), first + perWave);
+        Job *root = js.createJob(&empty);
+        for(std::size_t c {first}; c < last; ++c)
+          skinCharacter(js, characters[c], root);
+        js.run(root);
+        js.wait(root);
+      }
+    });
+    assert(std::memcmp(out.data(), expected.data(), total * sizeof(vert)) == 0);
+    std::cout << "job system, " << workers << " worker(s): " << us << "us ("
+              << static_cast<double>(serial) / us << "x)" << std::endl;
+    if(cores == 1)
+      break;
+  }
+}
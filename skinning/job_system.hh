@@ -0,0 +1,477 @@
+#ifndef _JOB_SYSTEM_HH_
+#define _JOB_SYSTEM_HH_
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//
+// A small work-stealing job system.
+//
+// This is my attempt at Answer 2 of Q13 (callbacks) done properly. Rather than the skinning
+// function waiting on transfers, each transfer is a job and the skinning of a chunk is a
+// continuation of that transfer; so whoever finishes the transfer schedules the skin and the
+// thread that would have waited just picks up other work instead (the 'while(worktoDo)' loop
+// from the question).
+//
+// The design is the usual one (see Stefan Reinalter's Molecule Engine job system posts),
+//
+//  - every worker thread owns a Chase-Lev deque of jobs. The owner pushes and pops at the
+//    bottom (LIFO, good for cache), idle workers steal from the top (FIFO) of a random victim.
+//
+//  - a job has a parent; a parent is not finished until all its children are. This is how
+//    you wait on a whole batch of work, i.e. wait(root).
+//
+//  - a job may depend on other jobs. A dependent job is pushed onto a deque by whichever
+//    thread finishes its last prerequisite. A continuation is just a job with one dependency.
+//
+//  - a worker with nothing to do keeps trying for a little while (idleSpins tries, yielding
+//    in between) and then sleeps on a futex, which schedule() wakes; so a system with nothing
+//    to run costs nothing. A thread in wait() does the same, and is woken by any job
+//    finishing.
+//
+// Jobs are allocated from a per-thread ring buffer and never freed, thus at most
+// JobSystem::jobsPerThread jobs may be alive per creating thread at any one time. This is
+// checked with an assert when a slot is reused.
+//
+// Only the system's own threads may create, run or wait on its jobs; that is the thread which
+// constructed it (worker 0) and the jobs themselves, on the workers it started. Each of them
+// owns a ring and a deque which nobody else pushes to, so a job can't be handed to a system
+// from any other thread; that is asserted. A job of one system may use another, it is then
+// that system's worker 0 (its constructing thread) which must be the one doing it.
+//
+
+//
+// Chase-Lev deque with the memory orderings from,
+//   "Correct and Efficient Work-Stealing for Weak Memory Models", Le et al. 2013.
+//
+// The buffer is fixed size (no growing) thus push can fail, the caller must then handle the
+// item some other way (the job system just runs the job there and then).
+//
+template<typename T, std::size_t Capacity>
+class WorkStealingDeque
+{
+  static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of 2");
+  static_assert(std::is_pointer_v<T>, "deque holds pointers, nullptr means empty");
+
+public:
+
+  // owner only
+  bool push(T item)
+  {
+    std::int64_t b = _bottom.load(std::memory_order_relaxed);
+    std::int64_t t = _top.load(std::memory_order_acquire);
+    if(b - t >= static_cast<std::int64_t>(Capacity))
+      return false;
+    _buffer[b & mask].store(item, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // owner only
+  T pop()
+  {
+    std::int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t t = _top.load(std::memory_order_relaxed);
+    if(t > b){
+      _bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T item = _buffer[b & mask].load(std::memory_order_relaxed);
+    if(t == b){
+      //
+      // last item, race any thieves for it.
+      //
+      if(!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed))
+        item = nullptr;
+      _bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // any thread
+  T steal()
+  {
+    std::int64_t t = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t b = _bottom.load(std::memory_order_acquire);
+    if(t >= b)
+      return nullptr;
+    T item = _buffer[t & mask].load(std::memory_order_relaxed);
+    if(!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed))
+      return nullptr;
+    return item;
+  }
+
+  // any thread; only a guess, it may not be true by the time it returns.
+  bool empty() const
+  { return _top.load(std::memory_order_acquire) >= _bottom.load(std::memory_order_acquire); }
+
+private:
+  static constexpr std::int64_t mask {Capacity - 1};
+
+  alignas(64) std::atomic<std::int64_t> _top {0};
+  alignas(64) std::atomic<std::int64_t> _bottom {0};
+  alignas(64) std::atomic<T> _buffer[Capacity] {};
+};
+
+struct Job;
+using JobFunction = void (*)(Job&, const void* data);
+
+//
+// sized to 3 cache lines so jobs never share a line with another job (false sharing on the
+// counters would be nasty).
+//
+struct alignas(64) Job
+{
+  static constexpr int maxContinuations {6};
+  static constexpr int dataSize {96};
+
+  JobFunction function;
+  Job* parent;
+  std::atomic<int> unfinished;        // 1 for this job + 1 per unfinished child.
+  std::atomic<int> pending;           // unfinished dependencies + 1 until the job is run.
+  std::atomic<int> continuationCount;
+  Job* continuations[maxContinuations];
+  alignas(16) unsigned char data[dataSize];
+
+  template<typename T>
+  const T& as() const
+  { return *reinterpret_cast<const T*>(data); }
+};
+
+static_assert(sizeof(Job) == 192);
+
+namespace job_detail
+{
+  //
+  // a futex word; wait(seen) sleeps unless there has been a notify since count() returned
+  // seen, so taking the count before looking for work means a notify in between isn't lost.
+  // It may also return for no reason.
+  //
+  class Event
+  {
+  public:
+    std::uint32_t count() const
+    { return _count.load(std::memory_order_acquire); }
+
+    void wait(std::uint32_t seen)
+    { syscall(SYS_futex, &_count, FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0); }
+
+    void notify(int threads)
+    {
+      _count.fetch_add(1, std::memory_order_release);
+      syscall(SYS_futex, &_count, FUTEX_WAKE_PRIVATE, threads, nullptr, nullptr, 0);
+    }
+
+  private:
+    std::atomic<std::uint32_t> _count {0};
+  };
+}
+
+class JobSystem
+{
+public:
+  static constexpr std::size_t jobsPerThread {1 << 16};
+  static constexpr std::size_t dequeCapacity {1 << 16};
+  static constexpr unsigned idleSpins {64};
+
+  //
+  // workers includes the calling thread, which becomes worker 0 and does work when it calls
+  // wait. 0 means one worker per hardware thread.
+  //
+  explicit JobSystem(unsigned workers = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  //
+  // jobs are created in a held state; they will not run until run() is called on them and
+  // all their dependencies have finished. Dependencies must be added before run() is called
+  // on either job.
+  //
+  Job* createJob(JobFunction function, Job* parent = nullptr);
+
+  template<typename T>
+  Job* createJob(JobFunction function, const T& data, Job* parent = nullptr)
+  {
+    static_assert(sizeof(T) <= Job::dataSize, "job data too large");
+    static_assert(std::is_trivially_copyable_v<T>, "job data is memcpy'd");
+    Job* job = createJob(function, parent);
+    std::memcpy(job->data, &data, sizeof(T));
+    return job;
+  }
+
+  // job will not run until prerequisite (and all its children) have finished.
+  void addDependency(Job* job, Job* prerequisite);
+
+  // a continuation is scheduled when job (and its children) finish.
+  void addContinuation(Job* job, Job* continuation)
+  { addDependency(continuation, job); }
+
+  // release the hold placed on the job by createJob.
+  void run(Job* job);
+
+  // do work until job (and all its children) are finished.
+  void wait(const Job* job);
+
+  static bool isFinished(const Job* job)
+  { return job->unfinished.load(std::memory_order_acquire) == 0; }
+
+  unsigned workerCount() const
+  { return static_cast<unsigned>(_workers.size()); }
+
+private:
+  struct alignas(64) Worker
+  {
+    WorkStealingDeque<Job*, dequeCapacity> deque;
+    std::unique_ptr<Job[]> jobs;
+    std::size_t nextJob {0};
+    std::uint32_t rng {0};
+  };
+
+  void workerMain(unsigned index);
+  Job* getJob(Worker& self);
+  void execute(Job* job);
+  void finish(Job* job);
+  void schedule(Job* job);
+  Worker& thisWorker();
+  bool anyWork() const;
+
+  template<typename Ready>
+  void sleepUnless(job_detail::Event& event, std::atomic<unsigned>& sleepers, Ready&& ready);
+
+  std::vector<std::unique_ptr<Worker>> _workers;
+  std::vector<std::thread> _threads;
+  std::thread::id _owner {std::this_thread::get_id()};
+  std::atomic<bool> _running {true};
+
+  alignas(64) job_detail::Event _work;        // a job was scheduled
+  job_detail::Event _finished;                // a job finished
+  std::atomic<unsigned> _sleeping {0};        // workers asleep on _work
+  std::atomic<unsigned> _waiting {0};         // threads in wait() asleep on _finished
+};
+
+//
+// the implementation; header only so each experiment is still just 'g++ file.cc'.
+//
+
+namespace job_detail
+{
+  //
+  // which system's worker this thread is, if any; a thread is a worker of at most one.
+  //
+  struct WorkerId
+  {
+    const JobSystem* system;
+    unsigned index;
+  };
+
+  inline thread_local WorkerId t_worker {nullptr, 0};
+}
+
+inline JobSystem::JobSystem(unsigned workers)
+{
+  if(workers == 0)
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  for(unsigned i {0}; i < workers; ++i){
+    auto w = std::make_unique<Worker>();
+    w->jobs = std::make_unique<Job[]>(jobsPerThread);
+    w->rng = 0x9e3779b9u * (i + 1);
+    _workers.push_back(std::move(w));
+  }
+  for(unsigned i {1}; i < workers; ++i)
+    _threads.emplace_back(&JobSystem::workerMain, this, i);
+}
+
+inline JobSystem::~JobSystem()
+{
+  _running.store(false, std::memory_order_relaxed);
+  _work.notify(INT_MAX);
+  for(auto& t : _threads)
+    t.join();
+}
+
+inline JobSystem::Worker& JobSystem::thisWorker()
+{
+  if(job_detail::t_worker.system == this)
+    return *_workers[job_detail::t_worker.index];
+  assert(std::this_thread::get_id() == _owner && "job system used from a thread not its own");
+  return *_workers[0];
+}
+
+inline Job* JobSystem::createJob(JobFunction function, Job* parent)
+{
+  Worker& w = thisWorker();
+  Job* job = &w.jobs[w.nextJob++ & (jobsPerThread - 1)];
+  assert(job->unfinished.load(std::memory_order_relaxed) == 0 && "job ring buffer overrun");
+  job->function = function;
+  job->parent = parent;
+  job->unfinished.store(1, std::memory_order_relaxed);
+  job->pending.store(1, std::memory_order_relaxed);
+  job->continuationCount.store(0, std::memory_order_relaxed);
+  if(parent)
+    parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+  return job;
+}
+
+inline void JobSystem::addDependency(Job* job, Job* prerequisite)
+{
+  int i = prerequisite->continuationCount.fetch_add(1, std::memory_order_relaxed);
+  assert(i < Job::maxContinuations && "too many continuations");
+  prerequisite->continuations[i] = job;
+  job->pending.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void JobSystem::run(Job* job)
+{
+  if(job->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    schedule(job);
+}
+
+inline void JobSystem::schedule(Job* job)
+{
+  if(!thisWorker().deque.push(job)){
+    execute(job);
+    return;
+  }
+  //
+  // the push then the look at _sleeping, against a sleeper's add to _sleeping then its look
+  // at the deques (sleepUnless); with a fence between each pair one of them sees the other's.
+  //
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(_sleeping.load(std::memory_order_relaxed) > 0)
+    _work.notify(1);
+}
+
+inline void JobSystem::execute(Job* job)
+{
+  job->function(*job, job->data);
+  finish(job);
+}
+
+inline void JobSystem::finish(Job* job)
+{
+  //
+  // read everything we need before anybody can see this job as finished, the creating thread
+  // may reuse the slot as soon as it does. This is safe as the contract is no dependencies
+  // are added once a job has been run.
+  //
+  Job* parent = job->parent;
+  int count = job->continuationCount.load(std::memory_order_relaxed);
+  Job* continuations[Job::maxContinuations];
+  for(int i {0}; i < count; ++i)
+    continuations[i] = job->continuations[i];
+
+  if(job->unfinished.fetch_sub(1, std::memory_order_seq_cst) != 1)
+    return;
+  if(_waiting.load(std::memory_order_seq_cst) > 0)
+    _finished.notify(INT_MAX);
+
+  for(int i {0}; i < count; ++i)
+    run(continuations[i]);
+  if(parent)
+    finish(parent);
+}
+
+inline Job* JobSystem::getJob(Worker& self)
+{
+  if(Job* job = self.deque.pop())
+    return job;
+
+  std::size_t n = _workers.size();
+  if(n == 1)
+    return nullptr;
+
+  //
+  // xorshift32 to pick a victim.
+  //
+  self.rng ^= self.rng << 13;
+  self.rng ^= self.rng >> 17;
+  self.rng ^= self.rng << 5;
+  Worker& victim = *_workers[self.rng % n];
+  if(&victim == &self)
+    return nullptr;
+  return victim.deque.steal();
+}
+
+inline bool JobSystem::anyWork() const
+{
+  for(auto& w : _workers)
+    if(!w->deque.empty())
+      return true;
+  return false;
+}
+
+//
+// sleep on event unless ready() says there's a reason not to, counted in sleepers while
+// asleep so whoever would wake us knows to.
+//
+template<typename Ready>
+void JobSystem::sleepUnless(job_detail::Event& event, std::atomic<unsigned>& sleepers,
+                            Ready&& ready)
+{
+  sleepers.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  std::uint32_t seen = event.count();
+  if(!ready())
+    event.wait(seen);
+  sleepers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+inline void JobSystem::wait(const Job* job)
+{
+  Worker& self = thisWorker();
+  unsigned idle {0};
+  while(!isFinished(job)){
+    if(Job* next = getJob(self)){
+      execute(next);
+      idle = 0;
+    }
+    else if(++idle < idleSpins)
+      std::this_thread::yield();
+    else{
+      sleepUnless(_finished, _waiting, [&]{ return isFinished(job) || anyWork(); });
+      idle = 0;
+    }
+  }
+}
+
+inline void JobSystem::workerMain(unsigned index)
+{
+  job_detail::t_worker = {this, index};
+  Worker& self = *_workers[index];
+  unsigned idle {0};
+  while(_running.load(std::memory_order_relaxed)){
+    if(Job* job = getJob(self)){
+      execute(job);
+      idle = 0;
+    }
+    else if(++idle < idleSpins)
+      std::this_thread::yield();
+    else{
+      sleepUnless(_work, _sleeping, [&]{
+        return !_running.load(std::memory_order_relaxed) || anyWork();
+      });
+      idle = 0;
+    }
+  }
+}
+
+#endif
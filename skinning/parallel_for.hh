@@ -0,0 +1,141 @@
+#ifndef _PARALLEL_FOR_HH_
+#define _PARALLEL_FOR_HH_
+
+#include "job_system.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+//
+// parallelFor over an index range, on the job system (job_system.hh) so the threads are the
+// ones already there rather than new ones per loop.
+//
+//   parallelFor(js, 0, n, [&](std::size_t first, std::size_t last){ ... }, options);
+//
+// The body gets a range rather than an index so its inner loop is the same tight loop it
+// would be on one thread (addToAll's SIMD kernels take a pointer and a count).
+//
+// Two ways to cut the range up, as OpenMP has;
+//
+//  - equal; one chunk per worker, all the same size. Cheapest, and best when every index
+//    costs the same and every worker is free.
+//  - guided; one job per worker which keeps taking chunks from a shared cursor until there
+//    are none left, each chunk the remaining work / (2 * workers), so big chunks first and
+//    small ones at the end to even up a worker which started late or got descheduled.
+//
+// Every split point is a multiple of options.align indices (counted from 0, not from first)
+// so if index 0 is at the start of a cache line and align indices are a whole number of
+// lines, no two workers ever write to the same line; for floats that's 16, for Q16's 12
+// byte vec3s it is also 16 (192 bytes, three lines).
+//
+// No chunk is smaller than the grain, except the last. With options.grain 0 it is
+// minGrainIndices; a job costs 42ns on one thread (add_to_all/scaling.cc) and perhaps 100ns
+// once it has been stolen by another core, and 16384 vec3s of the cheapest addToAll there is
+// (SoA, in L1) take about 1µs, ten times that. A range of less than two grains isn't worth
+// splitting at all and runs on the calling thread there and then, as does everything with a
+// single worker.
+//
+
+enum class Chunking {equal, guided};
+
+struct ParallelOptions
+{
+  Chunking chunking {Chunking::equal};
+  std::size_t grain {0};      // 0 for minGrainIndices
+  std::size_t align {16};
+};
+
+constexpr std::size_t minGrainIndices {16384};
+
+namespace parallel_detail
+{
+  template<typename F>
+  struct Loop
+  {
+    const F *body;
+    std::size_t end;
+    std::size_t grain;
+    std::size_t align;
+    std::size_t workers;
+    alignas(64) std::atomic<std::size_t> cursor;
+  };
+
+  struct Range
+  {
+    void *loop;
+    std::size_t first, last;
+  };
+
+  //
+  // up to the next split point, but no further than end.
+  //
+  inline std::size_t alignUp(std::size_t i, std::size_t align, std::size_t end)
+  { return std::min(end, (i + align - 1) / align * align); }
+
+  template<typename F>
+  void equalChunk(Job&, const void* data)
+  {
+    auto& r = *static_cast<const Range*>(data);
+    (*static_cast<Loop<F>*>(r.loop)->body)(r.first, r.last);
+  }
+
+  template<typename F>
+  void guidedWorker(Job&, const void* data)
+  {
+    auto& loop = *static_cast<Loop<F>*>(static_cast<const Range*>(data)->loop);
+    std::size_t first = loop.cursor.load(std::memory_order_relaxed);
+    while(first < loop.end){
+      std::size_t size = std::max(loop.grain, (loop.end - first) / (2 * loop.workers));
+      std::size_t last = alignUp(first + size, loop.align, loop.end);
+      //
+      // if somebody else got there first, first is now where they got to; try again from there.
+      //
+      if(loop.cursor.compare_exchange_weak(first, last, std::memory_order_relaxed)){
+        (*loop.body)(first, last);
+        first = loop.cursor.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  inline void noop(Job&, const void*)
+  {}
+}
+
+template<typename F>
+void parallelFor(JobSystem& js, std::size_t first, std::size_t last, const F& body,
+                 const ParallelOptions& options = {})
+{
+  using namespace parallel_detail;
+  if(first >= last)
+    return;
+  std::size_t n = last - first;
+  std::size_t align = std::max<std::size_t>(1, options.align);
+  std::size_t grain = std::max(align, options.grain ? options.grain : minGrainIndices);
+  std::size_t workers = js.workerCount();
+  if(workers == 1 || n < 2 * grain){
+    body(first, last);
+    return;
+  }
+
+  Loop<F> loop {&body, last, grain, align, workers, {first}};
+  Job *root = js.createJob(&noop);
+  if(options.chunking == Chunking::equal){
+    std::size_t chunks = std::min(workers, n / grain);
+    std::size_t from = first;
+    for(std::size_t c {1}; c <= chunks; ++c){
+      std::size_t to = c == chunks ? last : alignUp(first + n * c / chunks, align, last);
+      if(to > from)
+        js.run(js.createJob(&equalChunk<F>, Range{&loop, from, to}, root));
+      from = to;
+    }
+  }
+  else{
+    for(std::size_t w {0}; w < workers; ++w)
+      js.run(js.createJob(&guidedWorker<F>, Range{&loop, 0, 0}, root));
+  }
+  js.run(root);
+  js.wait(root);
+}
+
+#endif
@@ -0,0 +1,196 @@
+//
+// Error bounds and throughput of the compressed vertex streams in vertex_quant.hh.
+//
+// The asserts are the error bounds,
+//
+//  - decoded positions are within half a quantisation step of the original on each axis.
+//  - decoded normals are within 1e-4 of the original (16 bit octahedral is good to about
+//    0.005 degrees, far better than you would ever see).
+//  - decoded weights are within 1/255 of the original and still sum to exactly 1.
+//  - the skinned output is within the error you get from feeding those decoded values
+//    through the blend, i.e. per vert,
+//
+//      |skinned - reference| <= |dp| + sum_b |dw_b| * |M_b p| + float rounding
+//
+//    which shows the fused SIMD decode is doing the same thing as the scalar decode.
+//  - the skinned normals likewise, within |dn| + sum_b |dw_b| * |R_b n| + float rounding
+//    (R_b the rotation part of the bone's matrix).
+//  - every skinned position and normal is within float rounding of skinVertex on the
+//    decoded vert, the scalar path the last few verts take.
+//
+
+#include "skinning.hh"
+#include "vertex_quant.hh"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+float length(float x, float y, float z)
+{ return std::sqrt(x * x + y * y + z * z); }
+
+//
+// |M p| for a single bone
+//
+float transformedLength(const mat34& M, const float p[3])
+{
+  float r[3];
+  for(int row {0}; row < 3; ++row)
+    r[row] = M.m[row][0] * p[0] + M.m[row][1] * p[1] + M.m[row][2] * p[2] + M.m[row][3];
+  return length(r[0], r[1], r[2]);
+}
+
+//
+// |R n|, R the rotation part of the bone; what a normal goes through.
+//
+float rotatedLength(const mat34& M, const float n[3])
+{
+  float r[3];
+  for(int row {0}; row < 3; ++row)
+    r[row] = M.m[row][0] * n[0] + M.m[row][1] * n[1] + M.m[row][2] * n[2];
+  return length(r[0], r[1], r[2]);
+}
+
+//
+// the skinned vert i in out against v, to within tolerance on every component.
+//
+bool close(const SkinnedVerts& out, u32 i, const vert& v, float tolerance)
+{
+  return std::fabs(out.px[i] - v.position[0]) <= tolerance &&
+         std::fabs(out.py[i] - v.position[1]) <= tolerance &&
+         std::fabs(out.pz[i] - v.position[2]) <= tolerance &&
+         std::fabs(out.nx[i] - v.normal[0]) <= tolerance &&
+         std::fabs(out.ny[i] - v.normal[1]) <= tolerance &&
+         std::fabs(out.nz[i] - v.normal[2]) <= tolerance;
+}
+
+void testErrorBounds(const std::vector<vert>& verts, const mat34 *palette)
+{
+  u32 n = static_cast<u32>(verts.size());
+  QuantisedVerts q = quantise(verts.data(), n);
+  SkinnedVerts out {n};
+  skinQuantised(q, palette, out);
+
+  float worstNormal {0.f}, worstSkinned {0.f}, worstRatio {0.f};
+  float worstSkinnedNormal {0.f}, worstNormalRatio {0.f};
+  for(u32 i {0}; i < n; ++i){
+    const vert& v = verts[i];
+    vert d = dequantise(q, i);
+
+    float dp[3];
+    for(int k {0}; k < 3; ++k){
+      dp[k] = d.position[k] - v.position[k];
+      assert(std::fabs(dp[k]) <= q.boxStep[k] * 0.5f + 1e-6f);
+    }
+
+    float dn = length(d.normal[0] - v.normal[0], d.normal[1] - v.normal[1],
+                      d.normal[2] - v.normal[2]);
+    assert(dn <= 1e-4f);
+    worstNormal = std::max(worstNormal, dn);
+
+    u32 sum {0};
+    float bound = length(dp[0], dp[1], dp[2]) + 1e-5f;
+    float normalBound = dn + 1e-5f;
+    for(int b {0}; b < 4; ++b){
+      u32 wq = (q.weights[i] >> (8 * b)) & 0xff;
+      sum += wq;
+      float dw = std::fabs(wq / 255.f - v.weights[b]);
+      assert(dw < 1.f / 255.f);
+      bound += dw * transformedLength(palette[v.bones[b]], v.position);
+      normalBound += dw * rotatedLength(palette[v.bones[b]], v.normal);
+    }
+    assert(sum == 255);
+
+    vert ref;
+    skinVertex(&ref, &v, palette);
+    float err = length(out.px[i] - ref.position[0], out.py[i] - ref.position[1],
+                       out.pz[i] - ref.position[2]);
+    assert(err <= bound);
+    worstSkinned = std::max(worstSkinned, err);
+    worstRatio = std::max(worstRatio, err / bound);
+
+    float normalErr = length(out.nx[i] - ref.normal[0], out.ny[i] - ref.normal[1],
+                             out.nz[i] - ref.normal[2]);
+    assert(normalErr <= normalBound);
+    worstSkinnedNormal = std::max(worstSkinnedNormal, normalErr);
+    worstNormalRatio = std::max(worstNormalRatio, normalErr / normalBound);
+
+    vert decoded;
+    skinVertex(&decoded, &d, palette);
+    assert(close(out, i, decoded, 1e-5f));
+  }
+  std::cout << "error bounds hold for " << n << " verts; worst normal error " << worstNormal
+            << ", worst skinned position error " << worstSkinned << " (" << worstRatio * 100
+            << "% of its bound), worst skinned normal error " << worstSkinnedNormal << " ("
+            << worstNormalRatio * 100 << "% of its bound)" << std::endl;
+
+  //
+  // and the full precision SIMD kernel matches skinVertex to float rounding.
+  //
+  FloatVerts f = toFloatVerts(verts.data(), n);
+  skinFloat(f, palette, out);
+  for(u32 i {0}; i < n; ++i){
+    vert ref;
+    skinVertex(&ref, &verts[i], palette);
+    assert(close(out, i, ref, 1e-5f));
+  }
+}
+
+template<typename F>
+double bestOfMs(int runs, F&& f)
+{
+  double best {-1.0};
+  for(int r {0}; r < runs; ++r){
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto t1 = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    if(best < 0.0 || ms < best)
+      best = ms;
+  }
+  return best;
+}
+
+void report(const char* name, u32 n, double ms, std::size_t bytesPerVert)
+{
+  std::cout << name << ": " << ms << "ms, " << n / ms / 1e3 << " Mverts/s, "
+            << bytesPerVert << " bytes/vert, " << n * bytesPerVert / ms / 1e6 << " GB/s"
+            << std::endl;
+}
+
+int main()
+{
+  std::mt19937 rng {3};
+  std::vector<mat34> palette(numBones);
+  makePalette(palette.data(), rng);
+
+  //
+  // +3 so the scalar tail gets tested too.
+  //
+  std::vector<vert> small(1'000'003);
+  makeCharacter(small.data(), static_cast<u32>(small.size()), rng);
+  testErrorBounds(small, palette.data());
+
+  constexpr u32 n {8'000'000};
+  std::vector<vert> verts(n), skinned(n);
+  makeCharacter(verts.data(), n, rng);
+  QuantisedVerts q = quantise(verts.data(), n);
+  FloatVerts f = toFloatVerts(verts.data(), n);
+  SkinnedVerts out {n};
+
+  double scalar = bestOfMs(5, [&]{
+    for(u32 i {0}; i < n; ++i)
+      skinVertex(&skinned[i], &verts[i], palette.data());
+  });
+  double simdFloat = bestOfMs(5, [&]{ skinFloat(f, palette.data(), out); });
+  double simdQuant = bestOfMs(5, [&]{ skinQuantised(q, palette.data(), out); });
+
+  report("scalar skinVertex, vert in/out   ", n, scalar, 2 * sizeof(vert));
+  report("simd, float streams in           ", n, simdFloat,
+         FloatVerts::bytesPerVert + SkinnedVerts::bytesPerVert);
+  report("simd, quantised streams in       ", n, simdQuant,
+         QuantisedVerts::bytesPerVert + SkinnedVerts::bytesPerVert);
+  std::cout << "quantised vs float streams: " << simdFloat / simdQuant << "x, input bytes "
+            << static_cast<double>(FloatVerts::bytesPerVert) / QuantisedVerts::bytesPerVert
+            << "x smaller" << std::endl;
+}
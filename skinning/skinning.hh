@@ -0,0 +1,122 @@
+#ifndef _SKINNING_HH_
+#define _SKINNING_HH_
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <vector>
+
+//
+// A concrete version of the pieces the Q13 question (dambuster_questions/Q13.cpp) takes for
+// granted so the different answers can actually be run and timed.
+//
+// The question never says what a vert is or what skinVertex does so I have gone with the
+// usual linear blend skinning setup; a position and normal plus up to 4 bone influences.
+//
+
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+
+struct vert
+{
+  float position[3];
+  float normal[3];
+  u8 bones[4];
+  float weights[4];
+};
+
+//
+// bone transforms are stored as the top 3 rows of a 4x4 matrix since the last row is always
+// {0, 0, 0, 1} for rigid transforms.
+//
+struct mat34
+{
+  float m[3][4];
+};
+
+inline void skinVertex(vert *out, const vert *in, const mat34 *palette)
+{
+  float p[3] {0.f, 0.f, 0.f};
+  float n[3] {0.f, 0.f, 0.f};
+  for(int b {0}; b < 4; ++b){
+    const mat34& M = palette[in->bones[b]];
+    float w = in->weights[b];
+    for(int r {0}; r < 3; ++r){
+      p[r] += w * (M.m[r][0] * in->position[0] + M.m[r][1] * in->position[1] +
+                   M.m[r][2] * in->position[2] + M.m[r][3]);
+      n[r] += w * (M.m[r][0] * in->normal[0] + M.m[r][1] * in->normal[1] +
+                   M.m[r][2] * in->normal[2]);
+    }
+  }
+  std::memcpy(out->position, p, sizeof(p));
+  std::memcpy(out->normal, n, sizeof(n));
+  std::memcpy(out->bones, in->bones, sizeof(in->bones));
+  std::memcpy(out->weights, in->weights, sizeof(in->weights));
+}
+
+//
+// The question's version of Answer 1 but with the DMA transfers replaced by memcpy since I
+// don't have a DMA engine to play with. The 'cache' buffers are just ordinary buffers small
+// enough to stay resident.
+//
+inline void skinCharacter(vert *out, const vert *in, u32 numVerts, const mat34 *palette,
+                          vert *input, vert *output, u32 chunkVerts)
+{
+  while(numVerts){
+    u32 n = numVerts < chunkVerts ? numVerts : chunkVerts;
+    std::memcpy(input, in, n * sizeof(vert));
+    for(u32 i {0}; i < n; ++i)
+      skinVertex(&output[i], &input[i], palette);
+    std::memcpy(out, output, n * sizeof(vert));
+    in += n;
+    out += n;
+    numVerts -= n;
+  }
+}
+
+//
+// Test data. Random unit normals, random positions in a 2m box, weights which sum to 1.
+//
+constexpr int numBones {64};
+
+inline void makeCharacter(vert *verts, u32 numVerts, std::mt19937& rng)
+{
+  std::uniform_real_distribution<float> pos {-1.f, 1.f};
+  std::uniform_int_distribution<int> bone {0, numBones - 1};
+  for(u32 i {0}; i < numVerts; ++i){
+    vert& v = verts[i];
+    for(int k {0}; k < 3; ++k){
+      v.position[k] = pos(rng);
+      v.normal[k] = pos(rng);
+    }
+    float len = std::sqrt(v.normal[0] * v.normal[0] + v.normal[1] * v.normal[1] +
+                          v.normal[2] * v.normal[2]) + 1e-6f;
+    for(int k {0}; k < 3; ++k)
+      v.normal[k] /= len;
+    float sum {0.f};
+    for(int k {0}; k < 4; ++k){
+      v.bones[k] = static_cast<u8>(bone(rng));
+      v.weights[k] = pos(rng) + 1.f;
+      sum += v.weights[k];
+    }
+    for(int k {0}; k < 4; ++k)
+      v.weights[k] /= sum;
+  }
+}
+
+inline void makePalette(mat34 *palette, std::mt19937& rng)
+{
+  std::uniform_real_distribution<float> angle {-3.14159f, 3.14159f};
+  std::uniform_real_distribution<float> offset {-0.5f, 0.5f};
+  for(int b {0}; b < numBones; ++b){
+    float a = angle(rng);
+    float c = std::cos(a), s = std::sin(a);
+    palette[b] = mat34 {{{c, -s, 0.f, offset(rng)},
+                         {s,  c, 0.f, offset(rng)},
+                         {0.f, 0.f, 1.f, offset(rng)}}};
+  }
+}
+
+#endif
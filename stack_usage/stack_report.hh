@@ -0,0 +1,232 @@
+#ifndef _STACK_REPORT_HH_
+#define _STACK_REPORT_HH_
+
+#include "stack_watermark.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//
+// Joins what StackSampler saw with what the compiler says each frame costs.
+//
+// g++ -fstack-usage writes a .su file next to each object, a line per function;
+//
+//   Q14.cpp:44:6:void foo_with_inline_buffer(int, int, char*, char*)	1104	static
+//
+// i.e. where, the function, its frame in bytes and whether that is all of it ('static'), or
+// it also has alloca / VLAs ('dynamic', or 'dynamic,bounded' if the compiler could see a
+// limit). On its own that is a list of big frames, but a big frame called once doesn't matter
+// and a small one recursing a million times does, so the report takes the deepest stack the
+// sampler caught, counts how many times each function is on it and multiplies by its frame.
+//
+
+struct FrameUsage
+{
+  std::string file;
+  int line {0};
+  std::string function;     // as the compiler printed it, e.g. "int a::B::f(int)"
+  std::size_t bytes {0};
+  std::string qualifier;    // static, dynamic or dynamic,bounded
+
+  bool dynamic() const
+  { return qualifier.compare(0, 7, "dynamic") == 0; }
+};
+
+//
+// reads one .su file; lines it can't make sense of are skipped.
+//
+inline std::vector<FrameUsage> readStackUsage(const std::string& path)
+{
+  std::vector<FrameUsage> out;
+  std::ifstream in {path};
+  std::string line;
+  while(std::getline(in, line)){
+    std::size_t tab1 = line.find('\t');
+    std::size_t tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+    if(tab2 == std::string::npos)
+      continue;
+    //
+    // file:line:column:function; the function can have ':'s of its own so split on the
+    // first three.
+    //
+    std::string where = line.substr(0, tab1);
+    std::size_t c1 = where.find(':');
+    std::size_t c2 = c1 == std::string::npos ? c1 : where.find(':', c1 + 1);
+    std::size_t c3 = c2 == std::string::npos ? c2 : where.find(':', c2 + 1);
+    if(c3 == std::string::npos)
+      continue;
+    FrameUsage f;
+    f.file = where.substr(0, c1);
+    f.line = std::atoi(where.c_str() + c1 + 1);
+    f.function = where.substr(c3 + 1);
+    f.bytes = static_cast<std::size_t>(std::strtoull(line.c_str() + tab1 + 1, nullptr, 10));
+    f.qualifier = line.substr(tab2 + 1);
+    out.push_back(std::move(f));
+  }
+  return out;
+}
+
+//
+// the demangled name of the function containing pc, or "" if the dynamic symbol table doesn't
+// know (link with -rdynamic so it knows about everything that isn't static).
+//
+inline std::string functionAt(const void *pc)
+{
+  Dl_info info {};
+  if(!dladdr(pc, &info) || !info.dli_sname)
+    return {};
+  int status {0};
+  char *name = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+  std::string out = status == 0 && name ? name : info.dli_sname;
+  std::free(name);
+  return out;
+}
+
+//
+// the bare qualified name; "int a::B::f<int>(int) const" and "T a::B::f(T) [with T = int]"
+// both become "a::B::f". The demangler and -fstack-usage print templates differently, so this
+// is what the two get matched on when the full names don't agree.
+//
+inline std::string bareName(const std::string& name)
+{
+  std::string s = name.substr(0, name.find(" [with"));
+  //
+  // cut at the parameter list; the first '(' that isn't inside template brackets.
+  //
+  int depth {0};
+  std::size_t end {s.size()};
+  for(std::size_t i {0}; i < s.size(); ++i){
+    if(s[i] == '<')
+      ++depth;
+    else if(s[i] == '>')
+      --depth;
+    else if(s[i] == '(' && depth == 0){
+      end = i;
+      break;
+    }
+  }
+  s.resize(end);
+  //
+  // drop the return type (anything up to the last space outside brackets) and template args.
+  //
+  std::string out;
+  depth = 0;
+  for(char c : s){
+    if(c == '<')
+      ++depth;
+    else if(c == '>')
+      --depth;
+    else if(depth == 0){
+      if(c == ' ')
+        out.clear();
+      else
+        out += c;
+    }
+  }
+  return out;
+}
+
+//
+// the .su entry for a demangled name; the full signature if it matches one (the .su version
+// has the return type in front), otherwise the bare name.
+//
+inline const FrameUsage* findFrame(const std::vector<FrameUsage>& usage, const std::string& function)
+{
+  if(function.empty())
+    return nullptr;
+  for(const FrameUsage& f : usage){
+    const std::string& s = f.function;
+    if(s == function || (s.size() > function.size() &&
+                         s.compare(s.size() - function.size(), function.size(), function) == 0 &&
+                         s[s.size() - function.size() - 1] == ' '))
+      return &f;
+  }
+  std::string bare = bareName(function);
+  for(const FrameUsage& f : usage)
+    if(bareName(f.function) == bare)
+      return &f;
+  return nullptr;
+}
+
+struct StackOffender
+{
+  std::string function;
+  std::size_t calls {0};          // times on the deepest stack
+  std::size_t frameBytes {0};     // from the .su, 0 if it wasn't found
+  bool dynamic {false};
+
+  std::size_t totalBytes() const
+  { return calls * frameBytes; }
+};
+
+//
+// the functions on a thread's deepest sampled stack, worst first.
+//
+inline std::vector<StackOffender> worstOffenders(const StackSampler::ThreadRecord& record,
+                                                 const std::vector<FrameUsage>& usage)
+{
+  std::map<std::string, StackOffender> byName;
+  for(int i {0}; i < record.frames; ++i){
+    //
+    // return addresses point after the call, which may be the first byte of the next
+    // function, so look up the byte before. pcs[0] is where it was interrupted, not a return.
+    //
+    const char *pc = static_cast<const char*>(record.pcs[i]) - (i ? 1 : 0);
+    std::string name = functionAt(pc);
+    if(name.empty()){
+      std::ostringstream unknown;
+      unknown << "?? " << record.pcs[i];
+      name = unknown.str();
+    }
+    StackOffender& o = byName[name];
+    if(!o.calls){
+      o.function = name;
+      if(const FrameUsage *f = findFrame(usage, name)){
+        o.frameBytes = f->bytes;
+        o.dynamic = f->dynamic();
+      }
+    }
+    ++o.calls;
+  }
+  std::vector<StackOffender> out;
+  for(auto& kv : byName)
+    out.push_back(kv.second);
+  std::sort(out.begin(), out.end(), [](const StackOffender& a, const StackOffender& b){
+    return a.totalBytes() != b.totalBytes() ? a.totalBytes() > b.totalBytes() : a.calls > b.calls;
+  });
+  return out;
+}
+
+inline void printStackReport(std::ostream& os, const std::vector<StackSampler::ThreadRecord>& records,
+                             const std::vector<FrameUsage>& usage, std::size_t top = 5)
+{
+  for(const auto& r : records){
+    os << "thread '" << r.name << "' (tid " << r.tid << "): " << r.samples
+       << " samples, deepest " << r.deepest() << " bytes, " << r.frames << " frames"
+       << (r.truncated ? " (truncated)" : "") << std::endl;
+    auto offenders = worstOffenders(r, usage);
+    for(std::size_t i {0}; i < offenders.size() && i < top; ++i){
+      const StackOffender& o = offenders[i];
+      os << "  " << o.function << ": " << o.calls << " x ";
+      if(o.frameBytes)
+        os << o.frameBytes << " = " << o.totalBytes() << " bytes";
+      else
+        os << "? bytes";
+      if(o.dynamic)
+        os << " (+ dynamic)";
+      if(o.calls > 1)
+        os << " recursive";
+      os << std::endl;
+    }
+  }
+}
+
+#endif
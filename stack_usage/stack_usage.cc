@@ -0,0 +1,140 @@
+//
+// The Q14 experiment (dambuster_questions/Q14.cpp) again, measured by the tools in
+// stack_watermark.hh and stack_report.hh instead of by printing addresses.
+//
+// Each of the question's three recursions runs 100 deep on its own thread, which paints its
+// stack first and is sampled while it runs. At the bottom each one spins for a bit so the
+// sampler has a chance to catch it there. Then the painted high water marks are checked
+// against what the frames should cost and the deepest sampled stacks are joined with this
+// file's own -fstack-usage output (see the makefile), which should put the recursion with the
+// 1KiB buffer at the top of the list.
+//
+// usage: stack_usage [file.su]
+//
+
+#include "stack_watermark.hh"
+#include "stack_report.hh"
+
+#include <cassert>
+#include <iostream>
+#include <thread>
+
+constexpr int depth {100};
+
+__attribute__((noinline)) void atBottom()
+{
+  timespec t0, t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+  do
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  while((t.tv_sec - t0.tv_sec) * 1'000'000'000 + (t.tv_nsec - t0.tv_nsec) < 50'000'000);
+}
+
+//
+// the question's three functions, without the printing. Each does something with the result
+// of the recursive call so it isn't a tail call (which -O2 would turn into a loop); the empty
+// asm hides the result from the optimiser, otherwise it spots the sum and makes that a loop
+// too. The buffers are volatile so they are really there.
+//
+inline long long opaque(long long x)
+{
+  asm volatile("" : "+r"(x));
+  return x;
+}
+
+__attribute__((noinline)) long long foo_with_inline_buffer(int depth)
+{
+  volatile char c[1024];
+  for(int i {0}; i < 1024; ++i)
+    c[i] = static_cast<char>(i);
+  if(depth == 0){
+    atBottom();
+    return c[0];
+  }
+  return opaque(foo_with_inline_buffer(depth - 1)) + c[depth];
+}
+
+__attribute__((noinline)) long long allocate_and_pop_a_buffer(int depth)
+{
+  volatile char c[1024];
+  for(int i {0}; i < 1024; ++i)
+    c[i] = static_cast<char>(i);
+  return c[depth];
+}
+
+__attribute__((noinline)) long long foo_with_call_buffer(int depth)
+{
+  long long sum = allocate_and_pop_a_buffer(depth);
+  if(depth == 0){
+    atBottom();
+    return sum;
+  }
+  return opaque(foo_with_call_buffer(depth - 1)) + sum;
+}
+
+__attribute__((noinline)) long long foo(int depth)
+{
+  if(depth == 0){
+    atBottom();
+    return 0;
+  }
+  return opaque(foo(depth - 1)) + 1;
+}
+
+struct Run
+{
+  const char *name;
+  long long (*f)(int);
+  std::size_t painted {0};
+  std::size_t deepest {0};
+};
+
+int main(int argc, char *argv[])
+{
+  std::vector<FrameUsage> usage = readStackUsage(argc > 1 ? argv[1] : "stack_usage.su");
+  std::cout << usage.size() << " functions in the .su" << std::endl;
+
+  StackSampler::start(2000);
+  Run runs[] {{"inline buffer", &foo_with_inline_buffer},
+              {"call buffer", &foo_with_call_buffer},
+              {"foo", &foo}};
+  for(Run& run : runs){
+    std::thread t {[&run]{
+      StackSampler::attach(run.name);
+      StackPaint paint {256 * 1024};
+      volatile long long result = run.f(depth);
+      (void)result;
+      run.painted = paint.used();
+      run.deepest = paint.deepest();
+      StackSampler::detach();
+    }};
+    t.join();
+    std::cout << run.name << ": painted high water " << run.painted << " bytes, "
+              << run.painted / depth << " a frame (" << run.deepest << " from the base)"
+              << std::endl;
+  }
+  //
+  // the inline buffer puts 1KiB on every frame, the others are a small frame a call plus one
+  // 1KiB buffer (or nothing) at the bottom.
+  //
+  assert(runs[0].painted >= depth * 1024);
+  assert(runs[1].painted < depth * 128 + 4096);
+  assert(runs[2].painted < depth * 128 + 4096);
+
+  auto records = StackSampler::records();
+  printStackReport(std::cout, records, usage);
+  for(std::size_t i {0}; i < records.size(); ++i){
+    //
+    // the sampler only sees what is on the stack when it fires so it can be under (it may
+    // never catch the bottom's callees at their deepest), and it can be a little over; rsp
+    // moves down for a frame before its locals are written, and paint only sees the writes.
+    //
+    assert(records[i].samples > 0);
+    assert(records[i].deepest() > 0 && records[i].deepest() <= runs[i].deepest + 256);
+  }
+  auto worst = worstOffenders(records[0], usage);
+  if(!usage.empty()){
+    assert(worst[0].function.find("foo_with_inline_buffer") != std::string::npos);
+    assert(worst[0].calls == depth + 1 && worst[0].frameBytes >= 1024);
+  }
+}
@@ -0,0 +1,316 @@
+#ifndef _STACK_WATERMARK_HH_
+#define _STACK_WATERMARK_HH_
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <vector>
+
+//
+// How deep did the stack get?
+//
+// Q14.cpp worked out the stack cost of a recursive call by printing the address of a local in
+// every call (1104 bytes a frame with the buffer, 80 without). This does the same job for any
+// code without touching it, two ways;
+//
+//  1. Painting. StackPaint fills the unused part of the thread's stack with a known pattern;
+//     later the first word that isn't the pattern any more is as deep as the stack has been
+//     since. Exact (give or take a function which happened to write the pattern) and costs
+//     nothing while the code runs, but it only tells you how deep, not who.
+//
+//  2. Sampling. StackSampler puts a CPU time timer on each attached thread. The signal handler
+//     reads rsp out of the interrupted context and if it is the deepest yet keeps it, along
+//     with the return addresses found by following the frame pointers. So it knows who was on
+//     the stack at the deepest point it saw, but it can miss a short lived peak between samples.
+//     The walk needs -fno-omit-frame-pointer, and -rdynamic if you want names for the
+//     addresses (see stack_report.hh).
+//
+// The handler runs on a per thread alternate signal stack, so the samples don't land in the
+// painted stack and look like usage. Everything here is Linux / x86-64 specific.
+//
+
+struct StackBounds
+{
+  char *low {nullptr};      // the lowest usable address (above the guard)
+  char *high {nullptr};     // the base; the stack grows down from here
+
+  std::size_t size() const
+  { return static_cast<std::size_t>(high - low); }
+};
+
+//
+// the stack of the calling thread. For the main thread glibc reports the rlimit, not what is
+// mapped right now; the kernel grows the mapping as it is touched.
+//
+inline StackBounds currentStackBounds()
+{
+  pthread_attr_t attr;
+  pthread_getattr_np(pthread_self(), &attr);
+  void *addr {nullptr};
+  std::size_t size {0}, guard {0};
+  pthread_attr_getstack(&attr, &addr, &size);
+  pthread_attr_getguardsize(&attr, &guard);
+  pthread_attr_destroy(&attr);
+  StackBounds b;
+  b.low = static_cast<char*>(addr) + guard;
+  b.high = static_cast<char*>(addr) + size;
+  return b;
+}
+
+inline char* currentStackPointer()
+{
+  char *sp;
+  asm volatile("mov %%rsp, %0" : "=r"(sp));
+  return sp;
+}
+
+class StackPaint
+{
+public:
+  static constexpr std::uint64_t pattern {0xdeadbeefcafef00dull};
+
+  //
+  // paints from just below the caller's frame down 'bytes' (0 = to the bottom of the stack,
+  // which on the main thread commits the whole rlimit's worth of pages).
+  //
+  __attribute__((noinline)) explicit StackPaint(std::size_t bytes = 0)
+  {
+    _bounds = currentStackBounds();
+    //
+    // leave some room for this frame; the loop makes no calls, so nothing below rsp gets
+    // written while it runs (bar a signal, which goes on the alternate stack if there is one).
+    //
+    char *top = currentStackPointer() - 256;
+    char *bottom = _bounds.low;
+    if(bytes && bytes < static_cast<std::size_t>(top - bottom))
+      bottom = top - bytes;
+    _top = reinterpret_cast<std::uint64_t*>(reinterpret_cast<std::uintptr_t>(top) & ~std::uintptr_t{7});
+    _bottom = reinterpret_cast<std::uint64_t*>((reinterpret_cast<std::uintptr_t>(bottom) + 7) & ~std::uintptr_t{7});
+    for(volatile std::uint64_t *p = _bottom; p < _top; ++p)
+      *p = pattern;
+  }
+
+  //
+  // bytes of the painted region which have been written since; i.e. how much deeper than the
+  // point StackPaint was made the stack has been. If this is paintedBytes() it went past the
+  // end of the paint and the real figure is higher.
+  //
+  std::size_t used() const
+  {
+    const std::uint64_t *p = _bottom;
+    while(p < _top && *p == pattern)
+      ++p;
+    return static_cast<std::size_t>(reinterpret_cast<const char*>(_top) - reinterpret_cast<const char*>(p));
+  }
+
+  //
+  // as used() but measured from the base of the stack, i.e. the high water mark of the thread.
+  //
+  std::size_t deepest() const
+  { return used() + static_cast<std::size_t>(_bounds.high - reinterpret_cast<const char*>(_top)); }
+
+  std::size_t paintedBytes() const
+  { return static_cast<std::size_t>(reinterpret_cast<const char*>(_top) - reinterpret_cast<const char*>(_bottom)); }
+
+  const StackBounds& bounds() const
+  { return _bounds; }
+
+private:
+  StackBounds _bounds;
+  std::uint64_t *_top {nullptr};
+  std::uint64_t *_bottom {nullptr};
+};
+
+class StackSampler
+{
+public:
+  static constexpr int maxThreads {64};
+  static constexpr int maxFrames {1024};
+
+  //
+  // what the sampler saw on one thread. pcs[0] is where the thread was interrupted at its
+  // deepest sample, then the return addresses of the frames above it, innermost first.
+  //
+  struct ThreadRecord
+  {
+    char name[32] {};
+    pid_t tid {0};
+    char *base {nullptr};
+    char *limit {nullptr};
+    char *lowestSp {nullptr};
+    std::uint64_t samples {0};
+    int frames {0};
+    bool truncated {false};
+    void *pcs[maxFrames] {};
+
+    std::size_t deepest() const
+    { return lowestSp ? static_cast<std::size_t>(base - lowestSp) : 0; }
+  };
+
+  //
+  // installs the handler; attach each thread to be sampled (including the main thread) after.
+  //
+  static void start(int hz = 1000)
+  {
+    period().store(hz > 0 ? 1'000'000'000 / hz : 1'000'000, std::memory_order_relaxed);
+    struct sigaction sa {};
+    sa.sa_sigaction = &handler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, nullptr);
+  }
+
+  //
+  // starts sampling the calling thread; a timer on its own CPU clock, so an idle thread costs
+  // nothing and a busy one gets samples in proportion to the time it runs.
+  //
+  static void attach(const char *name)
+  {
+    Local& local = local_();
+    if(current())
+      return;
+    int slot = count().fetch_add(1, std::memory_order_relaxed);
+    if(slot >= maxThreads)
+      return;
+    ThreadRecord& r = table()[slot];
+    std::strncpy(r.name, name, sizeof(r.name) - 1);
+    r.tid = static_cast<pid_t>(syscall(SYS_gettid));
+    StackBounds bounds = currentStackBounds();
+    r.base = bounds.high;
+    r.limit = bounds.low;
+
+    local.altStack.resize(64 * 1024);
+    stack_t ss {};
+    ss.ss_sp = local.altStack.data();
+    ss.ss_size = local.altStack.size();
+    sigaltstack(&ss, nullptr);
+
+    sigevent sev {};
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+    sev._sigev_un._tid = r.tid;
+    if(timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &local.timer) != 0)
+      return;
+    long ns = period().load(std::memory_order_relaxed);
+    itimerspec its {};
+    its.it_interval.tv_sec = ns / 1'000'000'000;
+    its.it_interval.tv_nsec = ns % 1'000'000'000;
+    its.it_value = its.it_interval;
+    timer_settime(local.timer, 0, &its, nullptr);
+    local.armed = true;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    current() = &r;
+  }
+
+  //
+  // stops sampling the calling thread; its record stays in records().
+  //
+  static void detach()
+  {
+    Local& local = local_();
+    if(!current())
+      return;
+    current() = nullptr;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    if(local.armed)
+      timer_delete(local.timer);
+    local.armed = false;
+    stack_t ss {};
+    ss.ss_flags = SS_DISABLE;
+    sigaltstack(&ss, nullptr);
+  }
+
+  //
+  // the records so far. Only consistent for threads which have detached (or are not running).
+  //
+  static std::vector<ThreadRecord> records()
+  {
+    int n = std::min(count().load(std::memory_order_relaxed), maxThreads);
+    return std::vector<ThreadRecord>(table(), table() + n);
+  }
+
+private:
+  struct Local
+  {
+    timer_t timer {};
+    bool armed {false};
+    std::vector<char> altStack;
+  };
+
+  static Local& local_()
+  {
+    static thread_local Local local;
+    return local;
+  }
+
+  //
+  // the handler's view of the thread; kept apart from Local as a plain pointer so reading it
+  // from the handler never runs a thread_local constructor.
+  //
+  static ThreadRecord*& current()
+  {
+    static thread_local ThreadRecord *record {nullptr};
+    return record;
+  }
+
+  static ThreadRecord* table()
+  {
+    static ThreadRecord records[maxThreads];
+    return records;
+  }
+
+  static std::atomic<int>& count()
+  {
+    static std::atomic<int> n {0};
+    return n;
+  }
+
+  static std::atomic<long>& period()
+  {
+    static std::atomic<long> ns {1'000'000};
+    return ns;
+  }
+
+  static void handler(int, siginfo_t*, void *context)
+  {
+    ThreadRecord *r = current();
+    if(!r)
+      return;
+    const mcontext_t& mc = static_cast<ucontext_t*>(context)->uc_mcontext;
+    char *sp = reinterpret_cast<char*>(mc.gregs[REG_RSP]);
+    ++r->samples;
+    if(sp < r->limit || sp >= r->base)
+      return;   // not on this thread's stack (a fiber or some other stack), ignore it.
+    if(r->lowestSp && sp >= r->lowestSp)
+      return;
+    r->lowestSp = sp;
+    r->pcs[0] = reinterpret_cast<void*>(mc.gregs[REG_RIP]);
+    int n {1};
+    //
+    // each frame is [saved rbp][return address]; only follow a frame pointer that is above
+    // the last one and still on this stack, so a function built without frame pointers (or
+    // interrupted in its prologue) ends the walk rather than sending it off into the weeds.
+    //
+    char *fp = reinterpret_cast<char*>(mc.gregs[REG_RBP]);
+    char *prev = sp;
+    while(n < maxFrames && fp >= prev && fp + 16 <= r->base &&
+          (reinterpret_cast<std::uintptr_t>(fp) & 7) == 0){
+      void **frame = reinterpret_cast<void**>(fp);
+      r->pcs[n++] = frame[1];
+      prev = fp + 16;
+      fp = static_cast<char*>(frame[0]);
+    }
+    r->frames = n;
+    r->truncated = n == maxFrames;
+  }
+};
+
+#endif